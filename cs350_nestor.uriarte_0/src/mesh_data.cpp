@@ -22,182 +22,399 @@ The functions included are:
 
 
 #include "pch.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <thread>
+#include "file.hpp"
 #include "mesh_data.hpp"
 
 namespace cs350 {
 
+	//bytes of the file each task parses at least (small files are parsed by a single one)
+	static const size_t c_chunk_min_size = 1 << 20;
+
+	//elements on a piece of the file (faces as the triangles they are split in)
+	struct obj_counts
+	{
+		size_t positions;
+		size_t uvs;
+		size_t normals;
+		size_t faces;
+	};
+
 	/**************************************************************************
 	*!
-	\fn     load_obj
+	\fn     next_line
 
-	\brief 
-	Parses an .obj file to a mesh data structure
+	\brief
+	Finds the start of the line after the one p is on
 
-	\param  const char* filename
-	the .obj filename
+	\param  char const* p
+	\param  char const* end
+	the end of the file
 
-	\return mesh_data
-	The mesh data structure with the parsed data
+	\return char const*
+	the start of the next line, or end
 
 	*
 	**************************************************************************/
-	mesh_data load_obj(const char* filename)
+	static char const* next_line(char const* p, char const* end)
 	{
-		//getting the file and opening it
-		std::ifstream infile(filename);
+		p = static_cast<char const*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+		return p != nullptr ? p + 1 : end;
+	}
 
-		//if it was properly opened
-		assert(infile.is_open() != false);
+	/**************************************************************************
+	*!
+	\fn     skip_blanks
 
-		//struct that will contain the  parsed data
-		mesh_data parsed;
+	\brief
+	Skips spaces, tabs and carriage returns
 
-		//while not at the end of the file
-		while (!infile.eof())
-		{
-			//string to store the line start
-			std::string lineStart;
+	\param  char const* p
+	\param  char const* end
 
-			//getting the first word
-			infile >> lineStart;
+	\return char const*
 
-			//if is a v means the following data is a position
-			if (lineStart == "v")
-			{
-				//string to contain the data
-				std::string values;
+	*
+	**************************************************************************/
+	static char const* skip_blanks(char const* p, char const* end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			p++;
+		return p;
+	}
 
-				//struct to store the values
-				glm::vec3 vertex;
+	/**************************************************************************
+	*!
+	\fn     line_type
 
-				//getting the values, converting them to decimal and storing them
-				infile >> values;
-				vertex.x = static_cast<float>(atof(values.data()));
+	\brief
+	Gets the keyword a line starts with, moving past it
 
-				infile >> values;
-				vertex.y = static_cast<float>(atof(values.data()));
+	\param  char const*& p
+	the start of the line
+	\param  char const* end
 
-				infile >> values;
-				vertex.z = static_cast<float>(atof(values.data()));
+	\return char
+	'v', 't' (vt), 'n' (vn), 'f' or 0 for the lines that are not parsed
 
-				//adding it to the positions
-				parsed.positions.push_back(vertex);
+	*
+	**************************************************************************/
+	static char line_type(char const*& p, char const* end)
+	{
+		p = skip_blanks(p, end);
+		if (end - p < 2)
+			return 0;
+
+		//a single letter keyword is followed by a blank
+		char type = 0;
+		if ((p[0] == 'v' || p[0] == 'f') && (p[1] == ' ' || p[1] == '\t'))
+			type = p[0];
+		else if (p[0] == 'v' && (p[1] == 't' || p[1] == 'n') && end - p > 2 && (p[2] == ' ' || p[2] == '\t'))
+			type = p[1];
+
+		if (type != 0)
+			p += type == 'v' || type == 'f' ? 1 : 2;
+		return type;
+	}
 
-			}
-			//if is a v means the following data is a texture coordinate
-			else if (lineStart == "vt")
-			{
-				//string to contain the data
-				std::string values;
+	/**************************************************************************
+	*!
+	\fn     parse_float
 
-				//struct to store the values
-				glm::vec2 uv;
+	\brief
+	Parses the next number of a line
 
-				//getting the values, converting them to decimal and storing them
-				infile >> values;
-				uv.x = static_cast<float>(atof(values.data()));
+	\param  char const* p
+	\param  char const* end
+	the end of the line
+	\param  float& value
+	set to 0 if there is no number
 
-				infile >> values;
-				uv.y = static_cast<float>(atof(values.data()));
+	\return char const*
+	past the number
 
-				//adding it to the uvs
-				parsed.uvs.push_back(uv);
-			}
-			//if is a v means the following data is a normal vector
-			else if (lineStart == "vn")
-			{
-				//string to contain the data
-				std::string values;
+	*
+	**************************************************************************/
+	static char const* parse_float(char const* p, char const* end, float& value)
+	{
+		p = skip_blanks(p, end);
 
-				//struct to store the values
-				glm::vec3 normal;
+		//from_chars does not take the plus sign
+		if (p < end && *p == '+')
+			p++;
 
-				//getting the values, converting them to decimal and storing them
-				infile >> values;
-				normal.x = static_cast<float>(atof(values.data()));
+		auto result = std::from_chars(p, end, value);
+		if (result.ec != std::errc())
+		{
+			value = 0.0F;
+			return p;
+		}
+		return result.ptr;
+	}
 
-				infile >> values;
-				normal.y = static_cast<float>(atof(values.data()));
+	/**************************************************************************
+	*!
+	\fn     parse_index
 
-				infile >> values;
-				normal.z = static_cast<float>(atof(values.data()));
+	\brief
+	Parses an index of a face vertex, 1 based or relative to the end of the elements read so far
 
-				//adding it to the normals
-				parsed.normals.push_back(normal);
-			}
-			else if (lineStart == "f")
+	\param  char const* p
+	\param  char const* end
+	\param  size_t count
+	elements read before the line
+	\param  int& index
+	0 based, -1 if there is none
+
+	\return char const*
+	past the index
+
+	*
+	**************************************************************************/
+	static char const* parse_index(char const* p, char const* end, size_t count, int& index)
+	{
+		int value = 0;
+		auto result = std::from_chars(p, end, value);
+		if (result.ec != std::errc() || value == 0)
+		{
+			index = -1;
+			return result.ec != std::errc() ? p : result.ptr;
+		}
+
+		index = value > 0 ? value - 1 : static_cast<int>(count) + value;
+		return result.ptr;
+	}
+
+	/**************************************************************************
+	*!
+	\fn     count_chunk
+
+	\brief
+	Counts the elements of the lines starting in a piece of the file
+
+	\param  char const* begin
+	the start of a line
+	\param  char const* end
+	the start of a line, or the end of the file
+
+	\return obj_counts
+
+	*
+	**************************************************************************/
+	static obj_counts count_chunk(char const* begin, char const* end)
+	{
+		obj_counts counts{ 0, 0, 0, 0 };
+
+		for (char const* line = begin; line < end; line = next_line(line, end))
+		{
+			char const* p = line;
+			switch (line_type(p, end))
 			{
-				//string to contain the data
-				std::string values;
-
-				//reading the whole line
-				std::getline(infile, values);
-
-				//static arrays to store the data
-				int vertexIndex[] = { 0,0,0 };
-				int uvIndex[]     = { 0,0,0 };
-				int normalIndex[] = { 0,0,0 };
-
-				//structure to store all the data of a face
-				glm::vec<3, glm::ivec3> faceData;
-				
-				//if both uvs and normals are not given the format of the face data is: num  num  num
-				if(parsed.uvs.empty() && parsed.normals.empty())
-				{
-					//parsing the line and getting the data amount
-					sscanf_s(values.c_str(), "%d  %d  %d",
-									&vertexIndex[0],  
-									&vertexIndex[1],  
-									&vertexIndex[2]);
-				}
-				else if (parsed.uvs.empty())//if only the uvs were not given the format is: num//num  num//num  num//num
-				{
-					//parsing the line and getting the data amount
-					sscanf_s(values.c_str(), "%d//%d  %d//%d  %d//%d",
-									&vertexIndex[0], &normalIndex[0], 
-									&vertexIndex[1], &normalIndex[1], 
-									&vertexIndex[2], &normalIndex[2]);
-				}
-				else//if all the data was given the format is: num/num/num  num/num/num  num/num/num
+			case 'v':
+				counts.positions++;
+				break;
+			case 't':
+				counts.uvs++;
+				break;
+			case 'n':
+				counts.normals++;
+				break;
+			case 'f':
+			{
+				//a polygon of n vertices is split in n - 2 triangles
+				char const* eol = next_line(p, end);
+				size_t vertices = 0;
+				for (p = skip_blanks(p, eol); p < eol && *p != '\n'; p = skip_blanks(p, eol))
 				{
-					//parsing the line and getting the data amount
-					sscanf_s(values.c_str(), "%d/%d/%d  %d/%d/%d  %d/%d/%d",
-							&vertexIndex[0], &uvIndex[0],&normalIndex[0], 
-							&vertexIndex[1], &uvIndex[1],&normalIndex[1], 
-							&vertexIndex[2], &uvIndex[2],&normalIndex[2]);
+					vertices++;
+					while (p < eol && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+						p++;
 				}
+				counts.faces += vertices > 2 ? vertices - 2 : 0;
+				break;
+			}
+			default:
+				break;
+			}
+		}
 
-				//changing the index values to be from 1 -> n to 0 -> n-1
+		return counts;
+	}
 
-				//in this struct of 3 vectors of ints each vector represents a vertex 
-				//and the x coordinate is for position, the y for the uvs and the z for the normals
-				faceData[0].x = vertexIndex[0] - 1;
-				faceData[1].x = vertexIndex[1] - 1;
-				faceData[2].x = vertexIndex[2] - 1;
+	/**************************************************************************
+	*!
+	\fn     parse_chunk
+
+	\brief
+	Parses the lines starting in a piece of the file into the arrays of the mesh,
+	starting at the elements of the previous pieces
 
-				faceData[0].y = uvIndex[0] - 1;
-				faceData[1].y = uvIndex[1] - 1;
-				faceData[2].y = uvIndex[2] - 1;
+	\param  char const* begin
+	\param  char const* end
+	\param  obj_counts first
+	elements of the previous pieces
+	\param  mesh_data& parsed
+	with the arrays already sized
+
+	*
+	**************************************************************************/
+	static void parse_chunk(char const* begin, char const* end, obj_counts first, mesh_data& parsed)
+	{
+		obj_counts next = first;
 
-				faceData[0].z = normalIndex[0] - 1;
-				faceData[1].z = normalIndex[1] - 1;
-				faceData[2].z = normalIndex[2] - 1;
+		for (char const* line = begin; line < end; line = next_line(line, end))
+		{
+			char const* p = line;
+			char type = line_type(p, end);
+			if (type == 0)
+				continue;
 
-				//storing the data
-				parsed.faces.push_back(faceData);
+			char const* eol = next_line(p, end);
 
+			if (type == 'v' || type == 'n')
+			{
+				glm::vec3 value;
+				p = parse_float(p, eol, value.x);
+				p = parse_float(p, eol, value.y);
+				parse_float(p, eol, value.z);
+
+				if (type == 'v')
+					parsed.positions[next.positions++] = value;
+				else
+					parsed.normals[next.normals++] = value;
 			}
-			else//in case is a useless data
+			else if (type == 't')
 			{
-				//string to store it
-				std::string dummyString;
+				glm::vec2 uv;
+				p = parse_float(p, eol, uv.x);
+				parse_float(p, eol, uv.y);
+				parsed.uvs[next.uvs++] = uv;
+			}
+			else
+			{
+				//each vertex is position, position/uv, position//normal or position/uv/normal
+				//and the x coordinate is for position, the y for the uvs and the z for the normals
+				glm::ivec3 firstVertex{ -1 };
+				glm::ivec3 prevVertex{ -1 };
+				int vertices = 0;
 
-				//reading the line
-				std::getline(infile, dummyString);
+				for (p = skip_blanks(p, eol); p < eol && *p != '\n'; p = skip_blanks(p, eol))
+				{
+					glm::ivec3 vertex{ -1 };
+					p = parse_index(p, eol, next.positions, vertex.x);
+					if (p < eol && *p == '/')
+					{
+						p++;
+						if (p < eol && *p != '/')
+							p = parse_index(p, eol, next.uvs, vertex.y);
+						if (p < eol && *p == '/')
+							p = parse_index(p + 1, eol, next.normals, vertex.z);
+					}
+
+					//skipping anything left of the vertex
+					while (p < eol && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+						p++;
+
+					//fan of triangles around the first vertex
+					if (vertices == 0)
+						firstVertex = vertex;
+					else if (vertices >= 2)
+						parsed.faces[next.faces++] = glm::vec<3, glm::ivec3>(firstVertex, prevVertex, vertex);
+
+					prevVertex = vertex;
+					vertices++;
+				}
 			}
+		}
+	}
+
+	/**************************************************************************
+	*!
+	\fn     load_obj
 
+	\brief 
+	Parses an .obj file to a mesh data structure. The file is mapped and split in
+	pieces at line starts, each piece parsed by a task: a first pass counts the
+	elements of every piece, so the arrays are sized once and each piece knows
+	where its elements go, and a second pass parses them in place
+
+	\param  const char* filename
+	the .obj filename
+
+	\return mesh_data
+	The mesh data structure with the parsed data
+
+	*
+	**************************************************************************/
+	mesh_data load_obj(const char* filename)
+	{
+		//empty files can not be mapped, they are an empty mesh
+		std::error_code error;
+		if (std::filesystem::file_size(filename, error) == 0 && !error)
+			return mesh_data();
+
+		//mapping the whole file
+		mapped_file file(filename);
+
+		//if it was properly opened
+		assert(file.is_open() != false);
+
+		//struct that will contain the  parsed data
+		mesh_data parsed;
+		if (!file.is_open())
+			return parsed;
+
+		char const* begin = file.data();
+		char const* end = begin + file.size();
+
+		//a piece per core, moving the cuts to the start of the next line
+		size_t cores = std::max(1u, std::thread::hardware_concurrency());
+		size_t chunks = std::clamp<size_t>(file.size() / c_chunk_min_size, 1, cores);
+		std::vector<char const*> cuts(chunks + 1, end);
+		cuts[0] = begin;
+		for (size_t i = 1; i < chunks; i++)
+			cuts[i] = std::max(cuts[i - 1], next_line(begin + file.size() * i / chunks, end));
+
+		//runs a function on every piece, the calling thread takes the first one
+		auto run = [&](auto const& fn) {
+			std::vector<std::future<void>> tasks;
+			for (size_t i = 1; i < chunks; i++)
+				tasks.push_back(std::async(std::launch::async, fn, i));
+			fn(size_t(0));
+			for (auto& it : tasks)
+				it.get();
+		};
+
+		//counting the elements of each piece
+		std::vector<obj_counts> counts(chunks);
+		run([&](size_t i) { counts[i] = count_chunk(cuts[i], cuts[i + 1]); });
+
+		//the elements of a piece go after the ones of the previous pieces
+		std::vector<obj_counts> firsts(chunks);
+		obj_counts total{ 0, 0, 0, 0 };
+		for (size_t i = 0; i < chunks; i++)
+		{
+			firsts[i] = total;
+			total.positions += counts[i].positions;
+			total.uvs += counts[i].uvs;
+			total.normals += counts[i].normals;
+			total.faces += counts[i].faces;
 		}
 
+		//sizing the arrays once
+		parsed.positions.resize(total.positions);
+		parsed.uvs.resize(total.uvs);
+		parsed.normals.resize(total.normals);
+		parsed.faces.resize(total.faces);
+
+		//parsing every piece in place
+		run([&](size_t i) { parse_chunk(cuts[i], cuts[i + 1], firsts[i], parsed); });
+
 		//returning the mesh data with all the information
 		return parsed;
 	}
@@ -1,319 +1,155 @@
 /**
-* @file	bvh.hpp 
+* @file	bvh.hpp
 * @author Nestor Uriarte ,540000817, nestor.uriarte@digipen.edu
-* @date	Fri Oct 23 20:15:04 2020  
+* @date	Fri Oct 23 20:15:04 2020
 * @brief	Contains the definition of the BVH tree class and basic functionality The camera that will be used on the project.
 * @copyright Copyright (C) 2020 DigiPen Institute of Technology .
 */
 #pragma once
-#include "pch.hpp"
-#include "imgui.hpp"
 #include "geometry.hpp"
+#include "flat_bvh.hpp"
 
 namespace cs350
 {
-	template <typename T>
-	struct Node
+	enum class TreeMethod
 	{
-		enum class NodeType
-		{
-			Node,
-			Leaf
-		};
-
-		Node(const std::vector<T>& container);
-		Node();
-		Node* mLeft;
-		Node* mRight;
-		Node* mParent;
-		bool mVisible;
-
-		NodeType mType;
-		std::vector<T> mInside;
+		TopDown,
+		BottomUp,
+		Incremental
 	};
 
+/**
+* @brief	Gets the bounds of a triangle for the BVH builders
+* @param	const triangle& tri
+* @return	bvh_bounds
+**/
+	inline bvh_bounds bounds_of(const triangle& tri)
+	{
+		return bvh_bounds::of_triangle(tri.mV0, tri.mV1, tri.mV2);
+	}
+
+	/**
+	* BVH over a container of primitives. Nodes only store their bounds and leaves a range of the primitive
+	* index array of the tree (see flat_bvh), so the primitives are never copied into the tree. The container
+	* must outlive the tree, and the tree has to be initialized again when the container changes.
+	* bounds_of(const T&) gives the bounds of a primitive
+	**/
 	template <typename T>
 	class BVHTree
 	{
 	public:
-		BVHTree();
-		~BVHTree();
-		void Initialize(const std::vector<T>& container);
-		void Initialize(Node<T>** root);
-		void InsertNode(Node<T>* parent, Node<T>** node, const std::vector<T>& container);
-		void MergeNodes(Node<T>** toAdd, Node<T>** pos);
-		void UpdateParent(Node<T>* parent);
-		Node<T>* GetRoot();
+		void Initialize(const std::vector<T>& container, TreeMethod method, unsigned seed = 0);
 		void clear();
-	private:
-
-		void CreateNode(Node<T>* parent, Node<T>** target, const std::vector<T>& container);
-		void Clear(Node<T>** node);
-		void FreeNode(Node<T>** node);
 
-		Node<T>* mRoot;
+		bool IsEmpty() const;
+		const flat_bvh& GetTree() const;
+		const bvh_node& GetNode(uint32_t node) const;
+		unsigned GetPrimitiveCount(uint32_t node) const;
 
-	};
+		//calls fn(const T&) for every primitive under a node
+		template <typename F>
+		void ForEachPrimitive(uint32_t node, F const& fn) const;
 
-/**
-* @brief	Default constructor of the class
-**/
-	template<typename T>
-	BVHTree<T>::BVHTree()
-	{
-		//setting the root as null
-		mRoot = nullptr;
-	}
+	private:
 
-/**
-* @brief	Destructor of the class
-**/
-	template<typename T>
-	BVHTree<T>::~BVHTree()
-	{
-		//calling to clear the tree
-		Clear(&mRoot);
-	}
+		const std::vector<T>* mContainer = nullptr;
+		flat_bvh mTree;
+	};
 
 /**
-* @brief	Initialiuzes the tree
+* @brief	Builds the tree over a container
 * @param	const std::vector<T>& container
+* @param	TreeMethod method
+* @param	unsigned seed, of the insertion order of the incremental method
 **/
 	template<typename T>
-	void BVHTree<T>::Initialize(const std::vector<T>& container)
+	void BVHTree<T>::Initialize(const std::vector<T>& container, TreeMethod method, unsigned seed)
 	{
-		//creates a node with the given data
-		CreateNode(nullptr, &mRoot, container);
-	}
+		mContainer = &container;
 
-/**
-* @brief	Initializes the tree
-* @param	Node<T>** root
-**/
-	template<typename T>
-	void BVHTree<T>::Initialize(Node<T>** root)
-	{
-		//if the pointer is valid
-		if (root != nullptr)
+		//the builders only need the bounds of the primitives
+		std::vector<bvh_bounds> bounds;
+		bounds.reserve(container.size());
+		for (unsigned i = 0; i < container.size(); i++)
+			bounds.push_back(bounds_of(container[i]));
+
+		switch (method)
 		{
-			//setting the root
-			mRoot = *root;
-			mRoot->mParent = nullptr;
+		case TreeMethod::BottomUp:
+			mTree = build_bottom_up_ploc(bounds);
+			break;
+		case TreeMethod::Incremental:
+			mTree = build_incremental(bounds, seed);
+			break;
+		default:
+			mTree = build_top_down(bounds);
+			break;
 		}
-
-	}
-
-/**
-* @brief	Creates a node
-* @param	Node<T>* parent
-* @param	Node<T>** target
-* @param	const std::vector<T>& container
-**/
-	template<typename T>
-	void BVHTree<T>::CreateNode(Node<T>* parent, Node<T>** target, const std::vector<T>& container)
-	{
-		//crate a new node
-		Node<T>* new_node = new Node<T>(container);
-
-		//checking is valid
-		assert(new_node != nullptr);
-	
-		//setting the pointer
-		*target = new_node;
-
-		//if the parent is valid set it
-		if (parent != nullptr)
-			(*target)->mParent = parent;
-		else
-			(*target)->mParent = nullptr;
-
 	}
 
 /**
 * @brief	Clears the tree
-* @param	Node<T>** node
 **/
 	template<typename T>
-	void BVHTree<T>::Clear(Node<T>** node)
-	{
-		//if the pointer is valid
-		if (*node == nullptr)
-			return;
-
-		//calling to free the left and right ndes
-		Clear(&((*node)->mLeft));
-		Clear(&((*node)->mRight));
-	
-		//freenig the node
-		FreeNode(node);
-	}
-
-/**
-* @brief	Frees a node
-* @param	Node<T>** node
-**/
-	template<typename T>
-	void BVHTree<T>::FreeNode(Node<T>** node)
-	{
-		//if the pointer is valid
-		if (*node == nullptr)
-			return;
-
-		//delete the allocated memory
-		delete *node;
-
-		//setting the node point to null
-		*node = nullptr;
-	}
-
-/**
-* @brief	Inserts a node
-* @param	Node<T>* parent
-* @param	Node<T>** node
-* @param	const std::vector<T>& container
-**/
-	template<typename T>
-	void BVHTree<T>::InsertNode(Node<T>* parent, Node<T>** node, const std::vector<T>& container)
-	{
-		//creates a node and sets it
-		CreateNode(parent, node, container);
-	
-		//if the tree has no root initialize it with the given one
-		if (mRoot == nullptr)
-			Initialize(node);
-	}
-
-/**
-* @brief	Merges two nodes
-* @param	Node<T>** node
-* @param	Node<T>** pos
-**/
-	template<typename T>
-	void BVHTree<T>::MergeNodes(Node<T>** toAdd, Node<T>** pos)
+	void BVHTree<T>::clear()
 	{
-		
-		//if the tree has no root initialize it with the given one
-		if (mRoot == nullptr)
-		{
-			Initialize(toAdd);
-			return;
-		}
-
-		//node to contain the new node
-		Node<T>* node = nullptr;
-
-		//parent node of the one in tne tree
-		Node<T>* parent = (*pos)->mParent;
-
-		//creating a new vector with the one to add and the one in the tree
-		std::vector<T> merged = (*toAdd)->mInside;
-		merged.insert(merged.end(), (*pos)->mInside.begin(), (*pos)->mInside.end());
-
-		//creates a node
-		CreateNode(parent, &node, merged);
-
-		//setting the type of the node, the left and right
-		node->mType = Node<T>::NodeType::Node;
-
-		node->mLeft = *pos;
-		node->mRight = *toAdd;
-
-		//updating the parent of the affected nodes 
-		(*pos)->mParent = node;
-		(*toAdd)->mParent = node;
-
-		//if the parent is valid
-		if (parent != nullptr)
-		{
-			//check where to insert the new node
-			if (parent->mLeft == *pos)
-				parent->mLeft = node;
-			else
-				parent->mRight = node;
-		}
-		else//if the parent is null we want to add it to the root
-			mRoot = node;
-
-		//updating the parents up t this node
-		UpdateParent(node->mParent);
-
+		mContainer = nullptr;
+		mTree.clear();
 	}
 
 /**
-* @brief	Update parents
-* @param	Node<T>* parent
+* @brief	Checks if the tree has no nodes
+* @return	bool
 **/
 	template<typename T>
-	void BVHTree<T>::UpdateParent(Node<T>* parent)
+	bool BVHTree<T>::IsEmpty() const
 	{
-		//if the pointer is null
-		if (parent == nullptr)
-			return;
-
-		//creating a new vector with the containers on the left and right nodes
-		std::vector<T> newVec;
-
-		newVec = parent->mLeft->mInside;
-		newVec.insert(newVec.end(), parent->mRight->mInside.begin(), parent->mRight->mInside.end());
-
-		//setting the container
-		parent->mInside = newVec;
-
-		//calling to update the parent
-		UpdateParent(parent->mParent);
+		return mTree.empty();
 	}
 
 /**
-* @brief	Gets the root
+* @brief	Gets the nodes and the primitive index array
+* @return	const flat_bvh&
 **/
 	template<typename T>
-	Node<T>* BVHTree<T>::GetRoot()
+	const flat_bvh& BVHTree<T>::GetTree() const
 	{
-		//retuning the root
-		return mRoot;
+		return mTree;
 	}
 
 /**
-* @brief	Clears the tree
+* @brief	Gets a node, the root is the node 0
+* @param	uint32_t node
+* @return	const bvh_node&
 **/
 	template<typename T>
-	void BVHTree<T>::clear()
+	const bvh_node& BVHTree<T>::GetNode(uint32_t node) const
 	{
-		//calling to the private member clear
-		Clear(&mRoot);
+		return mTree.nodes[node];
 	}
 
 /**
-* @brief	Non Default Constructor of the class
-* @param	const std::vector<T>& container
+* @brief	Counts the primitives under a node
+* @param	uint32_t node
+* @return	unsigned
 **/
 	template<typename T>
-	Node<T>::Node(const std::vector<T>& container)
+	unsigned BVHTree<T>::GetPrimitiveCount(uint32_t node) const
 	{
-		//setting the values
-		mLeft = nullptr;
-		mRight = nullptr;
-		mVisible = false;
-
-		mType = Node<T>::NodeType::Leaf;
-		
-		mInside = container;
+		unsigned count = 0;
+		for_each_primitive(mTree, node, [&](uint32_t) { count++; });
+		return count;
 	}
 
 /**
-* @brief	Default Constructor of the class
+* @brief	Visits the primitives under a node
+* @param	uint32_t node
+* @param	F const& fn
 **/
 	template<typename T>
-	inline Node<T>::Node()
+	template<typename F>
+	void BVHTree<T>::ForEachPrimitive(uint32_t node, F const& fn) const
 	{
-		//setting the values
-		mLeft = nullptr;
-		mRight = nullptr;
-		mVisible = false;
-		mParent = nullptr;
-
-		mType = Node<T>::NodeType::Leaf;
-
+		for_each_primitive(mTree, node, [&](uint32_t index) { fn((*mContainer)[index]); });
 	}
 }
-
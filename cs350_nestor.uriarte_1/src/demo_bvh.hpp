@@ -12,20 +12,6 @@
 
 namespace cs350 {
 
-	enum class TreeMethod
-	{
-		TopDown,
-		BottomUp,
-		Incremental
-	};
-
-	enum class AXIS
-	{
-		X,
-		Y,
-		Z
-	};
-
 	class demo_bvh {
 	private:
 		// For camera update
@@ -42,35 +28,17 @@ namespace cs350 {
 		void Edit();
 		void renderGui();
 		bool EditBVH();
-		void RenderBVH(Node<triangle>* target, bool render);
-		void EditNode(Node<triangle>* current, bool render, bool triangles);
+		void RenderBVH(const BVHTree<triangle>& tree, uint32_t node, bool triangles);
+		void EditNode(const BVHTree<triangle>& tree, uint32_t node, bool render, bool triangles);
 
 		//BVH related
 		void RecomputeTree();
+		void BuildTree();
+		BVHTree<triangle>& GetTree();
 		std::vector<triangle>& GetTriangles();
-		aabb ComputeAABB(std::vector<triangle>& toBound);
-		glm::vec3 ComputeCentre(triangle& triangle);
-		AXIS GetPartitionAxis(std::vector<triangle>& container);
-		float GetSurfaceArea(std::vector<triangle>& container);
-
-		//Top Down
-		void Partition(std::vector<triangle>& container, std::vector<triangle>& right, std::vector<triangle>& left);
-		void TopDown(Node<triangle>* current);
-
-		//Bottom Up
-		void BottomUp();
-		std::vector<triangle> GetClosestNodes(std::vector<Node<triangle>*>& nodes, int count,int* left, int* right);
-
-
-		//Incremental
-		void Incremental();
-		void GetBestNode(const Node<triangle>* target, Node<triangle>* current, float& area, Node<triangle>** bestNode);
-
 
 	private:
 
-		const int MIN_TRIANGLES = 1;
-
 		bool mRenderBVH;
 		bool mRenderBVHTrangles;
 
@@ -78,6 +46,9 @@ namespace cs350 {
 		BVHTree<triangle> mBottomUp;
 		BVHTree<triangle> mIncremental;
 
+		//whether the volume of each node of the current tree is rendered
+		std::vector<bool> mVisible;
+
 		TreeMethod mMethod;
 
 		std::vector<GameObject> mObjs;
@@ -0,0 +1,900 @@
+/**
+* @file	flat_bvh.cpp
+* @author Nestor Uriarte ,540000817, nestor.uriarte@digipen.edu
+* @date	Fri Oct 23 20:15:04 2020
+* @brief	Contains the implementation of the flat BVH and its builders. It does not include pch.hpp, which
+*		pulls in the renderer, so the library links without OpenGL.
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <utility>
+#include "flat_bvh.hpp"
+
+namespace cs350
+{
+	namespace
+	{
+		//same epsilon the demo used to classify the triangles against the split plane
+		const float cSplitEpsilon = 1e-6F;
+		const uint32_t cNone = std::numeric_limits<uint32_t>::max();
+
+		/**
+		* Node of a tree built bottom up or incrementally, before it is laid out as a flat tree
+		**/
+		struct build_node
+		{
+			bvh_bounds bounds;
+			uint32_t left = cNone;
+			uint32_t right = cNone;
+			uint32_t parent = cNone;
+			uint32_t primitive = cNone;
+
+			bool is_leaf() const { return left == cNone; }
+		};
+
+/**
+* @brief	Gets the axis in which the bounds are the longest
+* @param	const bvh_bounds& bounds
+* @return	int
+**/
+		int longest_axis(const bvh_bounds& bounds)
+		{
+			glm::vec3 diff = bounds.max - bounds.min;
+
+			if (diff.x >= diff.y)
+				return diff.x >= diff.z ? 0 : 2;
+
+			return diff.y >= diff.z ? 1 : 2;
+		}
+
+/**
+* @brief	Lays out a built tree depth first, with the children of every node next to each other
+* @param	const std::vector<N>& nodes, build_node or dynamic_bvh::node
+* @param	uint32_t root
+* @return	flat_bvh
+**/
+		template <typename N>
+		flat_bvh flatten(const std::vector<N>& nodes, uint32_t root)
+		{
+			flat_bvh tree;
+			tree.nodes.reserve(nodes.size());
+			tree.primitives.reserve(nodes.size() / 2 + 1);
+			tree.nodes.push_back({});
+
+			//pairs of built node and node of the flat tree it goes to
+			std::vector<std::pair<uint32_t, uint32_t>> stack;
+			stack.push_back({ root, 0 });
+
+			while (!stack.empty())
+			{
+				auto [source, target] = stack.back();
+				stack.pop_back();
+
+				const N& node = nodes[source];
+				tree.nodes[target].bounds = node.bounds;
+
+				if (node.is_leaf())
+				{
+					tree.nodes[target].first = static_cast<uint32_t>(tree.primitives.size());
+					tree.nodes[target].count = 1;
+					tree.primitives.push_back(node.primitive);
+					continue;
+				}
+
+				uint32_t left = static_cast<uint32_t>(tree.nodes.size());
+				tree.nodes.push_back({});
+				tree.nodes.push_back({});
+				tree.nodes[target].first = left;
+				tree.nodes[target].count = 0;
+
+				stack.push_back({ node.right, left + 1 });
+				stack.push_back({ node.left, left });
+			}
+
+			return tree;
+		}
+
+/**
+* @brief	Creates a leaf per primitive
+* @param	std::span<const bvh_bounds> primitives
+* @return	std::vector<build_node>
+**/
+		std::vector<build_node> make_leaves(std::span<const bvh_bounds> primitives)
+		{
+			//a tree with n leaves has 2n - 1 nodes
+			std::vector<build_node> nodes;
+			nodes.reserve(2 * primitives.size());
+			nodes.resize(primitives.size());
+
+			for (uint32_t i = 0; i < primitives.size(); i++)
+			{
+				nodes[i].bounds = primitives[i];
+				nodes[i].primitive = i;
+			}
+
+			return nodes;
+		}
+
+/**
+* @brief	Spreads the lower 10 bits of a value so there are two zero bits between each of them
+* @param	uint32_t value
+* @return	uint32_t
+**/
+		uint32_t expand_bits(uint32_t value)
+		{
+			value = (value * 0x00010001U) & 0xFF0000FFU;
+			value = (value * 0x00000101U) & 0x0F00F00FU;
+			value = (value * 0x00000011U) & 0xC30C30C3U;
+			value = (value * 0x00000005U) & 0x49249249U;
+			return value;
+		}
+
+/**
+* @brief	Computes the 30 bit Morton code of a point inside some bounds
+* @param	const glm::vec3& point
+* @param	const bvh_bounds& bounds
+* @return	uint32_t
+**/
+		uint32_t morton_code(const glm::vec3& point, const bvh_bounds& bounds)
+		{
+			uint32_t code = 0;
+			for (int i = 0; i < 3; i++)
+			{
+				//flat axes map everything to 0
+				float size = bounds.max[i] - bounds.min[i];
+				float t = size > 0.0F ? (point[i] - bounds.min[i]) / size : 0.0F;
+				uint32_t cell = static_cast<uint32_t>(std::clamp(t * 1024.0F, 0.0F, 1023.0F));
+				code |= expand_bits(cell) << (2 - i);
+			}
+
+			return code;
+		}
+	}
+
+/**
+* @brief	Gets bounds which any grow replaces
+* @return	bvh_bounds
+**/
+	bvh_bounds bvh_bounds::empty()
+	{
+		float big = std::numeric_limits<float>::max();
+		return { glm::vec3(big), glm::vec3(-big) };
+	}
+
+/**
+* @brief	Gets the bounds of a triangle
+* @param	const glm::vec3& v0
+* @param	const glm::vec3& v1
+* @param	const glm::vec3& v2
+* @return	bvh_bounds
+**/
+	bvh_bounds bvh_bounds::of_triangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2)
+	{
+		return { glm::min(v0, glm::min(v1, v2)), glm::max(v0, glm::max(v1, v2)) };
+	}
+
+/**
+* @brief	Grows the bounds to contain other ones
+* @param	const bvh_bounds& other
+**/
+	void bvh_bounds::grow(const bvh_bounds& other)
+	{
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+/**
+* @brief	Computes the surface area of the bounds, 0 if they are empty
+* @return	float
+**/
+	float bvh_bounds::surface_area() const
+	{
+		glm::vec3 diff = max - min;
+		if (diff.x < 0.0F || diff.y < 0.0F || diff.z < 0.0F)
+			return 0.0F;
+
+		return (diff.x * diff.y + diff.z * diff.y + diff.x * diff.z) * 2.0F;
+	}
+
+/**
+* @brief	Checks if other bounds are inside these ones
+* @param	const bvh_bounds& other
+* @return	bool
+**/
+	bool bvh_bounds::contains(const bvh_bounds& other) const
+	{
+		for (int i = 0; i < 3; i++)
+			if (other.min[i] < min[i] || other.max[i] > max[i])
+				return false;
+
+		return true;
+	}
+
+/**
+* @brief	Checks if other bounds touch these ones
+* @param	const bvh_bounds& other
+* @return	bool
+**/
+	bool bvh_bounds::overlaps(const bvh_bounds& other) const
+	{
+		for (int i = 0; i < 3; i++)
+			if (other.max[i] < min[i] || other.min[i] > max[i])
+				return false;
+
+		return true;
+	}
+
+/**
+* @brief	Slab test of a ray against the bounds
+* @param	const glm::vec3& origin
+* @param	const glm::vec3& invDir
+* @param	float maxT
+* @param	float& tEntry, time at which the ray enters (0 if it starts inside)
+* @return	bool
+**/
+	bool bvh_bounds::intersect(const glm::vec3& origin, const glm::vec3& invDir, float maxT, float& tEntry) const
+	{
+		glm::vec3 t0 = (min - origin) * invDir;
+		glm::vec3 t1 = (max - origin) * invDir;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+
+		float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0F));
+		float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxT));
+
+		tEntry = enter;
+		return enter <= exit;
+	}
+
+/**
+* @brief	Gets the bounds containing two others
+* @param	const bvh_bounds& a
+* @param	const bvh_bounds& b
+* @return	bvh_bounds
+**/
+	bvh_bounds merge(const bvh_bounds& a, const bvh_bounds& b)
+	{
+		return { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+	}
+
+/**
+* @brief	Removes every node and primitive
+**/
+	void flat_bvh::clear()
+	{
+		nodes.clear();
+		primitives.clear();
+	}
+
+/**
+* @brief	Computes the levels of the tree
+* @return	int
+**/
+	int flat_bvh::depth() const
+	{
+		if (nodes.empty())
+			return 0;
+
+		int deepest = 0;
+		std::vector<std::pair<uint32_t, int>> stack;
+		stack.push_back({ 0, 1 });
+
+		while (!stack.empty())
+		{
+			auto [index, level] = stack.back();
+			stack.pop_back();
+
+			deepest = std::max(deepest, level);
+			if (!nodes[index].is_leaf())
+			{
+				stack.push_back({ nodes[index].first, level + 1 });
+				stack.push_back({ nodes[index].first + 1, level + 1 });
+			}
+		}
+
+		return deepest;
+	}
+
+/**
+* @brief	Computes the cost of the tree with the surface area heuristic, relative to the root
+* @return	float
+**/
+	float flat_bvh::sah_cost() const
+	{
+		if (nodes.empty())
+			return 0.0F;
+
+		//a flat root (every primitive on a plane or a point) makes every node cost the same
+		float rootArea = nodes[0].bounds.surface_area();
+		float cost = 0.0F;
+		for (const bvh_node& node : nodes)
+		{
+			float probability = rootArea > 0.0F ? node.bounds.surface_area() / rootArea : 1.0F;
+			cost += probability * (node.is_leaf() ? static_cast<float>(node.count) : 1.0F);
+		}
+
+		return cost;
+	}
+
+/**
+* @brief	Builds a tree top down
+* @param	std::span<const bvh_bounds> primitives
+* @param	unsigned leafSize, a node with that many primitives or less is not split
+* @return	flat_bvh
+**/
+	flat_bvh build_top_down(std::span<const bvh_bounds> primitives, unsigned leafSize)
+	{
+		flat_bvh tree;
+		if (primitives.empty())
+			return tree;
+
+		leafSize = std::max(leafSize, 1U);
+
+		tree.primitives.resize(primitives.size());
+		std::iota(tree.primitives.begin(), tree.primitives.end(), 0U);
+		tree.nodes.reserve(2 * primitives.size());
+		tree.nodes.push_back({});
+
+		//node and the range of the primitive array it holds, without recursion as the depth has no bound
+		struct task { uint32_t node, first, count; };
+		std::vector<task> stack;
+		stack.push_back({ 0, 0, static_cast<uint32_t>(primitives.size()) });
+
+		while (!stack.empty())
+		{
+			task current = stack.back();
+			stack.pop_back();
+
+			auto begin = tree.primitives.begin() + current.first;
+			auto end = begin + current.count;
+
+			//bounds of the node and mean of the centers of its primitives
+			bvh_bounds bounds = bvh_bounds::empty();
+			glm::vec3 mean(0.0F);
+			for (auto it = begin; it != end; ++it)
+			{
+				bounds.grow(primitives[*it]);
+				mean += primitives[*it].center();
+			}
+			mean /= static_cast<float>(current.count);
+
+			tree.nodes[current.node].bounds = bounds;
+			tree.nodes[current.node].first = current.first;
+			tree.nodes[current.node].count = current.count;
+
+			if (current.count <= leafSize)
+				continue;
+
+			int axis = longest_axis(bounds);
+			float split = mean[axis];
+
+			//primitives completely at one side of the plane go to that side, the ones crossing it to the side
+			//of their center, and the ones whose center is on the plane to the left
+			auto middle = std::partition(begin, end, [&](uint32_t index) {
+				const bvh_bounds& box = primitives[index];
+				if (box.max[axis] <= split + cSplitEpsilon && box.min[axis] < split - cSplitEpsilon)
+					return true;
+				if (box.min[axis] >= split - cSplitEpsilon && box.max[axis] > split + cSplitEpsilon)
+					return false;
+				return box.center()[axis] <= split + cSplitEpsilon;
+			});
+
+			//checking that none of both sides are empty, otherwise the node stays a leaf
+			uint32_t leftCount = static_cast<uint32_t>(middle - begin);
+			if (leftCount == 0 || leftCount == current.count)
+				continue;
+
+			//both children next to each other
+			uint32_t left = static_cast<uint32_t>(tree.nodes.size());
+			tree.nodes.push_back({});
+			tree.nodes.push_back({});
+			tree.nodes[current.node].first = left;
+			tree.nodes[current.node].count = 0;
+
+			stack.push_back({ left + 1, current.first + leftCount, current.count - leftCount });
+			stack.push_back({ left, current.first, leftCount });
+		}
+
+		return tree;
+	}
+
+/**
+* @brief	Builds a tree bottom up
+* @param	std::span<const bvh_bounds> primitives
+* @return	flat_bvh
+**/
+	flat_bvh build_bottom_up(std::span<const bvh_bounds> primitives)
+	{
+		if (primitives.empty())
+			return {};
+
+		std::vector<build_node> nodes = make_leaves(primitives);
+
+		//nodes which are not merged yet
+		std::vector<uint32_t> active(primitives.size());
+		std::iota(active.begin(), active.end(), 0U);
+		size_t count = active.size();
+
+		//while the node count is higher than 1
+		while (count > 1)
+		{
+			//the pair with the minimum surface area
+			size_t left = 0;
+			size_t right = 1;
+			float area = std::numeric_limits<float>::max();
+			for (size_t i = 0; i < count - 1; i++)
+			{
+				for (size_t j = i + 1; j < count; j++)
+				{
+					float currentArea = merge(nodes[active[i]].bounds, nodes[active[j]].bounds).surface_area();
+					if (currentArea < area)
+					{
+						left = i;
+						right = j;
+						area = currentArea;
+					}
+				}
+			}
+
+			build_node addition;
+			addition.bounds = merge(nodes[active[left]].bounds, nodes[active[right]].bounds);
+			addition.left = active[left];
+			addition.right = active[right];
+
+			uint32_t index = static_cast<uint32_t>(nodes.size());
+			nodes[addition.left].parent = index;
+			nodes[addition.right].parent = index;
+			nodes.push_back(addition);
+
+			//the new node takes the place of the first one and the last one the place of the second
+			active[left] = index;
+			active[right] = active[count - 1];
+			count--;
+		}
+
+		return flatten(nodes, active[0]);
+	}
+
+/**
+* @brief	Builds a tree bottom up with locally ordered clustering
+* @param	std::span<const bvh_bounds> primitives
+* @param	unsigned radius, clusters on each side of the curve a cluster looks for its pair in
+* @return	flat_bvh
+**/
+	flat_bvh build_bottom_up_ploc(std::span<const bvh_bounds> primitives, unsigned radius)
+	{
+		if (primitives.empty())
+			return {};
+
+		std::vector<build_node> nodes = make_leaves(primitives);
+		radius = std::max(radius, 1U);
+
+		//sorting the primitives along the Morton curve of their centers
+		bvh_bounds centers = bvh_bounds::empty();
+		for (const bvh_bounds& box : primitives)
+			centers.grow({ box.center(), box.center() });
+
+		std::vector<std::pair<uint32_t, uint32_t>> codes(primitives.size());
+		for (uint32_t i = 0; i < primitives.size(); i++)
+			codes[i] = { morton_code(primitives[i].center(), centers), i };
+		std::sort(codes.begin(), codes.end());
+
+		//clusters in curve order, with their bounds next to each other so the searches stay in cache
+		std::vector<uint32_t> clusters(codes.size());
+		std::vector<bvh_bounds> bounds(codes.size());
+		for (size_t i = 0; i < codes.size(); i++)
+		{
+			clusters[i] = codes[i].second;
+			bounds[i] = primitives[codes[i].second];
+		}
+
+		std::vector<uint32_t> nearest;
+		std::vector<float> area;
+
+		while (clusters.size() > 1)
+		{
+			size_t count = clusters.size();
+
+			//best pair of every cluster among its neighbours, each pair is measured once for both of them
+			nearest.assign(count, 0);
+			area.assign(count, std::numeric_limits<float>::max());
+			for (size_t i = 0; i < count; i++)
+			{
+				size_t last = std::min(count - 1, i + radius);
+				for (size_t j = i + 1; j <= last; j++)
+				{
+					//area of the merged bounds, which are never empty
+					glm::vec3 diff = glm::max(bounds[i].max, bounds[j].max) - glm::min(bounds[i].min, bounds[j].min);
+					float currentArea = (diff.x * diff.y + diff.z * diff.y + diff.x * diff.z) * 2.0F;
+
+					//ties go to the first cluster on the curve, which makes the best pair of all mutual
+					if (currentArea < area[i])
+					{
+						area[i] = currentArea;
+						nearest[i] = static_cast<uint32_t>(j);
+					}
+					if (currentArea < area[j])
+					{
+						area[j] = currentArea;
+						nearest[j] = static_cast<uint32_t>(i);
+					}
+				}
+			}
+
+			//merging the mutual pairs, the new node takes the place of the first one
+			size_t kept = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				size_t j = nearest[i];
+				if (nearest[j] == i)
+				{
+					//the second one of the pair is merged already
+					if (j < i)
+						continue;
+
+					build_node addition;
+					addition.bounds = merge(bounds[i], bounds[j]);
+					addition.left = clusters[i];
+					addition.right = clusters[j];
+
+					uint32_t index = static_cast<uint32_t>(nodes.size());
+					nodes[addition.left].parent = index;
+					nodes[addition.right].parent = index;
+					nodes.push_back(addition);
+
+					clusters[kept] = index;
+					bounds[kept] = addition.bounds;
+				}
+				else
+				{
+					clusters[kept] = clusters[i];
+					bounds[kept] = bounds[i];
+				}
+				kept++;
+			}
+
+			clusters.resize(kept);
+			bounds.resize(kept);
+		}
+
+		return flatten(nodes, clusters[0]);
+	}
+
+/**
+* @brief	Builds a tree incrementally
+* @param	std::span<const bvh_bounds> primitives
+* @param	unsigned seed, of the insertion order
+* @return	flat_bvh
+**/
+	flat_bvh build_incremental(std::span<const bvh_bounds> primitives, unsigned seed)
+	{
+		std::vector<uint32_t> order(primitives.size());
+		std::iota(order.begin(), order.end(), 0U);
+		std::shuffle(order.begin(), order.end(), std::mt19937(seed));
+
+		dynamic_bvh tree;
+		for (uint32_t index : order)
+			tree.insert(primitives[index], index);
+
+		return tree.flatten();
+	}
+
+/**
+* @brief	Adds a primitive to the tree
+* @param	const bvh_bounds& bounds
+* @param	uint32_t primitive
+* @return	uint32_t, the leaf holding it
+**/
+	uint32_t dynamic_bvh::insert(const bvh_bounds& bounds, uint32_t primitive)
+	{
+		uint32_t leaf = allocate();
+		mNodes[leaf].bounds = bounds;
+		mNodes[leaf].primitive = primitive;
+		mLeaves++;
+
+		insert_leaf(leaf);
+		return leaf;
+	}
+
+/**
+* @brief	Removes a primitive from the tree
+* @param	uint32_t leaf
+**/
+	void dynamic_bvh::remove(uint32_t leaf)
+	{
+		remove_leaf(leaf);
+		release(leaf);
+		mLeaves--;
+	}
+
+/**
+* @brief	Moves a leaf to new bounds
+* @param	uint32_t leaf
+* @param	const bvh_bounds& bounds
+**/
+	void dynamic_bvh::update(uint32_t leaf, const bvh_bounds& bounds)
+	{
+		remove_leaf(leaf);
+		mNodes[leaf].bounds = bounds;
+		insert_leaf(leaf);
+	}
+
+/**
+* @brief	Removes every node
+**/
+	void dynamic_bvh::clear()
+	{
+		mNodes.clear();
+		mRoot = cNull;
+		mFree = cNull;
+		mLeaves = 0;
+	}
+
+/**
+* @brief	Computes the levels of the tree
+* @return	int
+**/
+	int dynamic_bvh::depth() const
+	{
+		if (mRoot == cNull)
+			return 0;
+
+		int deepest = 0;
+		std::vector<std::pair<uint32_t, int>> stack;
+		stack.push_back({ mRoot, 1 });
+
+		while (!stack.empty())
+		{
+			auto [index, level] = stack.back();
+			stack.pop_back();
+
+			deepest = std::max(deepest, level);
+			if (!mNodes[index].is_leaf())
+			{
+				stack.push_back({ mNodes[index].left, level + 1 });
+				stack.push_back({ mNodes[index].right, level + 1 });
+			}
+		}
+
+		return deepest;
+	}
+
+/**
+* @brief	Lays the tree out as a flat one
+* @return	flat_bvh
+**/
+	flat_bvh dynamic_bvh::flatten() const
+	{
+		if (mRoot == cNull)
+			return {};
+
+		return cs350::flatten(mNodes, mRoot);
+	}
+
+/**
+* @brief	Gets an unused node, reusing the removed ones first
+* @return	uint32_t
+**/
+	uint32_t dynamic_bvh::allocate()
+	{
+		if (mFree == cNull)
+		{
+			mNodes.push_back({});
+			return static_cast<uint32_t>(mNodes.size() - 1);
+		}
+
+		uint32_t index = mFree;
+		mFree = mNodes[index].parent;
+		mNodes[index] = {};
+		return index;
+	}
+
+/**
+* @brief	Puts a node on the free list
+* @param	uint32_t index
+**/
+	void dynamic_bvh::release(uint32_t index)
+	{
+		mNodes[index] = {};
+		mNodes[index].parent = mFree;
+		mFree = index;
+	}
+
+/**
+* @brief	Links a leaf next to its best sibling and refits its ancestors
+* @param	uint32_t leaf
+**/
+	void dynamic_bvh::insert_leaf(uint32_t leaf)
+	{
+		if (mRoot == cNull)
+		{
+			mRoot = leaf;
+			mNodes[leaf].parent = cNull;
+			return;
+		}
+
+		uint32_t sibling = find_sibling(mNodes[leaf].bounds);
+		uint32_t oldParent = mNodes[sibling].parent;
+
+		//a new parent takes the place of the sibling, keeping it on the left and the new leaf on the right
+		uint32_t parent = allocate();
+		mNodes[parent].bounds = merge(mNodes[sibling].bounds, mNodes[leaf].bounds);
+		mNodes[parent].left = sibling;
+		mNodes[parent].right = leaf;
+		mNodes[parent].parent = oldParent;
+		mNodes[sibling].parent = parent;
+		mNodes[leaf].parent = parent;
+
+		if (oldParent == cNull)
+			mRoot = parent;
+		else
+			replace_child(oldParent, sibling, parent);
+
+		refit(parent);
+	}
+
+/**
+* @brief	Unlinks a leaf, its sibling takes the place of their parent
+* @param	uint32_t leaf
+**/
+	void dynamic_bvh::remove_leaf(uint32_t leaf)
+	{
+		if (leaf == mRoot)
+		{
+			mRoot = cNull;
+			return;
+		}
+
+		uint32_t parent = mNodes[leaf].parent;
+		uint32_t grandParent = mNodes[parent].parent;
+		uint32_t sibling = mNodes[parent].left == leaf ? mNodes[parent].right : mNodes[parent].left;
+
+		mNodes[sibling].parent = grandParent;
+		if (grandParent == cNull)
+			mRoot = sibling;
+		else
+		{
+			replace_child(grandParent, parent, sibling);
+			refit(grandParent);
+		}
+
+		release(parent);
+		mNodes[leaf].parent = cNull;
+	}
+
+/**
+* @brief	Finds the node with which new bounds make the tree the cheapest. The cost of a sibling is the area
+*		of its merge with the bounds plus the growth of its ancestors, which the children inherit, and a
+*		subtree is skipped once the bounds plus the inherited growth cost more than the best sibling
+* @param	const bvh_bounds& bounds
+* @return	uint32_t
+**/
+	uint32_t dynamic_bvh::find_sibling(const bvh_bounds& bounds)
+	{
+		float area = bounds.surface_area();
+		uint32_t best = mRoot;
+		float bestCost = merge(mNodes[mRoot].bounds, bounds).surface_area();
+
+		//the node with the lowest inherited cost on top
+		auto cheaper = [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) {
+			return a.first > b.first;
+		};
+		mHeap.clear();
+		mHeap.push_back({ 0.0F, mRoot });
+
+		while (!mHeap.empty())
+		{
+			std::pop_heap(mHeap.begin(), mHeap.end(), cheaper);
+			auto [inherited, index] = mHeap.back();
+			mHeap.pop_back();
+
+			//no node left can be cheaper than the best one
+			if (inherited + area >= bestCost)
+				break;
+
+			const node& current = mNodes[index];
+			float direct = merge(current.bounds, bounds).surface_area();
+			float cost = direct + inherited;
+			if (cost < bestCost)
+			{
+				best = index;
+				bestCost = cost;
+			}
+
+			if (current.is_leaf())
+				continue;
+
+			//the children inherit the growth of this node
+			float childInherited = inherited + direct - current.bounds.surface_area();
+			if (childInherited + area < bestCost)
+			{
+				mHeap.push_back({ childInherited, current.left });
+				std::push_heap(mHeap.begin(), mHeap.end(), cheaper);
+				mHeap.push_back({ childInherited, current.right });
+				std::push_heap(mHeap.begin(), mHeap.end(), cheaper);
+			}
+		}
+
+		return best;
+	}
+
+/**
+* @brief	Recomputes the bounds of a node and its ancestors, rotating each of them
+* @param	uint32_t index
+**/
+	void dynamic_bvh::refit(uint32_t index)
+	{
+		for (; index != cNull; index = mNodes[index].parent)
+		{
+			mNodes[index].bounds = merge(mNodes[mNodes[index].left].bounds, mNodes[mNodes[index].right].bounds);
+			rotate(index);
+		}
+	}
+
+/**
+* @brief	Swaps a child of a node with a child of its other child when that lowers the area of the latter,
+*		the bounds of the node itself stay the same
+* @param	uint32_t index
+**/
+	void dynamic_bvh::rotate(uint32_t index)
+	{
+		uint32_t children[2] = { mNodes[index].left, mNodes[index].right };
+
+		//best swap of a child with a grandchild under the other child
+		float bestDelta = 0.0F;
+		uint32_t bestChild = cNull;
+		uint32_t bestGrandChild = cNull;
+		uint32_t bestOther = cNull;
+
+		for (int i = 0; i < 2; i++)
+		{
+			uint32_t child = children[i];
+			uint32_t other = children[1 - i];
+			const node& otherNode = mNodes[other];
+			if (otherNode.is_leaf())
+				continue;
+
+			float otherArea = otherNode.bounds.surface_area();
+			uint32_t grandChildren[2] = { otherNode.left, otherNode.right };
+			for (int j = 0; j < 2; j++)
+			{
+				//the other child ends up with the child and the grandchild it keeps
+				uint32_t kept = grandChildren[1 - j];
+				float delta = merge(mNodes[child].bounds, mNodes[kept].bounds).surface_area() - otherArea;
+				if (delta < bestDelta)
+				{
+					bestDelta = delta;
+					bestChild = child;
+					bestGrandChild = grandChildren[j];
+					bestOther = other;
+				}
+			}
+		}
+
+		if (bestChild == cNull)
+			return;
+
+		replace_child(index, bestChild, bestGrandChild);
+		replace_child(bestOther, bestGrandChild, bestChild);
+		mNodes[bestGrandChild].parent = index;
+		mNodes[bestChild].parent = bestOther;
+		mNodes[bestOther].bounds = merge(mNodes[mNodes[bestOther].left].bounds, mNodes[mNodes[bestOther].right].bounds);
+	}
+
+/**
+* @brief	Replaces a child of a node
+* @param	uint32_t parent
+* @param	uint32_t child
+* @param	uint32_t replacement
+**/
+	void dynamic_bvh::replace_child(uint32_t parent, uint32_t child, uint32_t replacement)
+	{
+		if (mNodes[parent].left == child)
+			mNodes[parent].left = replacement;
+		else
+			mNodes[parent].right = replacement;
+	}
+}
@@ -0,0 +1,343 @@
+/**
+* @file	flat_bvh.hpp
+* @author Nestor Uriarte ,540000817, nestor.uriarte@digipen.edu
+* @date	Fri Oct 23 20:15:04 2020
+* @brief	Contains the definition of the flat BVH and its builders. It only depends on glm (no renderer),
+*		so it can be built and queried by headless tools and tests.
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#pragma once
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace cs350
+{
+	/**
+	* Axis aligned box of a node or of a primitive
+	**/
+	struct bvh_bounds
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+
+		//bounds that any grow replaces
+		static bvh_bounds empty();
+		static bvh_bounds of_triangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2);
+
+		void grow(const bvh_bounds& other);
+		glm::vec3 center() const { return (min + max) * 0.5F; }
+		float surface_area() const;
+		bool contains(const bvh_bounds& other) const;
+		bool overlaps(const bvh_bounds& other) const;
+
+		//entry time of a ray (invDir is 1 / direction), false if it misses the box before maxT
+		bool intersect(const glm::vec3& origin, const glm::vec3& invDir, float maxT, float& tEntry) const;
+	};
+
+	bvh_bounds merge(const bvh_bounds& a, const bvh_bounds& b);
+
+	/**
+	* Node of the flat tree, 32 bytes
+	**/
+	struct bvh_node
+	{
+		bvh_bounds bounds;
+		//left child (the right one follows it) on internal nodes, first entry of the primitive array on leaves
+		uint32_t first;
+		//primitives of a leaf, 0 on internal nodes
+		uint32_t count;
+
+		bool is_leaf() const { return count != 0; }
+	};
+
+	/**
+	* Bounding volume hierarchy as a node array, the root is the first node. Leaves own a range of the
+	* primitive array, which holds the indices of the primitives the tree was built from
+	**/
+	struct flat_bvh
+	{
+		std::vector<bvh_node> nodes;
+		std::vector<uint32_t> primitives;
+
+		bool empty() const { return nodes.empty(); }
+		void clear();
+
+		//levels of the tree, 0 if empty
+		int depth() const;
+
+		//cost of the tree with the surface area heuristic (traversal 1, primitive test 1)
+		float sah_cost() const;
+	};
+
+	/**
+	* Top down: splits each node at the mean of the centers of its primitives along the longest axis of its
+	* bounds, primitives crossing the split go to the side of their center
+	**/
+	flat_bvh build_top_down(std::span<const bvh_bounds> primitives, unsigned leafSize = 1);
+
+	/**
+	* Bottom up: starting from a node per primitive, merges the pair with the smallest bounds until one is left
+	**/
+	flat_bvh build_bottom_up(std::span<const bvh_bounds> primitives);
+
+	/**
+	* Bottom up with locally ordered clustering (PLOC): primitives are sorted along a Morton curve and every
+	* pass merges the clusters that are each other's best pair among their radius neighbours on the curve.
+	* Close to the greedy tree of build_bottom_up in O(n radius) per pass instead of O(n^3)
+	**/
+	flat_bvh build_bottom_up_ploc(std::span<const bvh_bounds> primitives, unsigned radius = 8);
+
+	/**
+	* Incremental: inserts the primitives in random order in a dynamic_bvh
+	**/
+	flat_bvh build_incremental(std::span<const bvh_bounds> primitives, unsigned seed = 0);
+
+	/**
+	* Tree of boxes that can change after it is built, to index a scene whose objects move. Insertion finds the
+	* sibling with the smallest surface area cost with a branch and bound on the cost the ancestors inherit,
+	* then refits only the ancestors of the new leaf, rotating each one when that lowers its children's area.
+	* Leaves keep their index while they are in the tree, so it works as a handle of the primitive
+	**/
+	class dynamic_bvh
+	{
+	public:
+		static constexpr uint32_t cNull = 0xFFFFFFFF;
+
+		struct node
+		{
+			bvh_bounds bounds;
+			uint32_t left = cNull;
+			uint32_t right = cNull;
+			//parent, or the next free node while the node is not used
+			uint32_t parent = cNull;
+			uint32_t primitive = cNull;
+
+			bool is_leaf() const { return left == cNull; }
+		};
+
+		//adds a primitive, returns the leaf holding it
+		uint32_t insert(const bvh_bounds& bounds, uint32_t primitive);
+		void remove(uint32_t leaf);
+		//moves a leaf, which keeps its index
+		void update(uint32_t leaf, const bvh_bounds& bounds);
+		void clear();
+
+		uint32_t root() const { return mRoot; }
+		size_t size() const { return mLeaves; }
+		const std::vector<node>& nodes() const { return mNodes; }
+		int depth() const;
+
+		//lays the tree out as a flat one, with a primitive per leaf
+		flat_bvh flatten() const;
+
+		//calls fn(uint32_t primitive) for every leaf overlapping a box
+		template <typename F>
+		void query(const bvh_bounds& box, F const& fn) const;
+
+	private:
+		uint32_t allocate();
+		void release(uint32_t index);
+		void insert_leaf(uint32_t leaf);
+		void remove_leaf(uint32_t leaf);
+		uint32_t find_sibling(const bvh_bounds& bounds);
+		void refit(uint32_t index);
+		void rotate(uint32_t index);
+		void replace_child(uint32_t parent, uint32_t child, uint32_t replacement);
+
+		std::vector<node> mNodes;
+		//open nodes of the sibling search, kept to not allocate on every insert
+		std::vector<std::pair<float, uint32_t>> mHeap;
+		uint32_t mRoot = cNull;
+		uint32_t mFree = cNull;
+		size_t mLeaves = 0;
+	};
+
+	/**
+	* Calls fn(uint32_t primitive) for every primitive under a node
+	**/
+	template <typename F>
+	void for_each_primitive(const flat_bvh& tree, uint32_t node, F const& fn);
+
+	/**
+	* Closest hit along a ray, visiting the nearest child first and skipping nodes past the closest hit
+	* intersect is float(uint32_t primitive, float maxT), returning the time of the hit or a negative value
+	* returns the time of the closest hit or -1
+	**/
+	template <typename F>
+	float raycast(const flat_bvh& tree, const glm::vec3& origin, const glm::vec3& dir, float maxT, F const& intersect);
+
+	/**
+	* Calls fn(uint32_t primitive) for every primitive whose leaf overlaps a box
+	**/
+	template <typename F>
+	void query(const flat_bvh& tree, const bvh_bounds& box, F const& fn);
+
+/**
+* @brief	Calls a function for every primitive under a node
+* @param	const flat_bvh& tree
+* @param	uint32_t node
+* @param	F const& fn
+**/
+	template <typename F>
+	void for_each_primitive(const flat_bvh& tree, uint32_t node, F const& fn)
+	{
+		//the trees of the bottom up and incremental builders have no bound on their depth
+		std::vector<uint32_t> stack;
+		stack.reserve(64);
+		stack.push_back(node);
+
+		while (!stack.empty())
+		{
+			const bvh_node& n = tree.nodes[stack.back()];
+			stack.pop_back();
+			if (n.is_leaf())
+			{
+				for (uint32_t i = n.first; i < n.first + n.count; i++)
+					fn(tree.primitives[i]);
+				continue;
+			}
+
+			stack.push_back(n.first + 1);
+			stack.push_back(n.first);
+		}
+	}
+
+/**
+* @brief	Closest hit along a ray
+* @param	const flat_bvh& tree
+* @param	const glm::vec3& origin
+* @param	const glm::vec3& dir
+* @param	float maxT
+* @param	F const& intersect
+* @return	float
+**/
+	template <typename F>
+	float raycast(const flat_bvh& tree, const glm::vec3& origin, const glm::vec3& dir, float maxT, F const& intersect)
+	{
+		if (tree.empty())
+			return -1.0F;
+
+		glm::vec3 invDir = 1.0F / dir;
+		float best = maxT;
+		bool hit = false;
+
+		std::vector<uint32_t> stack;
+		stack.reserve(64);
+		stack.push_back(0);
+
+		while (!stack.empty())
+		{
+			const bvh_node& n = tree.nodes[stack.back()];
+			stack.pop_back();
+
+			float tEntry = 0.0F;
+			if (!n.bounds.intersect(origin, invDir, best, tEntry))
+				continue;
+
+			if (n.is_leaf())
+			{
+				for (uint32_t i = n.first; i < n.first + n.count; i++)
+				{
+					float t = intersect(tree.primitives[i], best);
+					if (t >= 0.0F && t <= best)
+					{
+						best = t;
+						hit = true;
+					}
+				}
+				continue;
+			}
+
+			//nearest child on top of the stack
+			float leftT = 0.0F;
+			float rightT = 0.0F;
+			bool left = tree.nodes[n.first].bounds.intersect(origin, invDir, best, leftT);
+			bool right = tree.nodes[n.first + 1].bounds.intersect(origin, invDir, best, rightT);
+			if (left && right && leftT <= rightT)
+			{
+				stack.push_back(n.first + 1);
+				stack.push_back(n.first);
+			}
+			else
+			{
+				if (left)
+					stack.push_back(n.first);
+				if (right)
+					stack.push_back(n.first + 1);
+			}
+		}
+
+		return hit ? best : -1.0F;
+	}
+
+/**
+* @brief	Visits the primitives of the leaves overlapping a box
+* @param	const flat_bvh& tree
+* @param	const bvh_bounds& box
+* @param	F const& fn
+**/
+	template <typename F>
+	void query(const flat_bvh& tree, const bvh_bounds& box, F const& fn)
+	{
+		if (tree.empty())
+			return;
+
+		std::vector<uint32_t> stack;
+		stack.reserve(64);
+		stack.push_back(0);
+
+		while (!stack.empty())
+		{
+			const bvh_node& n = tree.nodes[stack.back()];
+			stack.pop_back();
+			if (!n.bounds.overlaps(box))
+				continue;
+
+			if (n.is_leaf())
+			{
+				for (uint32_t i = n.first; i < n.first + n.count; i++)
+					fn(tree.primitives[i]);
+				continue;
+			}
+
+			stack.push_back(n.first + 1);
+			stack.push_back(n.first);
+		}
+	}
+
+/**
+* @brief	Visits the primitives of the leaves overlapping a box
+* @param	const bvh_bounds& box
+* @param	F const& fn
+**/
+	template <typename F>
+	void dynamic_bvh::query(const bvh_bounds& box, F const& fn) const
+	{
+		if (mRoot == cNull)
+			return;
+
+		std::vector<uint32_t> stack;
+		stack.reserve(64);
+		stack.push_back(mRoot);
+
+		while (!stack.empty())
+		{
+			const node& n = mNodes[stack.back()];
+			stack.pop_back();
+			if (!n.bounds.overlaps(box))
+				continue;
+
+			if (n.is_leaf())
+			{
+				fn(n.primitive);
+				continue;
+			}
+
+			stack.push_back(n.right);
+			stack.push_back(n.left);
+		}
+	}
+}
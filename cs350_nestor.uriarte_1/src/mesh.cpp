@@ -15,7 +15,7 @@
 Mesh class
 
 The functions included are:
-- void mesh::generate(const mesh_data& data);
+- void mesh::generate(const mesh_view& data);
 - mesh::~mesh();
 - void mesh::generateBuffers();
 - void mesh::bindBuffers();
@@ -37,15 +37,24 @@ namespace cs350 {
     \fn     mesh::generate
 
     \brief 
-    Function to generate a mesh from a mesh_data structure
+    Function to generate a mesh from the arrays of a mesh_data structure or
+    of a mesh cache
 
-    \param  const mesh_data& data
+    \param  const mesh_view& data
     the data to use to create
 
     *
     **************************************************************************/
-    void mesh::generate(const mesh_data& data)
+    void mesh::generate(const mesh_view& data)
     {
+        //every face adds 3 vertices
+        positions.reserve(positions.size() + 3 * data.faces.size());
+        triangles.reserve(triangles.size() + data.faces.size());
+        if (!data.uvs.empty())
+            uvs.reserve(uvs.size() + 3 * data.faces.size());
+        if (!data.normals.empty())
+            normals.reserve(normals.size() + 3 * data.faces.size());
+
         //for each face on the mesh data
         for (unsigned i = 0; i < data.faces.size(); i++)
         {
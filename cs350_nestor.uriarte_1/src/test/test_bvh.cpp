@@ -0,0 +1,413 @@
+#include <gtest/gtest.h>
+#include <random>
+#include "pch.hpp"
+#include "bvh.hpp"
+#include "flat_bvh.hpp"
+using namespace cs350;
+
+namespace {
+    struct test_triangle
+    {
+        glm::vec3 v0, v1, v2;
+    };
+
+    std::vector<test_triangle> random_triangles(unsigned count, unsigned seed)
+    {
+        std::mt19937                          rng(seed);
+        std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+        std::uniform_real_distribution<float> offset(-0.5f, 0.5f);
+
+        std::vector<test_triangle> triangles;
+        for (unsigned i = 0; i < count; ++i) {
+            glm::vec3 c(position(rng), position(rng), position(rng));
+            triangles.push_back({c + glm::vec3(offset(rng), offset(rng), offset(rng)),
+                                 c + glm::vec3(offset(rng), offset(rng), offset(rng)),
+                                 c + glm::vec3(offset(rng), offset(rng), offset(rng))});
+        }
+        return triangles;
+    }
+
+    // Primitive of the BVHTree test, found by the tree through its own bounds_of
+    struct test_sphere
+    {
+        glm::vec3 center;
+        float     radius;
+    };
+    static_assert(std::is_trivial_v<test_sphere> && std::is_standard_layout_v<test_sphere>);
+
+    bvh_bounds bounds_of(test_sphere const& s)
+    {
+        return {s.center - glm::vec3(s.radius), s.center + glm::vec3(s.radius)};
+    }
+
+    std::vector<bvh_bounds> bounds_of(std::vector<test_triangle> const& triangles)
+    {
+        std::vector<bvh_bounds> bounds;
+        for (auto const& t : triangles)
+            bounds.push_back(bvh_bounds::of_triangle(t.v0, t.v1, t.v2));
+        return bounds;
+    }
+
+    // Moller-Trumbore, time of the hit or -1
+    float intersect_triangle(glm::vec3 const& origin, glm::vec3 const& dir, test_triangle const& t)
+    {
+        glm::vec3 e1  = t.v1 - t.v0;
+        glm::vec3 e2  = t.v2 - t.v0;
+        glm::vec3 p   = glm::cross(dir, e2);
+        float     det = glm::dot(e1, p);
+        if (std::abs(det) < 1e-8f)
+            return -1.0f;
+
+        glm::vec3 s = origin - t.v0;
+        float     u = glm::dot(s, p) / det;
+        if (u < 0.0f || u > 1.0f)
+            return -1.0f;
+
+        glm::vec3 q = glm::cross(s, e1);
+        float     v = glm::dot(dir, q) / det;
+        if (v < 0.0f || u + v > 1.0f)
+            return -1.0f;
+
+        return glm::dot(e2, q) / det;
+    }
+
+    void check_tree(flat_bvh const& tree, std::vector<bvh_bounds> const& bounds)
+    {
+        // Every primitive exactly once
+        ASSERT_EQ(tree.primitives.size(), bounds.size());
+        std::vector<int> seen(bounds.size(), 0);
+        for_each_primitive(tree, 0, [&](uint32_t p) { seen[p]++; });
+        for (int s : seen)
+            ASSERT_EQ(s, 1);
+
+        // Nodes contain their children and the primitives of their leaves
+        for (auto const& n : tree.nodes) {
+            if (n.is_leaf()) {
+                for (uint32_t i = n.first; i < n.first + n.count; ++i)
+                    ASSERT_TRUE(n.bounds.contains(bounds[tree.primitives[i]]));
+            } else {
+                ASSERT_TRUE(n.bounds.contains(tree.nodes[n.first].bounds));
+                ASSERT_TRUE(n.bounds.contains(tree.nodes[n.first + 1].bounds));
+            }
+        }
+    }
+
+    void check_raycast(flat_bvh const& tree, std::vector<test_triangle> const& triangles)
+    {
+        std::mt19937                          rng(7);
+        std::uniform_real_distribution<float> u(-10.0f, 10.0f);
+        int                                   hits = 0;
+        for (int i = 0; i < 500; ++i) {
+            glm::vec3 origin(u(rng), u(rng), -20.0f);
+            glm::vec3 dir = glm::normalize(glm::vec3(u(rng) * 0.05f, u(rng) * 0.05f, 1.0f));
+
+            float expected = -1.0f;
+            for (auto const& t : triangles) {
+                float time = intersect_triangle(origin, dir, t);
+                if (time >= 0.0f && (expected < 0.0f || time < expected))
+                    expected = time;
+            }
+
+            float result = raycast(tree, origin, dir, std::numeric_limits<float>::max(), [&](uint32_t p, float) {
+                return intersect_triangle(origin, dir, triangles[p]);
+            });
+
+            ASSERT_FLOAT_EQ(result, expected);
+            hits += expected >= 0.0f;
+        }
+        ASSERT_GT(hits, 0);
+    }
+}
+
+TEST(flat_bvh, empty)
+{
+    std::vector<bvh_bounds> bounds;
+    ASSERT_TRUE(build_top_down(bounds).empty());
+    ASSERT_TRUE(build_bottom_up(bounds).empty());
+    ASSERT_TRUE(build_incremental(bounds).empty());
+    ASSERT_EQ(build_top_down(bounds).depth(), 0);
+}
+
+TEST(flat_bvh, single_primitive)
+{
+    std::vector<bvh_bounds> bounds = {{glm::vec3(0.0f), glm::vec3(1.0f)}};
+    for (auto const& tree : {build_top_down(bounds), build_bottom_up(bounds), build_incremental(bounds)}) {
+        ASSERT_EQ(tree.nodes.size(), 1u);
+        ASSERT_TRUE(tree.nodes[0].is_leaf());
+        ASSERT_EQ(tree.depth(), 1);
+    }
+}
+
+TEST(flat_bvh, top_down)
+{
+    auto triangles = random_triangles(300, 1);
+    auto bounds    = bounds_of(triangles);
+    auto tree      = build_top_down(bounds);
+    check_tree(tree, bounds);
+    check_raycast(tree, triangles);
+}
+
+TEST(flat_bvh, top_down_leaf_size)
+{
+    auto bounds = bounds_of(random_triangles(300, 2));
+    auto tree   = build_top_down(bounds, 4);
+    check_tree(tree, bounds);
+    ASSERT_LT(tree.nodes.size(), build_top_down(bounds).nodes.size());
+}
+
+TEST(flat_bvh, top_down_coincident)
+{
+    // Nothing can be split, everything stays on the root
+    std::vector<bvh_bounds> bounds(10, {glm::vec3(0.0f), glm::vec3(1.0f)});
+    auto                    tree = build_top_down(bounds);
+    check_tree(tree, bounds);
+    ASSERT_EQ(tree.nodes.size(), 1u);
+    ASSERT_EQ(tree.nodes[0].count, 10u);
+}
+
+TEST(flat_bvh, bottom_up)
+{
+    auto triangles = random_triangles(150, 3);
+    auto bounds    = bounds_of(triangles);
+    auto tree      = build_bottom_up(bounds);
+    check_tree(tree, bounds);
+    check_raycast(tree, triangles);
+}
+
+TEST(flat_bvh, bottom_up_clusters)
+{
+    // Two clusters far apart end up on different children of the root
+    std::vector<bvh_bounds> bounds;
+    for (int i = 0; i < 8; ++i) {
+        glm::vec3 c(i % 2 == 0 ? -100.0f : 100.0f, static_cast<float>(i), 0.0f);
+        bounds.push_back({c, c + glm::vec3(0.5f)});
+    }
+    auto tree = build_bottom_up(bounds);
+    check_tree(tree, bounds);
+
+    for (uint32_t child = 0; child < 2; ++child) {
+        float side = 0.0f;
+        for_each_primitive(tree, tree.nodes[0].first + child, [&](uint32_t p) {
+            float x = bounds[p].min.x;
+            if (side == 0.0f)
+                side = x;
+            ASSERT_EQ(side < 0.0f, x < 0.0f);
+        });
+    }
+}
+
+TEST(flat_bvh, bottom_up_ploc)
+{
+    auto triangles = random_triangles(2000, 8);
+    auto bounds    = bounds_of(triangles);
+    auto tree      = build_bottom_up_ploc(bounds);
+    check_tree(tree, bounds);
+    check_raycast(tree, triangles);
+}
+
+TEST(flat_bvh, bottom_up_ploc_clusters)
+{
+    std::vector<bvh_bounds> bounds;
+    for (int i = 0; i < 64; ++i) {
+        glm::vec3 c(i % 2 == 0 ? -100.0f : 100.0f, static_cast<float>(i), 0.0f);
+        bounds.push_back({c, c + glm::vec3(0.5f)});
+    }
+    auto tree = build_bottom_up_ploc(bounds, 2);
+    check_tree(tree, bounds);
+
+    for (uint32_t child = 0; child < 2; ++child) {
+        float side = 0.0f;
+        for_each_primitive(tree, tree.nodes[0].first + child, [&](uint32_t p) {
+            float x = bounds[p].min.x;
+            if (side == 0.0f)
+                side = x;
+            ASSERT_EQ(side < 0.0f, x < 0.0f);
+        });
+    }
+}
+
+TEST(flat_bvh, bottom_up_ploc_quality)
+{
+    // Close to the greedy tree it approximates
+    auto bounds = bounds_of(random_triangles(300, 9));
+    ASSERT_LT(build_bottom_up_ploc(bounds).sah_cost(), build_bottom_up(bounds).sah_cost() * 1.2f);
+}
+
+TEST(flat_bvh, bottom_up_ploc_coincident)
+{
+    std::vector<bvh_bounds> bounds(100, {glm::vec3(0.0f), glm::vec3(1.0f)});
+    check_tree(build_bottom_up_ploc(bounds), bounds);
+}
+
+TEST(flat_bvh, incremental)
+{
+    auto triangles = random_triangles(300, 4);
+    auto bounds    = bounds_of(triangles);
+    auto tree      = build_incremental(bounds, 11);
+    check_tree(tree, bounds);
+    check_raycast(tree, triangles);
+}
+
+TEST(flat_bvh, incremental_quality)
+{
+    auto bounds = bounds_of(random_triangles(2000, 10));
+    ASSERT_LT(build_incremental(bounds).sah_cost(), build_top_down(bounds).sah_cost() * 1.3f);
+}
+
+TEST(dynamic_bvh, insert_remove_update)
+{
+    auto                  bounds = bounds_of(random_triangles(1000, 12));
+    dynamic_bvh           tree;
+    std::vector<uint32_t> leaves;
+    for (uint32_t i = 0; i < bounds.size(); ++i)
+        leaves.push_back(tree.insert(bounds[i], i));
+    ASSERT_EQ(tree.size(), bounds.size());
+    check_tree(tree.flatten(), bounds);
+
+    // Removing every other primitive and moving the rest
+    std::mt19937                          rng(13);
+    std::uniform_real_distribution<float> offset(-2.0f, 2.0f);
+    std::vector<bvh_bounds>               remaining;
+    for (uint32_t i = 0; i < bounds.size(); ++i) {
+        if (i % 2 == 0) {
+            tree.remove(leaves[i]);
+            continue;
+        }
+        glm::vec3 move(offset(rng), offset(rng), offset(rng));
+        bounds[i] = {bounds[i].min + move, bounds[i].max + move};
+        tree.update(leaves[i], bounds[i]);
+    }
+    ASSERT_EQ(tree.size(), bounds.size() / 2);
+
+    // Every remaining primitive once, parents link back and contain their children
+    std::vector<int> seen(bounds.size(), 0);
+    for (uint32_t i = 1; i < bounds.size(); i += 2) {
+        ASSERT_EQ(tree.nodes()[leaves[i]].primitive, i);
+        ASSERT_TRUE(tree.nodes()[leaves[i]].bounds.contains(bounds[i]));
+    }
+    std::vector<uint32_t> stack = {tree.root()};
+    while (!stack.empty()) {
+        uint32_t index = stack.back();
+        stack.pop_back();
+        auto const& n = tree.nodes()[index];
+        if (n.is_leaf()) {
+            seen[n.primitive]++;
+            continue;
+        }
+        ASSERT_EQ(tree.nodes()[n.left].parent, index);
+        ASSERT_EQ(tree.nodes()[n.right].parent, index);
+        ASSERT_TRUE(n.bounds.contains(tree.nodes()[n.left].bounds));
+        ASSERT_TRUE(n.bounds.contains(tree.nodes()[n.right].bounds));
+        stack.push_back(n.left);
+        stack.push_back(n.right);
+    }
+    for (uint32_t i = 0; i < bounds.size(); ++i)
+        ASSERT_EQ(seen[i], static_cast<int>(i % 2));
+
+    // Query against brute force
+    bvh_bounds       box{glm::vec3(-4.0f), glm::vec3(4.0f)};
+    std::vector<int> found(bounds.size(), 0);
+    tree.query(box, [&](uint32_t p) { found[p]++; });
+    for (uint32_t i = 1; i < bounds.size(); i += 2)
+        ASSERT_EQ(found[i], bounds[i].overlaps(box) ? 1 : 0);
+
+    // Removed nodes are reused
+    size_t capacity = tree.nodes().size();
+    for (uint32_t i = 0; i < bounds.size(); i += 2)
+        tree.insert(bounds[i], i);
+    ASSERT_EQ(tree.nodes().size(), capacity);
+    check_tree(tree.flatten(), bounds);
+
+    tree.clear();
+    ASSERT_EQ(tree.size(), 0u);
+    ASSERT_TRUE(tree.flatten().empty());
+}
+
+TEST(dynamic_bvh, sorted_insertion)
+{
+    // Boxes along a line in order, which makes a list of a tree without rotations
+    std::vector<bvh_bounds> bounds;
+    dynamic_bvh             tree;
+    for (uint32_t i = 0; i < 4096; ++i) {
+        glm::vec3 c(static_cast<float>(i), 0.0f, 0.0f);
+        bounds.push_back({c, c + glm::vec3(0.5f)});
+        tree.insert(bounds.back(), i);
+    }
+    check_tree(tree.flatten(), bounds);
+    ASSERT_LE(tree.depth(), 40);
+}
+
+TEST(flat_bvh, query)
+{
+    auto       bounds = bounds_of(random_triangles(300, 5));
+    auto       tree   = build_top_down(bounds);
+    bvh_bounds box{glm::vec3(-3.0f), glm::vec3(3.0f)};
+
+    std::vector<int> found(bounds.size(), 0);
+    query(tree, box, [&](uint32_t p) { found[p]++; });
+    for (uint32_t i = 0; i < bounds.size(); ++i) {
+        if (bounds[i].overlaps(box)) {
+            ASSERT_EQ(found[i], 1);
+        }
+    }
+
+    // Only the primitives of the leaves overlapping the box are found, once, and a primitive alone in its
+    // leaf only when it overlaps the box itself
+    for (auto const& n : tree.nodes) {
+        if (!n.is_leaf())
+            continue;
+        for (uint32_t i = n.first; i < n.first + n.count; ++i) {
+            uint32_t p = tree.primitives[i];
+            ASSERT_EQ(found[p], n.bounds.overlaps(box) ? 1 : 0);
+            if (n.count == 1) {
+                ASSERT_EQ(found[p] == 1, bounds[p].overlaps(box));
+            }
+        }
+    }
+}
+
+TEST(flat_bvh, sah_cost)
+{
+    auto bounds = bounds_of(random_triangles(200, 6));
+
+    // A single leaf costs its primitive count
+    flat_bvh leaf = build_top_down(bounds, 1000);
+    ASSERT_FLOAT_EQ(leaf.sah_cost(), 200.0f);
+    ASSERT_LT(build_top_down(bounds).sah_cost(), leaf.sah_cost());
+}
+
+TEST(bvh_tree, generic_primitives)
+{
+    std::mt19937                          rng(5);
+    std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+    std::uniform_real_distribution<float> radius(0.1f, 1.0f);
+    std::vector<test_sphere>              spheres;
+    for (int i = 0; i < 200; ++i)
+        spheres.push_back({glm::vec3(position(rng), position(rng), position(rng)), radius(rng)});
+
+    for (TreeMethod method : {TreeMethod::TopDown, TreeMethod::BottomUp, TreeMethod::Incremental}) {
+        BVHTree<test_sphere> tree;
+        ASSERT_TRUE(tree.IsEmpty());
+        tree.Initialize(spheres, method, 3);
+        ASSERT_FALSE(tree.IsEmpty());
+        ASSERT_EQ(tree.GetPrimitiveCount(0), spheres.size());
+
+        // The primitives of the container, each of them once
+        std::vector<int> seen(spheres.size(), 0);
+        tree.ForEachPrimitive(0, [&](test_sphere const& s) { seen[&s - spheres.data()]++; });
+        for (int count : seen)
+            ASSERT_EQ(count, 1);
+
+        // Built from their bounds, and the children split the primitives of their parent
+        std::vector<bvh_bounds> bounds;
+        for (auto const& s : spheres)
+            bounds.push_back(bounds_of(s));
+        check_tree(tree.GetTree(), bounds);
+        bvh_node const& root = tree.GetNode(0);
+        if (!root.is_leaf())
+            ASSERT_EQ(tree.GetPrimitiveCount(root.first) + tree.GetPrimitiveCount(root.first + 1), spheres.size());
+
+        tree.clear();
+        ASSERT_TRUE(tree.IsEmpty());
+    }
+}
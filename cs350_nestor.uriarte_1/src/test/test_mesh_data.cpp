@@ -0,0 +1,314 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include "pch.hpp"
+#include "mesh_data.hpp"
+using namespace cs350;
+
+namespace {
+    using face = glm::vec<3, glm::ivec3>;
+
+    // Bigger than the pieces the parser splits files in (1 MB), so they are parsed by several tasks
+    const size_t c_large_size = 3 << 20;
+
+    void write_file(const char* path, std::string const& text)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << text;
+    }
+
+    // Parses the text as an .obj file
+    mesh_data parse(std::string const& text)
+    {
+        const char* path = "test_mesh_data.obj";
+        write_file(path, text);
+        mesh_data parsed = load_obj(path);
+        std::remove(path);
+        return parsed;
+    }
+
+    face make_face(glm::ivec3 a, glm::ivec3 b, glm::ivec3 c)
+    {
+        return face(a, b, c);
+    }
+
+    void expect_same(mesh_data const& a, mesh_data const& b)
+    {
+        ASSERT_EQ(a.positions, b.positions);
+        ASSERT_EQ(a.normals, b.normals);
+        ASSERT_EQ(a.uvs, b.uvs);
+        ASSERT_EQ(a.faces, b.faces);
+    }
+
+    float next_float(std::istream& is)
+    {
+        std::string value;
+        is >> value;
+        return static_cast<float>(std::atof(value.c_str()));
+    }
+
+    // The parser load_obj had before it mapped the file: a stream, triangles given with every index
+    mesh_data stream_load_obj(std::string const& text)
+    {
+        std::istringstream infile(text);
+        mesh_data          parsed;
+        std::string        lineStart;
+        while (infile >> lineStart) {
+            if (lineStart == "v" || lineStart == "vn") {
+                glm::vec3 value;
+                for (int i = 0; i < 3; ++i)
+                    value[i] = next_float(infile);
+                (lineStart == "v" ? parsed.positions : parsed.normals).push_back(value);
+            } else if (lineStart == "vt") {
+                glm::vec2 uv;
+                uv.x = next_float(infile);
+                uv.y = next_float(infile);
+                parsed.uvs.push_back(uv);
+            } else if (lineStart == "f") {
+                std::string values;
+                std::getline(infile, values);
+                int  v[3], t[3], n[3];
+                face f;
+                std::sscanf(values.c_str(), "%d/%d/%d %d/%d/%d %d/%d/%d", &v[0], &t[0], &n[0], &v[1], &t[1], &n[1], &v[2], &t[2], &n[2]);
+                for (int i = 0; i < 3; ++i)
+                    f[i] = glm::ivec3(v[i] - 1, t[i] - 1, n[i] - 1);
+                parsed.faces.push_back(f);
+            } else {
+                std::getline(infile, lineStart);
+            }
+        }
+        return parsed;
+    }
+}
+
+TEST(mesh_data, face_forms)
+{
+    auto parsed = parse("v 0 0 0\n"
+                        "v 1 0 0\n"
+                        "v 1 1 0\n"
+                        "vt 0 0\n"
+                        "vt 1 0\n"
+                        "vt 1 1\n"
+                        "vn 0 0 1\n"
+                        "f 1 2 3\n"
+                        "f 1/1 2/2 3/3\n"
+                        "f 1//1 2//1 3//1\n"
+                        "f 1/1/1 2/2/1 3/3/1\n");
+
+    ASSERT_EQ(parsed.positions.size(), 3u);
+    ASSERT_EQ(parsed.uvs.size(), 3u);
+    ASSERT_EQ(parsed.normals.size(), 1u);
+    ASSERT_EQ(parsed.positions[2], glm::vec3(1, 1, 0));
+    ASSERT_EQ(parsed.uvs[1], glm::vec2(1, 0));
+    ASSERT_EQ(parsed.normals[0], glm::vec3(0, 0, 1));
+
+    // Missing indices are -1
+    ASSERT_EQ(parsed.faces.size(), 4u);
+    ASSERT_EQ(parsed.faces[0], make_face({0, -1, -1}, {1, -1, -1}, {2, -1, -1}));
+    ASSERT_EQ(parsed.faces[1], make_face({0, 0, -1}, {1, 1, -1}, {2, 2, -1}));
+    ASSERT_EQ(parsed.faces[2], make_face({0, -1, 0}, {1, -1, 0}, {2, -1, 0}));
+    ASSERT_EQ(parsed.faces[3], make_face({0, 0, 0}, {1, 1, 0}, {2, 2, 0}));
+}
+
+TEST(mesh_data, polygons_are_split_in_triangles)
+{
+    auto parsed = parse("v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv -1 1 0\n"
+                        "f 1 2 3 4\n"
+                        "f 1 2 3 4 5\n");
+
+    // A fan around the first vertex
+    ASSERT_EQ(parsed.faces.size(), 5u);
+    ASSERT_EQ(parsed.faces[0], make_face({0, -1, -1}, {1, -1, -1}, {2, -1, -1}));
+    ASSERT_EQ(parsed.faces[1], make_face({0, -1, -1}, {2, -1, -1}, {3, -1, -1}));
+    ASSERT_EQ(parsed.faces[4], make_face({0, -1, -1}, {3, -1, -1}, {4, -1, -1}));
+}
+
+TEST(mesh_data, crlf_line_endings)
+{
+    std::string text = "# comment\n"
+                       "v 0.5 -1.25 2\n"
+                       "v 1 0 0\n"
+                       "v 1 1 0\n"
+                       "vt 0.25 0.75\n"
+                       "vn 0 1 0\n"
+                       "f 1/1/1 2/1/1 3/1/1\n"
+                       "f 1 2 3";
+
+    std::string crlf;
+    for (char c : text)
+        crlf += c == '\n' ? std::string("\r\n") : std::string(1, c);
+
+    auto parsed = parse(text);
+    ASSERT_EQ(parsed.positions[0], glm::vec3(0.5f, -1.25f, 2.0f));
+    ASSERT_EQ(parsed.faces.size(), 2u);
+    expect_same(parse(crlf), parsed);
+    expect_same(parse(crlf + "\r\n"), parsed);
+}
+
+TEST(mesh_data, empty_file)
+{
+    auto parsed = parse("");
+    ASSERT_TRUE(parsed.positions.empty());
+    ASSERT_TRUE(parsed.faces.empty());
+
+    // Nothing but lines that are not parsed
+    parsed = parse("# comment\r\ng group\n\n");
+    ASSERT_TRUE(parsed.positions.empty());
+    ASSERT_TRUE(parsed.faces.empty());
+}
+
+TEST(mesh_data, negative_indices_across_pieces)
+{
+    // A triangle after its own positions, all of them relative to the end
+    std::string text;
+    int         triangles = 0;
+    while (text.size() < c_large_size) {
+        for (int k = 0; k < 3; ++k)
+            text += "v " + std::to_string(triangles) + " " + std::to_string(k) + " 0\n";
+        text += "f -3 -2 -1\n";
+        triangles++;
+    }
+
+    auto parsed = parse(text);
+    ASSERT_EQ(parsed.positions.size(), size_t(triangles) * 3);
+    ASSERT_EQ(parsed.faces.size(), size_t(triangles));
+    for (int i = 0; i < triangles; ++i) {
+        ASSERT_EQ(parsed.faces[i], make_face({3 * i, -1, -1}, {3 * i + 1, -1, -1}, {3 * i + 2, -1, -1}));
+        ASSERT_EQ(parsed.positions[3 * i + 2], glm::vec3(float(i), 2.0f, 0.0f));
+    }
+}
+
+TEST(mesh_data, large_file_matches_stream_parser)
+{
+    // Elements and faces interleaved, as exporters write them
+    std::string text;
+    char        line[128];
+    for (int i = 0; text.size() < c_large_size; ++i) {
+        std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", i * 0.001, -i * 0.25, 1.0 / (i + 1));
+        text += line;
+        std::snprintf(line, sizeof(line), "vt %.6f %.6f\n", (i % 100) * 0.01, (i % 7) * 0.125);
+        text += line;
+        std::snprintf(line, sizeof(line), "vn %.6f %.6f %.6f\n", 0.0, (i % 2) ? 1.0 : -1.0, 0.5);
+        text += line;
+        if (i >= 2) {
+            std::snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d\n", i - 1, i - 1, i + 1, i, i, i, i + 1, i + 1, i - 1);
+            text += line;
+        }
+    }
+
+    auto parsed = parse(text);
+    ASSERT_GT(parsed.faces.size(), 1000u);
+    expect_same(parsed, stream_load_obj(text));
+}
+
+namespace {
+    template <typename T>
+    void expect_same_span(std::span<const T> view, std::vector<T> const& data)
+    {
+        ASSERT_EQ(view.size(), data.size());
+        for (size_t i = 0; i < data.size(); ++i)
+            ASSERT_EQ(view[i], data[i]);
+    }
+
+    void expect_same_view(mesh_view const& view, mesh_data const& data)
+    {
+        expect_same_span(view.positions, data.positions);
+        expect_same_span(view.normals, data.normals);
+        expect_same_span(view.uvs, data.uvs);
+        expect_same_span(view.faces, data.faces);
+    }
+
+    // A mesh with every kind of element
+    const char* c_cache_obj = "v -1 0 2\n"
+                              "v 1 0.5 0\n"
+                              "v 0 3 -4\n"
+                              "v 2 2 2\n"
+                              "vt 0 0\n"
+                              "vt 1 1\n"
+                              "vn 0 0 1\n"
+                              "f 1/1/1 2/2/1 3/1/1 4/2/1\n";
+}
+
+TEST(mesh_cache, round_trip)
+{
+    const char* path  = "test_mesh_cache.obj";
+    const char* cache = "test_mesh_cache.mesh";
+    write_file(path, c_cache_obj);
+    std::remove(cache);
+    mesh_data parsed = load_obj(path);
+
+    // Parsed the first time, writing the cache
+    {
+        mesh_cache mesh;
+        ASSERT_FALSE(mesh.open(path));
+        expect_same_view(mesh.view(), parsed);
+    }
+
+    // Mapped from the cache afterwards, with the bounds of the positions
+    {
+        mesh_cache mesh;
+        ASSERT_TRUE(mesh.open(path));
+        expect_same_view(mesh.view(), parsed);
+        ASSERT_EQ(mesh.view().min, glm::vec3(-1, 0, -4));
+        ASSERT_EQ(mesh.view().max, glm::vec3(2, 3, 2));
+    }
+
+    // A cache with no .obj next to it is used as well
+    std::remove(path);
+    {
+        mesh_cache mesh(path);
+        expect_same_view(mesh.view(), parsed);
+    }
+    std::remove(cache);
+}
+
+TEST(mesh_cache, empty_mesh)
+{
+    const char* cache = "test_mesh_cache_empty.mesh";
+    ASSERT_TRUE(save_mesh_cache(cache, mesh_data()));
+
+    // The header alone, no obj to parse it from
+    mesh_cache mesh;
+    ASSERT_TRUE(mesh.open("test_mesh_cache_empty.obj"));
+    ASSERT_TRUE(mesh.view().positions.empty());
+    ASSERT_TRUE(mesh.view().faces.empty());
+    std::remove(cache);
+}
+
+TEST(mesh_cache, broken_caches_are_parsed_again)
+{
+    const char* path  = "test_mesh_cache_broken.obj";
+    const char* cache = "test_mesh_cache_broken.mesh";
+    write_file(path, c_cache_obj);
+    mesh_data parsed = load_obj(path);
+    ASSERT_TRUE(save_mesh_cache(cache, parsed));
+
+    std::ifstream in(cache, std::ios::binary);
+    std::string   bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+
+    std::string truncated = bytes.substr(0, bytes.size() - 4);
+    std::string header    = bytes.substr(0, 8);
+    std::string magic     = "NOPE" + bytes.substr(4);
+    std::string version   = bytes;
+    version[4]++;
+
+    for (std::string const& broken : {truncated, header, magic, version, std::string("M")}) {
+        write_file(cache, broken);
+
+        // The .obj is parsed instead, and the cache written again
+        mesh_cache mesh;
+        ASSERT_FALSE(mesh.open(path));
+        expect_same_view(mesh.view(), parsed);
+
+        mesh_cache fixed;
+        ASSERT_TRUE(fixed.open(path));
+        expect_same_view(fixed.view(), parsed);
+    }
+    std::remove(path);
+    std::remove(cache);
+}
@@ -1,5 +1,129 @@
+/**
+* @file	file.cpp
+* @author Nestor Uriarte ,540000817, nestor.uriarte@digipen.edu
+* @date	Fri Oct 23 20:19:07 2020
+* @brief	This file contains the implementation of the mapped_file
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
 #include "pch.hpp"
 #include "file.hpp"
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace cs350 {
-}
\ No newline at end of file
+
+/**
+* @brief	constructor, mapping the given file
+* @param	char const* path
+**/
+	mapped_file::mapped_file(char const* path)
+	{
+		open(path);
+	}
+
+/**
+* @brief	destructor, unmapping the file
+**/
+	mapped_file::~mapped_file()
+	{
+		close();
+	}
+
+/**
+* @brief	maps the whole file as read only memory
+* @param	char const* path
+* @return		bool
+**/
+	bool mapped_file::open(char const* path)
+	{
+		close();
+
+#ifdef _WIN32
+		//opening the file
+		HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		//empty files can not be mapped
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		//mapping it
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (view == nullptr)
+		{
+			if (mapping)
+				CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		m_file = file;
+		m_mapping = mapping;
+		m_data = static_cast<char const*>(view);
+		m_size = static_cast<size_t>(size.QuadPart);
+#else
+		//opening the file
+		int file = ::open(path, O_RDONLY);
+		if (file < 0)
+			return false;
+
+		//empty files can not be mapped
+		struct stat info;
+		if (fstat(file, &info) != 0 || info.st_size == 0)
+		{
+			::close(file);
+			return false;
+		}
+
+		//mapping it, the mapping stays valid after closing the descriptor
+		void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		::close(file);
+		if (view == MAP_FAILED)
+			return false;
+
+		//read once from start to end
+		madvise(view, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+
+		m_data = static_cast<char const*>(view);
+		m_size = static_cast<size_t>(info.st_size);
+#endif
+		return true;
+	}
+
+/**
+* @brief	unmaps the file, if any
+* @return		void
+**/
+	void mapped_file::close() noexcept
+	{
+		if (m_data == nullptr)
+			return;
+
+#ifdef _WIN32
+		UnmapViewOfFile(m_data);
+		CloseHandle(m_mapping);
+		CloseHandle(m_file);
+		m_file = nullptr;
+		m_mapping = nullptr;
+#else
+		munmap(const_cast<char*>(m_data), m_size);
+#endif
+		m_data = nullptr;
+		m_size = 0;
+	}
+}
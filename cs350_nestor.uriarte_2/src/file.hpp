@@ -1,5 +1,48 @@
+/**
+* @file	file.hpp
+* @author Nestor Uriarte ,540000817, nestor.uriarte@digipen.edu
+* @date	Fri Oct 23 20:19:07 2020
+* @brief	This file contains the definition of the mapped_file, a read only view of a whole file
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
 #pragma once
+#include <cstddef>
 
 namespace cs350 {
 
-}
\ No newline at end of file
+    /**
+     * Read only memory mapping of a whole file, unmapped when destroyed
+     */
+    class mapped_file
+    {
+      public:
+        mapped_file() = default;
+        explicit mapped_file(char const* path);
+        ~mapped_file();
+
+        // Disallow copy, the mapping has a single owner
+        mapped_file(const mapped_file&) = delete;
+        void operator=(const mapped_file&) = delete;
+
+        /**
+         * Maps the file, closing any previous one
+         * @param path
+         * @return bool, false if the file can not be opened or is empty
+         */
+        bool open(char const* path);
+        void close() noexcept;
+
+        [[nodiscard]] bool        is_open() const noexcept { return m_data != nullptr; }
+        [[nodiscard]] char const* data() const noexcept { return m_data; }
+        [[nodiscard]] size_t      size() const noexcept { return m_size; }
+
+      private:
+        char const* m_data = nullptr;
+        size_t      m_size = 0;
+#ifdef _WIN32
+        // File and mapping handles
+        void* m_file    = nullptr;
+        void* m_mapping = nullptr;
+#endif
+    };
+}
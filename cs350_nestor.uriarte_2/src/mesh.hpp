@@ -15,7 +15,7 @@
 Mesh class
 
 The functions included are:
-- void mesh::generate(const mesh_data& data);
+- void mesh::generate(const mesh_view& data);
 - mesh::~mesh();
 - void mesh::generateBuffers();
 - void mesh::bindBuffers();
@@ -43,7 +43,7 @@ namespace cs350 {
           GLuint mVBO[3];
 
       public:
-          void generate(const mesh_data& data);
+          void generate(const mesh_view& data);
           ~mesh();
           void generateBuffers();
           void bindBuffers();
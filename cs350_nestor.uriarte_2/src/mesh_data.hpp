@@ -17,10 +17,13 @@ parser functions
 The functions included are:
 - mesh_data load_obj(const char* filename);
 - std::vector<mesh_data> load_objs(const char* filename);
+- bool save_mesh_cache(const char* filename, const mesh_data& data);
 
 ***************************************************************************/
 
 #pragma once
+#include <span>
+#include "file.hpp"
 #include "geometry.hpp" // triangle
 
 namespace cs350 {
@@ -32,6 +35,62 @@ namespace cs350 {
         std::vector<glm::vec<3, glm::ivec3>> faces;
     };
 
+    /**
+     * Read only arrays of a mesh, pointing either to a mesh_data or to a mapped mesh cache
+     */
+    struct mesh_view
+    {
+        std::span<const glm::vec3>               positions;
+        std::span<const glm::vec3>               normals;
+        std::span<const glm::vec2>               uvs;
+        std::span<const glm::vec<3, glm::ivec3>> faces;
+        // Bounds of the positions
+        glm::vec3 min{0.0f};
+        glm::vec3 max{0.0f};
+
+        mesh_view() = default;
+        mesh_view(const mesh_data& data);
+    };
+
+    /**
+     * Mesh of an .obj loaded through its binary cache, the .mesh file next to it. The cache is mapped
+     * and viewed in place when it is newer than the .obj, otherwise the .obj is parsed and the cache
+     * written again for the next time
+     */
+    class mesh_cache
+    {
+      public:
+        mesh_cache() = default;
+        explicit mesh_cache(const char* filename);
+
+        // Disallow copy, the view points into the mapping
+        mesh_cache(const mesh_cache&) = delete;
+        void operator=(const mesh_cache&) = delete;
+
+        /**
+         * Loads a mesh, dropping the previous one
+         * @param filename, of the .obj
+         * @return bool, whether it was mapped from the cache
+         */
+        bool open(const char* filename);
+
+        [[nodiscard]] const mesh_view& view() const noexcept { return mView; }
+
+      private:
+        mapped_file mFile;
+        // Arrays of the .obj when the cache is out of date
+        mesh_data mParsed;
+        mesh_view mView;
+    };
+
     mesh_data load_obj(const char* filename);
     std::vector<mesh_data> load_objs(const char* filename);
+
+    /**
+     * Writes the binary cache of a mesh
+     * @param filename, of the cache
+     * @param data
+     * @return bool, false if it can not be written
+     */
+    bool save_mesh_cache(const char* filename, const mesh_data& data);
 }
\ No newline at end of file
@@ -125,20 +125,29 @@ namespace cs350{
 	**************************************************************************/
 	void renderer::load_resources()
 	{
-		//loading all the meshes from the .objs
-		mResources.meshes.bunny->generate(load_obj("resources/meshes/bunny.obj"));
-		mResources.meshes.cube->generate(load_obj("resources/meshes/cube.obj"));
-		mResources.meshes.cylinder->generate(load_obj("resources/meshes/cylinder.obj"));
-		mResources.meshes.gourd->generate(load_obj("resources/meshes/gourd.obj"));
-		mResources.meshes.icosahedron->generate(load_obj("resources/meshes/icosahedron.obj"));
-		mResources.meshes.line->generate(load_obj("resources/meshes/line.obj"));
-		mResources.meshes.octohedron->generate(load_obj("resources/meshes/octohedron.obj"));
-		mResources.meshes.quad->generate(load_obj("resources/meshes/quad.obj"));
-		mResources.meshes.segment->generate(load_obj("resources/meshes/segment.obj"));
-		mResources.meshes.sphere->generate(load_obj("resources/meshes/sphere.obj"));
-		mResources.meshes.sponza->generate(load_obj("resources/meshes/sponza.obj"));
-		mResources.meshes.suzanne->generate(load_obj("resources/meshes/suzanne.obj"));
-		mResources.meshes.triangle->generate(load_obj("resources/meshes/triangle.obj"));
+		//loading all the meshes, through their binary cache
+		const std::pair<std::shared_ptr<mesh>&, const char*> meshes[] = {
+			{ mResources.meshes.bunny, "resources/meshes/bunny.obj" },
+			{ mResources.meshes.cube, "resources/meshes/cube.obj" },
+			{ mResources.meshes.cylinder, "resources/meshes/cylinder.obj" },
+			{ mResources.meshes.gourd, "resources/meshes/gourd.obj" },
+			{ mResources.meshes.icosahedron, "resources/meshes/icosahedron.obj" },
+			{ mResources.meshes.line, "resources/meshes/line.obj" },
+			{ mResources.meshes.octohedron, "resources/meshes/octohedron.obj" },
+			{ mResources.meshes.quad, "resources/meshes/quad.obj" },
+			{ mResources.meshes.segment, "resources/meshes/segment.obj" },
+			{ mResources.meshes.sphere, "resources/meshes/sphere.obj" },
+			{ mResources.meshes.sponza, "resources/meshes/sponza.obj" },
+			{ mResources.meshes.suzanne, "resources/meshes/suzanne.obj" },
+			{ mResources.meshes.triangle, "resources/meshes/triangle.obj" },
+		};
+
+		mesh_cache cache;
+		for (const auto& it : meshes)
+		{
+			cache.open(it.second);
+			it.first->generate(cache.view());
+		}
 
 		//creating the shader program
 		mResources.shaders.color.create("resources/shaders/color.vert", "resources/shaders/color.frag");
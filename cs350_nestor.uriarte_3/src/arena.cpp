@@ -0,0 +1,121 @@
+/**
+* @file		 arena.cpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the implementation of the arena
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#include <algorithm>
+#include "arena.hpp"
+
+namespace cs350 {
+
+	// Smallest block requested to the system
+	static const size_t c_min_block_size = 64 * 1024;
+
+/**
+* @brief	constructor, optionally creating the first block
+* @param	size_t initial_size
+**/
+	arena::arena(size_t initial_size)
+	{
+		if (initial_size > 0)
+			reserve(initial_size);
+	}
+
+/**
+* @brief	sizes the first block, only if nothing has been handed out yet
+* @param	size_t bytes
+* @return		void
+**/
+	void arena::reserve(size_t bytes)
+	{
+		//in use or already big enough
+		if (m_used != 0 || (!m_blocks.empty() && m_blocks[0].size >= bytes))
+			return;
+
+		//replacing every block by a single one
+		m_blocks.clear();
+		m_blocks.push_back({ std::make_unique<std::byte[]>(bytes), bytes });
+		m_allocations++;
+
+		m_block = 0;
+		m_top = 0;
+	}
+
+/**
+* @brief	hands out memory from the top of the stack
+* @param	size_t bytes
+* @param	size_t alignment
+* @return		void*
+**/
+	void* arena::allocate_bytes(size_t bytes, size_t alignment)
+	{
+		//first use, requesting the first block
+		if (m_blocks.empty())
+		{
+			size_t size = std::max(bytes, c_min_block_size);
+			m_blocks.push_back({ std::make_unique<std::byte[]>(size), size });
+			m_allocations++;
+		}
+
+		//aligning the top on the current block
+		size_t start = (m_top + alignment - 1) & ~(alignment - 1);
+
+		//if it does not fit, moving to the next block
+		if (start + bytes > m_blocks[m_block].size)
+		{
+			//blocks after the current one are free, reusing the first that fits
+			size_t next = m_block + 1;
+			while (next < m_blocks.size() && m_blocks[next].size < bytes)
+				next++;
+
+			//none of them fits, requesting a new one
+			if (next == m_blocks.size())
+			{
+				size_t size = std::max({ bytes, c_min_block_size, m_blocks.back().size * 2 });
+				m_blocks.push_back({ std::make_unique<std::byte[]>(size), size });
+				m_allocations++;
+			}
+
+			//keeping the used blocks together
+			std::swap(m_blocks[next], m_blocks[m_block + 1]);
+
+			m_block++;
+			m_top = 0;
+			start = 0;
+		}
+
+		//moving the top
+		m_used += start + bytes - m_top;
+		m_top = start + bytes;
+		m_peak = std::max(m_peak, m_used);
+
+		return m_blocks[m_block].memory.get() + start;
+	}
+
+/**
+* @brief	releases everything handed out after the marker
+* @param	marker const& m
+* @return		void
+**/
+	void arena::rewind(marker const& m) noexcept
+	{
+		m_block = m.block;
+		m_top = m.top;
+		m_used = m.used;
+	}
+
+/**
+* @brief	total memory owned by the arena
+* @return		size_t
+**/
+	size_t arena::capacity() const noexcept
+	{
+		size_t total = 0;
+		for (auto const& it : m_blocks)
+			total += it.size;
+
+		return total;
+	}
+}
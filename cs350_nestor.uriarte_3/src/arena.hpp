@@ -0,0 +1,79 @@
+/**
+* @file		 arena.hpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the definition of the arena, scratch memory handed out as a stack
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace cs350 {
+
+    /**
+     * Scratch memory handed out as a stack. Memory is released by rewinding to a marker,
+     * and blocks are kept for reuse, so after the first pass it does not allocate again.
+     * Returned pointers stay valid until the arena is rewound past them.
+     */
+    class arena
+    {
+      public:
+        /**
+         * Position of the top of the stack
+         */
+        struct marker
+        {
+            size_t block;
+            size_t top;
+            size_t used;
+        };
+
+        explicit arena(size_t initial_size = 0);
+
+        /**
+         * Makes sure the first block can hold the given bytes (only when the arena is empty)
+         * @param bytes
+         */
+        void reserve(size_t bytes);
+
+        /**
+         * Gets uninitialized memory for count elements of T (T must be trivially copyable)
+         * @param count
+         * @return T*
+         */
+        template <typename T>
+        T* allocate(size_t count)
+        {
+            return static_cast<T*>(allocate_bytes(count * sizeof(T), alignof(T)));
+        }
+
+        [[nodiscard]] marker get_marker() const noexcept { return { m_block, m_top, m_used }; }
+        void                 rewind(marker const& m) noexcept;
+
+        [[nodiscard]] size_t peak() const noexcept { return m_peak; }
+        [[nodiscard]] size_t allocations() const noexcept { return m_allocations; }
+        [[nodiscard]] size_t capacity() const noexcept;
+
+      private:
+        void* allocate_bytes(size_t bytes, size_t alignment);
+
+        struct block
+        {
+            std::unique_ptr<std::byte[]> memory;
+            size_t                       size;
+        };
+
+        // Memory blocks, never freed until the arena dies
+        std::vector<block> m_blocks;
+        // Block in use and offset of the top inside of it
+        size_t m_block = 0;
+        size_t m_top   = 0;
+        // Bytes handed out (and the highest it got)
+        size_t m_used = 0;
+        size_t m_peak = 0;
+        // Amount of blocks requested to the system
+        size_t m_allocations = 0;
+    };
+}
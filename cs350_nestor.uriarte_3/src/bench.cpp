@@ -0,0 +1,399 @@
+/**
+* @file		 bench.cpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 Headless kdtree benchmark: bench [--trials n] [--size n] [--random n] [--csv path] [--json path] [scene]...
+*			builds and traces the test scenes (all of them if none is given), printing the statistics of every measure
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "material.hpp"
+#include "raytracer.hpp"
+#include "scene.hpp"
+
+namespace {
+    const float panel_scale    = 5;
+    const char* c_mesh_bunny   = "resources/bunny.obj";
+    const char* c_mesh_suzanne = "resources/suzanne.obj";
+    const char* c_mesh_dragon  = "resources/dragon.obj";
+    const char* c_mesh_gourd   = "resources/gourd.obj";
+    const char* c_mesh_quad    = "resources/quad.obj";
+
+    // Keeps the timed loops from being optimized away
+    volatile float g_sink = 0.0f;
+
+    /**
+     * Values of a measure over the trials
+     */
+    struct measure
+    {
+        std::string         scene;
+        std::string         name;
+        std::string         unit;
+        std::vector<double> samples;
+
+        [[nodiscard]] double min() const { return *std::min_element(samples.begin(), samples.end()); }
+        [[nodiscard]] double max() const { return *std::max_element(samples.begin(), samples.end()); }
+
+        [[nodiscard]] double mean() const
+        {
+            double sum = 0.0;
+            for (double it : samples)
+                sum += it;
+            return sum / static_cast<double>(samples.size());
+        }
+
+        [[nodiscard]] double median() const
+        {
+            std::vector<double> sorted = samples;
+            std::sort(sorted.begin(), sorted.end());
+            size_t half = sorted.size() / 2;
+            return sorted.size() % 2 != 0 ? sorted[half] : (sorted[half - 1] + sorted[half]) * 0.5;
+        }
+
+        // Sample standard deviation (0 for a single trial)
+        [[nodiscard]] double stddev() const
+        {
+            if (samples.size() < 2)
+                return 0.0;
+
+            double avg = mean();
+            double sum = 0.0;
+            for (double it : samples)
+                sum += (it - avg) * (it - avg);
+            return std::sqrt(sum / static_cast<double>(samples.size() - 1));
+        }
+    };
+
+    /**
+     * Scene to measure, set up as the tests do
+     */
+    struct bench_scene
+    {
+        char const* name;
+        void (*load)(cs350::scene& scene);
+    };
+
+    cs350::material material_default()
+    {
+        cs350::material material     = {};
+        material.diffuse             = {0.8, 0.8, 0.8};
+        material.specular_reflection = 1;
+        material.specular_exponent   = 0;
+        material.attenuation         = {};
+        material.electric_perm       = 0.0;
+        material.magnetic_perm       = 0.0;
+        return material;
+    }
+
+    void add_lights(cs350::scene& scene)
+    {
+        scene.add_light({{2.45, 2.4, 2.5}, {0.4, 0.4, 0.4}, 0.1f});
+        scene.add_light({{-2.45, 2.4, -2.5}, {0.4, 0.4, 0.4}, 0.1f});
+    }
+
+    void load_box(cs350::scene& scene)
+    {
+        cs350::material material = material_default();
+        scene.add_mesh(c_mesh_quad, {-panel_scale, 0, 0}, {0, -90, 0}, glm::vec3{panel_scale}, material);
+        scene.add_mesh(c_mesh_quad, {panel_scale, 0, 0}, {0, 90, 0}, glm::vec3{panel_scale}, material);
+        scene.add_mesh(c_mesh_quad, {0, panel_scale, 0}, {-90, 0, 0}, glm::vec3{panel_scale}, material);
+        scene.add_mesh(c_mesh_quad, {0, -panel_scale, 0}, {-90, 0, 0}, glm::vec3{panel_scale}, material);
+        scene.add_mesh(c_mesh_quad, {0, 0, panel_scale}, {0, 0, 0}, glm::vec3{panel_scale}, material);
+        scene.add_mesh(c_mesh_quad, {0, 0, -panel_scale}, {0, 0, 0}, glm::vec3{panel_scale}, material);
+        scene.add_mesh(c_mesh_suzanne, {panel_scale * 0.5, -panel_scale + 1, panel_scale * 0.5}, {0, 30, 0}, glm::vec3{1}, material);
+        add_lights(scene);
+    }
+
+    const bench_scene c_scenes[] = {
+        {"bunny", [](cs350::scene& s) { add_lights(s); s.add_mesh(c_mesh_bunny, {0, -1, -1}, {0, 180, 0}, glm::vec3{10}, material_default()); }},
+        {"suzanne", [](cs350::scene& s) { add_lights(s); s.add_mesh(c_mesh_suzanne, {0, 0, -1}, {0, 180, 0}, glm::vec3{1}, material_default()); }},
+        {"dragon", [](cs350::scene& s) { add_lights(s); s.add_mesh(c_mesh_dragon, {0, 0, -1}, {0, 90, 0}, glm::vec3{3}, material_default()); }},
+        {"gourd", [](cs350::scene& s) { add_lights(s); s.add_mesh(c_mesh_gourd, {0, 0, -1}, {0, 180, 0}, glm::vec3{1}, material_default()); }},
+        {"cornell", load_box},
+    };
+
+    /**
+     * Primary rays of the camera the tests use, 60 degrees of vertical field of view
+     * @param size, of the square image
+     * @return std::vector<cs350::ray>
+     */
+    std::vector<cs350::ray> make_primary_rays(unsigned size)
+    {
+        glm::vec3 center{0, 0, -3};
+        glm::vec3 view{0, 0, 1};
+        glm::vec3 up{0, 1, 0};
+        glm::vec3 right = glm::normalize(glm::cross(view, up));
+        float     half  = std::tan(glm::radians(30.0f));
+
+        std::vector<cs350::ray> rays;
+        rays.reserve(static_cast<size_t>(size) * size);
+        for (unsigned y = 0; y < size; ++y) {
+            for (unsigned x = 0; x < size; ++x) {
+                float     u         = (2.0f * (x + 0.5f) / size - 1.0f) * half;
+                float     v         = (1.0f - 2.0f * (y + 0.5f) / size) * half;
+                glm::vec3 direction = view + right * u + up * v;
+                rays.emplace_back(center, direction);
+            }
+        }
+        return rays;
+    }
+
+    /**
+     * Rays from the primary hits to every light, traced up to the light (t in [0, 1])
+     * @param scene, with the kdtree built
+     * @param primary
+     * @return std::vector<cs350::ray>
+     */
+    std::vector<cs350::ray> make_shadow_rays(cs350::scene const& scene, std::vector<cs350::ray> const& primary)
+    {
+        cs350::raytracing_stats stats{};
+        std::vector<cs350::ray> rays;
+        for (auto const& r : primary) {
+            auto hit = scene.get_closest_kdtree(r, stats);
+            if (!hit())
+                continue;
+
+            glm::vec3 point = r.mP + r.mVec * hit.intersection_time;
+            for (auto const& light : scene.lights()) {
+                // Started a bit off the surface, so it does not hit its own triangle
+                glm::vec3 to_light = light.position - point;
+                glm::vec3 origin   = point + to_light * 1e-4f;
+                rays.emplace_back(origin, to_light);
+            }
+        }
+        return rays;
+    }
+
+    /**
+     * Rays with random origins inside the bounds of the scene and random directions
+     * @param scene, with the kdtree built
+     * @param count
+     * @return std::vector<cs350::ray>
+     */
+    std::vector<cs350::ray> make_random_rays(cs350::scene const& scene, size_t count)
+    {
+        // The same rays on every run
+        std::mt19937                          rng(350);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::normal_distribution<float>       normal(0.0f, 1.0f);
+
+        cs350::aabb const&      bounds = scene.kdtree().bounds();
+        std::vector<cs350::ray> rays;
+        rays.reserve(count);
+        while (rays.size() < count) {
+            glm::vec3 origin    = bounds.mMin + (bounds.mMax - bounds.mMin) * glm::vec3{unit(rng), unit(rng), unit(rng)};
+            glm::vec3 direction = {normal(rng), normal(rng), normal(rng)};
+            if (glm::length(direction) < 1e-6f)
+                continue;
+
+            direction = glm::normalize(direction);
+            rays.emplace_back(origin, direction);
+        }
+        return rays;
+    }
+
+    /**
+     * Runs a function, returning the time it took
+     * @param fn
+     * @return double, milliseconds
+     */
+    template <typename F>
+    double time_ms(F const& fn)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /**
+     * Traces rays to their closest hit
+     * @param scene
+     * @param rays
+     * @return double, millions of rays per second
+     */
+    double trace_closest(cs350::scene const& scene, std::vector<cs350::ray> const& rays)
+    {
+        cs350::raytracing_stats stats{};
+        double                  ms = time_ms([&]() {
+            float sum = 0.0f;
+            for (auto const& r : rays)
+                sum += scene.get_closest_kdtree(r, stats).intersection_time;
+            g_sink = sum;
+        });
+        return static_cast<double>(rays.size()) / (ms * 1000.0);
+    }
+
+    /**
+     * Traces shadow rays up to the light
+     * @param scene
+     * @param rays
+     * @return double, millions of rays per second
+     */
+    double trace_occluded(cs350::scene const& scene, std::vector<cs350::ray> const& rays)
+    {
+        cs350::raytracing_query_stats stats{};
+        double                        ms = time_ms([&]() {
+            unsigned occluded = 0;
+            for (auto const& r : rays)
+                occluded += scene.is_occluded(r, 1.0f, stats) ? 1 : 0;
+            g_sink = static_cast<float>(occluded);
+        });
+        return static_cast<double>(rays.size()) / (ms * 1000.0);
+    }
+
+    void write_csv(std::ostream& os, std::vector<measure> const& measures)
+    {
+        os << "scene,measure,unit,trials,min,median,mean,max,stddev" << std::endl;
+        os << std::setprecision(6);
+        for (auto const& m : measures)
+            os << m.scene << "," << m.name << "," << m.unit << "," << m.samples.size() << "," << m.min() << "," << m.median() << ","
+               << m.mean() << "," << m.max() << "," << m.stddev() << std::endl;
+    }
+
+    void write_json(std::ostream& os, std::vector<measure> const& measures, int trials, unsigned size)
+    {
+        os << std::setprecision(6);
+        os << "{" << std::endl;
+        os << "  \"trials\": " << trials << "," << std::endl;
+        os << "  \"image_size\": " << size << "," << std::endl;
+        os << "  \"results\": [" << std::endl;
+        for (size_t i = 0; i < measures.size(); ++i) {
+            measure const& m = measures[i];
+            os << "    {\"scene\": \"" << m.scene << "\", \"measure\": \"" << m.name << "\", \"unit\": \"" << m.unit << "\", \"min\": " << m.min()
+               << ", \"median\": " << m.median() << ", \"mean\": " << m.mean() << ", \"max\": " << m.max() << ", \"stddev\": " << m.stddev()
+               << ", \"samples\": [";
+            for (size_t k = 0; k < m.samples.size(); ++k)
+                os << (k != 0 ? ", " : "") << m.samples[k];
+            os << "]}" << (i + 1 != measures.size() ? "," : "") << std::endl;
+        }
+        os << "  ]" << std::endl;
+        os << "}" << std::endl;
+    }
+
+    void write_table(std::ostream& os, std::vector<measure> const& measures)
+    {
+        os << std::left << std::setw(10) << "scene" << std::setw(16) << "measure" << std::right << std::setw(12) << "median" << std::setw(12)
+           << "mean" << std::setw(12) << "stddev" << std::setw(12) << "min" << std::setw(12) << "max"
+           << "  unit" << std::endl;
+        os << std::fixed << std::setprecision(3);
+        for (auto const& m : measures)
+            os << std::left << std::setw(10) << m.scene << std::setw(16) << m.name << std::right << std::setw(12) << m.median() << std::setw(12)
+               << m.mean() << std::setw(12) << m.stddev() << std::setw(12) << m.min() << std::setw(12) << m.max() << "  " << m.unit << std::endl;
+        os << std::defaultfloat;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int                      trials = 5;
+    unsigned                 size   = 256;
+    size_t                   random_count = 100000;
+    std::string              csv;
+    std::string              json;
+    std::vector<std::string> names;
+
+    for (int i = 1; i < argc; ++i) {
+        bool        has_value = i + 1 < argc;
+        char const* arg       = argv[i];
+        if (std::strcmp(arg, "--trials") == 0 && has_value)
+            trials = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(arg, "--size") == 0 && has_value)
+            size = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        else if (std::strcmp(arg, "--random") == 0 && has_value)
+            random_count = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        else if (std::strcmp(arg, "--csv") == 0 && has_value)
+            csv = argv[++i];
+        else if (std::strcmp(arg, "--json") == 0 && has_value)
+            json = argv[++i];
+        else if (arg[0] == '-') {
+            std::cerr << "usage: " << argv[0] << " [--trials n] [--size n] [--random n] [--csv path] [--json path] [scene]..." << std::endl;
+            std::cerr << "scenes: bunny suzanne dragon gourd cornell" << std::endl;
+            return 1;
+        } else
+            names.emplace_back(arg);
+    }
+
+    // The config the tests render with
+    cs350::kdtree::config kdconfig{};
+    kdconfig.cost_intersection = 80;
+    kdconfig.cost_traversal    = 1;
+    kdconfig.max_depth         = 30;
+
+    std::vector<measure> measures;
+    for (auto const& bench : c_scenes) {
+        if (!names.empty() && std::find(names.begin(), names.end(), bench.name) == names.end())
+            continue;
+
+        cs350::scene scene;
+        bench.load(scene);
+        std::cerr << bench.name << ": " << scene.triangles().size() << " triangles" << std::endl;
+
+        measure build{bench.name, "build", "ms", {}};
+        measure primary{bench.name, "primary", "Mrays/s", {}};
+        measure shadow{bench.name, "shadow", "Mrays/s", {}};
+        measure random{bench.name, "random", "Mrays/s", {}};
+        measure memory{bench.name, "memory", "KB", {}};
+        measure build_memory{bench.name, "build_memory_bound", "KB", {}};
+
+        std::vector<cs350::ray> primary_rays = make_primary_rays(size);
+        std::vector<cs350::ray> shadow_rays;
+        std::vector<cs350::ray> random_rays;
+
+        for (int trial = 0; trial < trials; ++trial) {
+            build.samples.push_back(time_ms([&]() { scene.build_kdtree(kdconfig); }));
+
+            // The rays depend on the tree, the same one every trial
+            if (trial == 0) {
+                shadow_rays = make_shadow_rays(scene, primary_rays);
+                random_rays = make_random_rays(scene, random_count);
+            }
+
+            primary.samples.push_back(trace_closest(scene, primary_rays));
+            shadow.samples.push_back(trace_occluded(scene, shadow_rays));
+            random.samples.push_back(trace_closest(scene, random_rays));
+            memory.samples.push_back(static_cast<double>(scene.kdtree().memory_footprint()) / 1024.0);
+            build_memory.samples.push_back(static_cast<double>(scene.kdtree().get_build_stats().memory_upper_bound) / 1024.0);
+        }
+
+        for (auto* m : {&build, &primary, &shadow, &random, &memory, &build_memory})
+            measures.push_back(std::move(*m));
+    }
+
+    if (measures.empty()) {
+        std::cerr << "no scene to run" << std::endl;
+        return 1;
+    }
+
+    write_table(std::cout, measures);
+
+    if (!csv.empty()) {
+        std::ofstream file(csv);
+        write_csv(file, measures);
+        if (!file) {
+            std::cerr << "could not write " << csv << std::endl;
+            return 1;
+        }
+    }
+
+    if (!json.empty()) {
+        std::ofstream file(json);
+        write_json(file, measures, trials, size);
+        if (!file) {
+            std::cerr << "could not write " << json << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+/**
+* @file		 direct_render.cpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the implementation of the direct lighting render
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#include <cmath>
+#include "direct_render.hpp"
+#include "camera.hpp"
+#include "scene.hpp"
+
+namespace cs350 {
+
+	namespace {
+
+/**
+* @brief	offset in [0, 1) of a sample of a pixel, the same whatever the thread tracing it
+* @param	unsigned x
+* @param	unsigned y
+* @param	unsigned sample
+* @param	unsigned axis
+* @return		float
+**/
+		float jitter(unsigned x, unsigned y, unsigned sample, unsigned axis)
+		{
+			//the first sample is the center of the pixel
+			if (sample == 0)
+				return 0.5F;
+
+			unsigned h = x * 73856093u ^ y * 19349663u ^ sample * 83492791u ^ axis * 2654435761u;
+			h ^= h >> 16;
+			h *= 0x7feb352du;
+			h ^= h >> 15;
+			h *= 0x846ca68bu;
+			h ^= h >> 16;
+			return static_cast<float>(h >> 8) * (1.0F / 16777216.0F);
+		}
+	}
+
+/**
+* @brief	builds the function tracing a sample of a pixel of the scene and its instances
+* @param	scene const& scene
+* @param	camera const& camera
+* @param	unsigned width
+* @param	unsigned height
+* @param	raytracing_config const& cfg
+* @return		progressive_render::sample_function
+**/
+	progressive_render::sample_function direct_lighting_sample(scene const& scene, camera const& camera, unsigned width, unsigned height, raytracing_config const& cfg)
+	{
+		//camera basis, the same as the primary rays of the tests
+		glm::vec3 eye = camera.center;
+		glm::vec3 view = glm::normalize(camera.view);
+		glm::vec3 right = glm::normalize(glm::cross(view, camera.up));
+		glm::vec3 up = glm::cross(right, view);
+		float half = std::tan(glm::radians(30.0F));
+		float aspect = static_cast<float>(width) / static_cast<float>(height);
+		bool useKdtree = cfg.use_kdtree;
+		float bias = cfg.shadow_bias;
+
+		return [&scene, eye, view, right, up, half, aspect, useKdtree, bias, width, height](unsigned x, unsigned y, unsigned sample, unsigned)
+		{
+			float u = (2.0F * (static_cast<float>(x) + jitter(x, y, sample, 0)) / static_cast<float>(width) - 1.0F) * half * aspect;
+			float v = (1.0F - 2.0F * (static_cast<float>(y) + jitter(x, y, sample, 1)) / static_cast<float>(height)) * half;
+			glm::vec3 origin = eye;
+			ray r(origin, view + right * u + up * v);
+
+			//closest of the scene triangles and the instances
+			raytracing_query_stats stats{};
+			scene_intersection hit = useKdtree ? scene.get_closest_kdtree(r, stats) : scene.get_closest_bf(r, stats);
+			scene_instance_intersection instanceHit = scene.get_closest_instance(r, useKdtree, stats);
+
+			float t;
+			glm::vec3 normal;
+			material const* surface;
+			if (instanceHit() && (!hit() || instanceHit.intersection_time < hit.intersection_time))
+			{
+				t = instanceHit.intersection_time;
+				normal = instanceHit.world_geometry().normal();
+				surface = &instanceHit.surface_material();
+			}
+			else if (hit())
+			{
+				t = hit.intersection_time;
+				normal = hit.triangle->geometry.normal();
+				surface = &hit.triangle->material;
+			}
+			else
+				return glm::vec3(0.0F);
+
+			//facing the ray, whatever the winding of the triangle
+			normal = glm::normalize(normal);
+			if (glm::dot(normal, r.mVec) > 0.0F)
+				normal = -normal;
+			glm::vec3 point = r.mP + r.mVec * t;
+
+			//every light not blocked by the triangles or the instances
+			glm::vec3 color(0.0F);
+			for (auto const& light : scene.lights())
+			{
+				glm::vec3 toLight = light.position - point;
+				float cosine = glm::dot(normal, glm::normalize(toLight));
+				if (cosine <= 0.0F)
+					continue;
+
+				//started off the surface, traced up to the light
+				glm::vec3 shadowOrigin = point + normal * bias;
+				ray shadow(shadowOrigin, light.position - shadowOrigin);
+				if (scene.is_occluded(shadow, 1.0F, stats))
+					continue;
+
+				color += surface->diffuse * light.intensity * cosine;
+			}
+			return color;
+		};
+	}
+}
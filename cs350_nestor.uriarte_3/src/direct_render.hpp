@@ -0,0 +1,30 @@
+/**
+* @file		 direct_render.hpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the definition of the direct lighting render, the one drawing the instances of a scene
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#pragma once
+#include "progressive.hpp"
+
+namespace cs350 {
+    class scene;
+    class camera;
+
+    /**
+     * Sample function for progressive_render that draws the scene along with its instances, which the prebuilt
+     * raytrace() never sees. The closest hit of the triangles and of the instances is lit by every light
+     * (diffuse, point lights) with a shadow ray towards each one. The first sample is at the center of the
+     * pixel, the rest are jittered from the sample index, so the image does not depend on the workers.
+     * Uses use_kdtree and shadow_bias of the config, and the camera of the tests (60 degrees of vertical
+     * field of view)
+     * @param scene, with the kdtree built, it has to outlive the function
+     * @param camera
+     * @param width, of the image
+     * @param height
+     * @param cfg
+     * @return progressive_render::sample_function
+     */
+    progressive_render::sample_function direct_lighting_sample(scene const& scene, camera const& camera, unsigned width, unsigned height, raytracing_config const& cfg);
+}
@@ -9,6 +9,7 @@
 * @copyright Copyright (C) 2020 DigiPen Institute of Technology .
 */
 
+#include <ostream>
 #include "geometry.hpp"
 
 namespace cs350 {
@@ -231,6 +232,52 @@ namespace cs350 {
 		return tMin;
 	}
 
+	/**
+	* @brief computes the interval of the ray that lies inside an aabb
+	* @param const ray& r
+	* @param const aabb& a
+	* @param float& tMin, entry time (clamped to 0 if the ray starts inside)
+	* @param float& tMax, exit time
+	* @return bool, false if the ray misses the aabb
+	*/
+	bool clip_ray_aabb(const ray& r, const aabb& a, float& tMin, float& tMax)
+	{
+		tMin = 0.0F;
+		tMax = FLT_MAX;
+
+		//slab test on the three axis
+		for (int i = 0; i < 3; i++)
+		{
+			//if the ray is parallel to the slab it has to start inside of it
+			if (r.mVec[i] <= cEpsilon && r.mVec[i] >= -cEpsilon)
+			{
+				if (r.mP[i] < a.mMin[i] || r.mP[i] > a.mMax[i])
+					return false;
+
+				continue;
+			}
+
+			float divider = 1.0F / r.mVec[i];
+
+			float t1 = (a.mMin[i] - r.mP[i]) * divider;
+			float t2 = (a.mMax[i] - r.mP[i]) * divider;
+
+			if (t1 > t2)
+				std::swap(t1, t2);
+
+			if (t1 > tMin)
+				tMin = t1;
+
+			if (t2 < tMax)
+				tMax = t2;
+
+			if (tMin > tMax)
+				return false;
+		}
+
+		return true;
+	}
+
 	/**
 	* @brief checks the intersection between a sphere and a ray
 	* @param const ray& r
@@ -654,6 +701,104 @@ namespace cs350 {
 		return classification_t::overlapping;
 	}
 
+	/**
+	* @brief splits a triangle by a plane (Sutherland-Hodgman), triangulating each side
+	* @param const triangle& t
+	* @param const plane& plane
+	* @param std::vector<triangle>& positive, pieces on the side the normal points to
+	* @param std::vector<triangle>& negative, pieces on the other side
+	* @return
+	*/
+	void split_triangle(const triangle& t, const plane& plane, std::vector<triangle>& positive, std::vector<triangle>& negative)
+	{
+		//a triangle clipped by a plane has at most four vertices per side
+		glm::vec3 front[4];
+		glm::vec3 back[4];
+		int frontCount = 0;
+		int backCount = 0;
+
+		//signed distances to the plane
+		float distances[3];
+		for (int i = 0; i < 3; i++)
+			distances[i] = glm::dot(t[i] - plane.mPosition, plane.mNormal);
+
+		//whether each side has a vertex strictly on it
+		bool anyFront = false;
+		bool anyBack = false;
+
+		//walking the edges, a to b
+		for (int i = 0; i < 3; i++)
+		{
+			int j = (i + 1) % 3;
+			const glm::vec3& a = t[i];
+			const glm::vec3& b = t[j];
+			float da = distances[i];
+			float db = distances[j];
+
+			if (db > cEpsilon)//b in front
+			{
+				//crossing from behind, the intersection goes to both sides
+				if (da < -cEpsilon)
+				{
+					glm::vec3 p = a + (b - a) * (da / (da - db));
+					front[frontCount++] = p;
+					back[backCount++] = p;
+				}
+
+				front[frontCount++] = b;
+				anyFront = true;
+			}
+			else if (db < -cEpsilon)//b behind
+			{
+				//crossing from the front, the intersection goes to both sides
+				if (da > cEpsilon)
+				{
+					glm::vec3 p = a + (b - a) * (da / (da - db));
+					front[frontCount++] = p;
+					back[backCount++] = p;
+				}
+
+				back[backCount++] = b;
+				anyBack = true;
+			}
+			else//b on the plane
+			{
+				front[frontCount++] = b;
+				back[backCount++] = b;
+			}
+		}
+
+		//coplanar triangles are kept on the positive side
+		if (!anyFront && !anyBack)
+		{
+			positive.push_back(t);
+			return;
+		}
+
+		//fan triangulation of each side that has something on it
+		if (anyFront)
+			for (int i = 1; i + 1 < frontCount; i++)
+				positive.push_back(triangle(front[0], front[i], front[i + 1]));
+
+		if (anyBack)
+			for (int i = 1; i + 1 < backCount; i++)
+				negative.push_back(triangle(back[0], back[i], back[i + 1]));
+	}
+
+	/**
+	* @brief prints the vertices of a triangle
+	* @param std::ostream& os
+	* @param const triangle& t
+	* @return std::ostream&
+	*/
+	std::ostream& operator<<(std::ostream& os, const triangle& t)
+	{
+		for (int i = 0; i < 3; i++)
+			os << "(" << t[i].x << ", " << t[i].y << ", " << t[i].z << ")" << (i < 2 ? " " : "");
+
+		return os;
+	}
+
 	/**
 	* @brief classifies if a aabb is inside, outside or overlapping a plane
 	* @param const plane& plane
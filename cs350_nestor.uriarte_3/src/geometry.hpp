@@ -11,6 +11,8 @@
 
 #pragma once
 #include <array>
+#include <iosfwd>
+#include <vector>
 #include "math.hpp"
 
 namespace cs350 {
@@ -78,6 +80,8 @@ namespace cs350 {
     };
 
     classification_t classify_plane_triangle(const plane& plane, const triangle& t, const float thickness);
+    void split_triangle(const triangle& t, const plane& plane, std::vector<triangle>& positive, std::vector<triangle>& negative);
+    std::ostream& operator<<(std::ostream& os, const triangle& t);
 
     struct aabb
     {
@@ -126,6 +130,7 @@ namespace cs350 {
 
     float intersection_ray_plane(const ray& r, const plane& p);
     float intersection_ray_aabb(const ray& r, const aabb& a);
+    bool clip_ray_aabb(const ray& r, const aabb& a, float& tMin, float& tMax);
     float intersection_ray_sphere(const ray& r, const sphere& s);
     float intersection_ray_triangle(const ray& r, const triangle& t);
 
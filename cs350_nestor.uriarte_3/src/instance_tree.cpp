@@ -0,0 +1,91 @@
+/**
+* @file		 instance_tree.cpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the implementation of the instance_tree
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#include <algorithm>
+#include "instance_tree.hpp"
+
+namespace cs350 {
+
+/**
+* @brief	builds the tree over the bounds of the instances, the root is the first node
+* @param	std::vector<aabb> const& bounds
+* @return		void
+**/
+	void instance_tree::build(std::vector<aabb> const& bounds)
+	{
+		m_nodes.clear();
+		m_items.resize(bounds.size());
+		for (unsigned i = 0; i < m_items.size(); i++)
+			m_items[i] = i;
+
+		if (bounds.empty())
+			return;
+
+		//a tree with n leaves has 2n - 1 nodes
+		m_nodes.reserve(2 * (bounds.size() / c_leaf_size + 1));
+		m_nodes.push_back(node());
+		build_node(0, bounds, 0, static_cast<unsigned>(bounds.size()));
+	}
+
+/**
+* @brief	fills a node with the given items, splitting it at the median of the longest axis of their centers
+* @param	unsigned index
+* @param	std::vector<aabb> const& bounds
+* @param	unsigned first, in m_items
+* @param	unsigned count
+* @return		void
+**/
+	void instance_tree::build_node(unsigned index, std::vector<aabb> const& bounds, unsigned first, unsigned count)
+	{
+		//bounds of the items and of their centers
+		aabb box = bounds[m_items[first]];
+		glm::vec3 centerMin = (box.mMin + box.mMax) * 0.5F;
+		glm::vec3 centerMax = centerMin;
+		for (unsigned i = first; i < first + count; i++)
+		{
+			aabb const& b = bounds[m_items[i]];
+			box.mMin = glm::min(box.mMin, b.mMin);
+			box.mMax = glm::max(box.mMax, b.mMax);
+
+			glm::vec3 center = (b.mMin + b.mMax) * 0.5F;
+			centerMin = glm::min(centerMin, center);
+			centerMax = glm::max(centerMax, center);
+		}
+		m_nodes[index].bounds = box;
+
+		if (count <= c_leaf_size)
+		{
+			m_nodes[index].first = first;
+			m_nodes[index].count = count;
+			return;
+		}
+
+		//the axis along which the centers spread the most
+		glm::vec3 extent = centerMax - centerMin;
+		int axis = 0;
+		if (extent[1] > extent[axis])
+			axis = 1;
+		if (extent[2] > extent[axis])
+			axis = 2;
+
+		unsigned half = count / 2;
+		auto begin = m_items.begin() + first;
+		std::nth_element(begin, begin + half, begin + count, [&](unsigned a, unsigned b) {
+			return bounds[a].mMin[axis] + bounds[a].mMax[axis] < bounds[b].mMin[axis] + bounds[b].mMax[axis];
+		});
+
+		//both children next to each other
+		unsigned left = static_cast<unsigned>(m_nodes.size());
+		m_nodes.push_back(node());
+		m_nodes.push_back(node());
+		m_nodes[index].first = left;
+		m_nodes[index].count = 0;
+
+		build_node(left, bounds, first, half);
+		build_node(left + 1, bounds, first + half, count - half);
+	}
+}
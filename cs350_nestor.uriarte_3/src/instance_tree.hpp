@@ -0,0 +1,151 @@
+/**
+* @file		 instance_tree.hpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the definition of the instance_tree, the top level of the two level acceleration structure
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#pragma once
+#include <vector>
+#include "geometry.hpp"
+
+namespace cs350 {
+
+    /**
+     * Bounding volume hierarchy over the world bounds of the mesh instances of a scene. Each instance is
+     * traced on the kdtree of its mesh, so this level only has to find which instances a ray may hit.
+     * Nodes are split at the median instance of their longest axis, and the traversal visits the nearest
+     * child first, skipping nodes that start past the closest hit found so far.
+     */
+    class instance_tree
+    {
+      public:
+        // Instances per leaf
+        static constexpr unsigned c_leaf_size = 2;
+        // Bound of the depth (median splits, more than enough for any instance count)
+        static constexpr int c_max_depth = 64;
+
+        struct node
+        {
+            aabb     bounds;
+            unsigned first; // Left child (the right one follows it), or first item of the leaf
+            unsigned count; // Instances of the leaf, 0 on internal nodes
+
+            [[nodiscard]] bool is_leaf() const noexcept { return count != 0; }
+        };
+
+        /**
+         * Builds the tree
+         * @param bounds, world bounds of every instance
+         */
+        void build(std::vector<aabb> const& bounds);
+
+        /**
+         * Closest hit of the instances along a ray
+         * @param r
+         * @param max_t, hits past it are ignored
+         * @param intersect, float(unsigned instance, float max_t) traces an instance, returning the time of its hit or -1
+         * @return float, the time of the closest hit or -1
+         */
+        template <typename F>
+        float closest(ray const& r, float max_t, F const& intersect) const;
+
+        /**
+         * Whether any instance is hit
+         * @param r
+         * @param max_t
+         * @param occluded, bool(unsigned instance) traces an instance up to max_t
+         * @return bool
+         */
+        template <typename F>
+        bool any(ray const& r, float max_t, F const& occluded) const;
+
+        [[nodiscard]] std::vector<node> const&     nodes() const noexcept { return m_nodes; }
+        [[nodiscard]] std::vector<unsigned> const& items() const noexcept { return m_items; }
+
+      private:
+        void build_node(unsigned index, std::vector<aabb> const& bounds, unsigned first, unsigned count);
+
+        std::vector<node>     m_nodes;
+        // Instances, in leaf order
+        std::vector<unsigned> m_items;
+    };
+
+    template <typename F>
+    float instance_tree::closest(ray const& r, float max_t, F const& intersect) const
+    {
+        float best = max_t;
+        bool  hit  = false;
+
+        unsigned stack[c_max_depth];
+        int      top = 0;
+        if (!m_nodes.empty())
+            stack[top++] = 0;
+
+        while (top != 0) {
+            node const& n = m_nodes[stack[--top]];
+
+            float t_min = 0.0f;
+            float t_max = 0.0f;
+            if (!clip_ray_aabb(r, n.bounds, t_min, t_max) || t_min > best)
+                continue;
+
+            if (n.is_leaf()) {
+                for (unsigned i = n.first; i < n.first + n.count; ++i) {
+                    float t = intersect(m_items[i], best);
+                    if (t >= 0.0f && t <= best) {
+                        best = t;
+                        hit  = true;
+                    }
+                }
+                continue;
+            }
+
+            // Nearest child on top of the stack
+            float left_min = 0.0f, right_min = 0.0f, ignored = 0.0f;
+            bool  left  = clip_ray_aabb(r, m_nodes[n.first].bounds, left_min, ignored);
+            bool  right = clip_ray_aabb(r, m_nodes[n.first + 1].bounds, right_min, ignored);
+            if (left && right && left_min <= right_min) {
+                stack[top++] = n.first + 1;
+                stack[top++] = n.first;
+            } else {
+                if (left)
+                    stack[top++] = n.first;
+                if (right)
+                    stack[top++] = n.first + 1;
+            }
+        }
+
+        return hit ? best : -1.0f;
+    }
+
+    template <typename F>
+    bool instance_tree::any(ray const& r, float max_t, F const& occluded) const
+    {
+        unsigned stack[c_max_depth];
+        int      top = 0;
+        if (!m_nodes.empty())
+            stack[top++] = 0;
+
+        while (top != 0) {
+            node const& n = m_nodes[stack[--top]];
+
+            float t_min = 0.0f;
+            float t_max = 0.0f;
+            if (!clip_ray_aabb(r, n.bounds, t_min, t_max) || t_min > max_t)
+                continue;
+
+            if (!n.is_leaf()) {
+                stack[top++] = n.first + 1;
+                stack[top++] = n.first;
+                continue;
+            }
+
+            for (unsigned i = n.first; i < n.first + n.count; ++i)
+                if (occluded(m_items[i]))
+                    return true;
+        }
+
+        return false;
+    }
+}
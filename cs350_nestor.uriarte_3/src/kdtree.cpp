@@ -5,14 +5,29 @@
 * @brief	 This file contains the implementation of the KDTree class     
 * @copyright Copyright (C) 2020 DigiPen Institute of Technology .
 */
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <cmath>
+#include <cstring>
+#include <fstream>
 #include <iomanip>
 #include <functional>
+#include <future>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include "kdtree.hpp"
+#include "mapped_file.hpp"
 #include "scene_data.hpp"
 
+//runs a statement counting on the stats of a query, when there are stats to count on
+#if CS350_KDTREE_STATS
+#define KDTREE_STAT(statement) do { if (stats != nullptr) { statement; } } while (false)
+#else
+#define KDTREE_STAT(statement) do { } while (false)
+#endif
+
 namespace cs350 {
 
 /**
@@ -97,14 +112,14 @@ namespace cs350 {
 	int kdtree::node::primitive_start() const noexcept { return m_start_primitive; }
 
 /**
-* @brief	gets the right node of a internal one
+* @brief	gets the children of a internal one (the left one, the right one is next to it)
 * @return		int
 **/
 	int kdtree::node::next_child() const noexcept
 	{
-		//remove the last 2 bits and return count
-		int rightNode = m_subnode_index >> 2;
-		return rightNode;
+		//remove the last 2 bits and return the index
+		int childNode = m_subnode_index >> 2;
+		return childNode;
 	}
 
 /**
@@ -126,107 +141,578 @@ namespace cs350 {
 	}
 
 /**
-* @brief	wrapper to call the recursive build
+* @brief	copy constructor, copying the state added over the baseline tree along
+* @param	kdtree const& rhs
+**/
+	kdtree::kdtree(kdtree const& rhs)
+		: m_indices(rhs.m_indices), m_nodes(rhs.m_nodes),
+		m_data(rhs.m_data ? std::make_unique<tree_data>(*rhs.m_data) : nullptr),
+		m_triangles(rhs.m_triangles),
+		m_cfg(rhs.m_cfg)
+	{
+	}
+
+/**
+* @brief	copy constructor of the extension, the scratch memory is left out
+* @param	tree_data const& rhs
+**/
+	kdtree::tree_data::tree_data(tree_data const& rhs)
+		: leaf_offsets(rhs.leaf_offsets), leaf_positions(rhs.leaf_positions), bounds(rhs.bounds), leaf_triangles(rhs.leaf_triangles), input_hash(rhs.input_hash), build(rhs.build), parallel_depth(rhs.parallel_depth)
+	{
+	}
+
+/**
+* @brief	copy assignment
+* @param	kdtree const& rhs
+* @return		kdtree&
+**/
+	kdtree& kdtree::operator=(kdtree const& rhs)
+	{
+		//copying first, so this one is left as it was if it throws
+		if (this != &rhs)
+			*this = kdtree(rhs);
+
+		return *this;
+	}
+
+/**
+* @brief	gets the state added over the baseline tree, creating it the first time
+* @return		kdtree::tree_data&
+**/
+	kdtree::tree_data& kdtree::data()
+	{
+		if (!m_data)
+			m_data = std::make_unique<tree_data>();
+
+		return *m_data;
+	}
+
+/**
+* @brief	gets the state added over the baseline tree, an empty one if it was never created
+* @return		kdtree::tree_data const&
+**/
+	kdtree::tree_data const& kdtree::data() const noexcept
+	{
+		static tree_data const empty{};
+		return m_data ? *m_data : empty;
+	}
+
+/**
+* @brief	copies the geometry out of the scene triangles
+* @param	triangle_container const& all_triangles
+* @return		position_container
+**/
+	kdtree::position_container kdtree::positions_of(triangle_container const& all_triangles)
+	{
+		position_container positions;
+		positions.reserve(all_triangles.size());
+		for (auto const& it : all_triangles)
+			positions.push_back(it.geometry);
+		return positions;
+	}
+
+/**
+* @brief	builds from the geometry of the scene triangles
 * @param	triangle_container const& all_triangles
 * @param	const config& cfg
 * @return		void
 **/
 	void kdtree::build(triangle_container const& all_triangles, const config& cfg)
 	{
-		//setting the config
+		build(positions_of(all_triangles), cfg);
+	}
+
+/**
+* @brief	wrapper to call the recursive build
+* @param	position_container const& positions
+* @param	const config& cfg
+* @return		void
+**/
+	void kdtree::build(position_container const& positions, const config& cfg)
+	{
+		//setting the config, the depth is bounded by the traversal stack
 		m_cfg = cfg;
+		m_cfg.max_depth = std::min(m_cfg.max_depth, c_max_depth - 1);
+
+		//forking while there are idle cores, each level doubles the tasks
+		tree_data& ext = data();
+		unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+		ext.parallel_depth = 0;
+		while ((1u << ext.parallel_depth) < cores * 2)
+			ext.parallel_depth++;
+
+		//identifying the input, so saved trees can be checked against it
+		ext.input_hash = hash_input(positions);
+
+		//throwing away any previous build, its arrays are reused
+		size_t trianglesCapacity = m_triangles.capacity();
+		size_t nodesCapacity = m_nodes.capacity();
+		size_t leafCapacity = ext.leaf_triangles.capacity();
+		m_triangles.clear();
+		ext.leaf_offsets.clear();
+		ext.leaf_positions.clear();
+		m_triangles.reserve(positions.size());
 
 		//pushing back the triangles
-		for (unsigned i = 0; i < all_triangles.size(); i++)
-			m_triangles.push_back({ all_triangles[i].geometry, i });
+		for (unsigned i = 0; i < positions.size(); i++)
+			m_triangles.push_back({ positions[i], i });
+
+		//the scratch memory of the previous builds is sized once for the whole build
+		build_context context;
+		context.scratch = std::move(ext.scratch);
+		size_t scratchAllocations = context.scratch.allocations();
+		arena::marker start = context.scratch.get_marker();
+		context.scratch.reserve(scratch_estimate(m_triangles.size()));
+
+		//the root references every triangle, with its bounds computed once
+		int count = static_cast<int>(m_triangles.size());
+		build_ref* refs = context.scratch.allocate<build_ref>(count);
+		for (int i = 0; i < count; i++)
+			refs[i] = { static_cast<unsigned>(i), computeBV(m_triangles[i]) };
+
+		//calling to build the tree, the root voxel bounds every triangle
+		ext.bounds = computeBV(refs, count);
+		build_tree(refs, count, ext.bounds, 0, context);
+
+		//the whole tree ends up in the flat arrays, the nodes reordered for the traversal
+		relayout_nodes(context.out.nodes);
+		m_indices = std::move(context.out.indices);
+
+		//the leaf triangles are laid out once in leaf order, ready to be intersected
+		build_leaf_triangles();
+
+		//the triangles, reordered nodes and leaf triangles arrays when they grew, plus everything the tasks requested
+		ext.build.scratch_allocations = context.scratch.allocations() - scratchAllocations;
+		ext.build.allocations = (m_triangles.capacity() != trianglesCapacity) + (m_nodes.capacity() != nodesCapacity) +
+								(ext.leaf_triangles.capacity() != leafCapacity) + context.allocations + ext.build.scratch_allocations;
+		ext.build.memory_upper_bound = m_triangles.capacity() * sizeof(triangle_wrapper) +
+									   context.scratch.capacity() + context.scratch_peak +
+									   (context.out.nodes.capacity() + m_nodes.capacity()) * sizeof(node) + m_indices.capacity() * sizeof(size_t) +
+									   ext.leaf_triangles.capacity() * sizeof(float);
+
+		//keeping the scratch memory for the next build
+		context.scratch.rewind(start);
+		ext.scratch = std::move(context.scratch);
+	}
+
+/**
+* @brief	copies the triangles referenced by the leaves, in the same order, with the data the intersection needs
+* @return		void
+**/
+	void kdtree::build_leaf_triangles()
+	{
+		size_t count = m_indices.size();
+
+		//one block, each component contiguous
+		std::vector<float>& leaf = data().leaf_triangles;
+		leaf.assign(count * c_leaf_components, 0.0F);
+		float* v0 = leaf.data();
+		float* e1 = v0 + count * 3;
+		float* e2 = v0 + count * 6;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			triangle const& tri = m_triangles[m_indices[i]].tri;
+
+			//first vertex and the two edges leaving it
+			for (int k = 0; k < 3; k++)
+			{
+				v0[k * count + i] = tri.mV0[k];
+				e1[k * count + i] = tri.mV1[k] - tri.mV0[k];
+				e2[k * count + i] = tri.mV2[k] - tri.mV0[k];
+			}
+		}
+	}
+
+/**
+* @brief	removes triangles from the leaves by collapsing their copies, the determinant of a collapsed triangle is 0 so it is always missed
+* @param	size_t first
+* @param	size_t count
+* @return		size_t
+**/
+	size_t kdtree::remove_triangles(size_t first, size_t count)
+	{
+		size_t total = m_indices.size();
+		if (total == 0 || first >= m_triangles.size())
+			return 0;
+		count = std::min(count, m_triangles.size() - first);
+
+		//counting sort of the leaf positions by triangle, done once
+		tree_data& ext = data();
+		if (ext.leaf_offsets.size() != m_triangles.size() + 1)
+		{
+			ext.leaf_offsets.assign(m_triangles.size() + 1, 0);
+			for (size_t index : m_indices)
+				ext.leaf_offsets[index + 1]++;
+			for (size_t i = 1; i < ext.leaf_offsets.size(); i++)
+				ext.leaf_offsets[i] += ext.leaf_offsets[i - 1];
+
+			ext.leaf_positions.resize(total);
+			std::vector<size_t> next(ext.leaf_offsets.begin(), ext.leaf_offsets.end() - 1);
+			for (size_t i = 0; i < total; i++)
+				ext.leaf_positions[next[m_indices[i]]++] = i;
+		}
 
-		//calling to build the tree
-		build_tree(m_triangles, 0);
+		//the edges are zeroed, the first vertex is kept
+		float* e1 = ext.leaf_triangles.data() + total * 3;
+		float* e2 = ext.leaf_triangles.data() + total * 6;
+		size_t removed = 0;
+		for (size_t p = ext.leaf_offsets[first]; p < ext.leaf_offsets[first + count]; p++, removed++)
+		{
+			size_t i = ext.leaf_positions[p];
+			for (int k = 0; k < 3; k++)
+			{
+				e1[k * total + i] = 0.0F;
+				e2[k * total + i] = 0.0F;
+			}
+		}
+
+		//no longer the tree of its input, saving it would not be loaded back
+		ext.input_hash = 0;
+
+		return removed;
+	}
+
+/**
+* @brief	intersects a ray with a leaf triangle (Moller-Trumbore), both faces count
+* @param	ray const& r
+* @param	size_t k, position of the triangle in the leaf order
+* @return		float, the time of the intersection or -1 if it misses
+**/
+	float kdtree::intersect_leaf_triangle(ray const& r, size_t k) const
+	{
+		size_t count = m_indices.size();
+		float const* leaf = data().leaf_triangles.data() + k;
+
+		//loading the triangle
+		glm::vec3 v0(leaf[0], leaf[count], leaf[2 * count]);
+		glm::vec3 e1(leaf[3 * count], leaf[4 * count], leaf[5 * count]);
+		glm::vec3 e2(leaf[6 * count], leaf[7 * count], leaf[8 * count]);
+
+		//the determinant is 0 if the ray is parallel to the triangle
+		glm::vec3 p = glm::cross(r.mVec, e2);
+		float det = glm::dot(e1, p);
+		if (det <= cEpsilon && det >= -cEpsilon)
+			return -1.0F;
+
+		float invDet = 1.0F / det;
+
+		//barycentric coordinates of the hit point
+		glm::vec3 s = r.mP - v0;
+		float u = glm::dot(s, p) * invDet;
+		if (u < 0.0F || u > 1.0F)
+			return -1.0F;
+
+		glm::vec3 q = glm::cross(s, e1);
+		float v = glm::dot(r.mVec, q) * invDet;
+		if (v < 0.0F || u + v > 1.0F)
+			return -1.0F;
+
+		//if the time is negative return -1
+		float time = glm::dot(e2, q) * invDet;
+		if (time < 0.0F)
+			return -1.0F;
+
+		return time;
 	}
 
 /**
 * @brief	recursive function that builds the KDTree
-* @param	std::vector<triangle_wrapper> const& triangles
+* @param	build_ref const* refs, triangles inside of the node
+* @param	int count
+* @param	aabb const& voxel
 * @param	int depth
+* @param	build_context& ctx, arrays in which the subtree is appended and scratch memory
 * @return		void
 **/
-	void kdtree::build_tree(std::vector<triangle_wrapper> const& triangles, int depth)
+	void kdtree::build_tree(build_ref const* refs, int count, aabb const& voxel, int depth, build_context& ctx)
 	{
-		//creating the new node
-		node new_node;
+		build_output& out = ctx.out;
 
-		//adding to the vector the node and its bv
-		m_nodes.push_back(new_node);
-		m_aabbs.push_back(computeBV(triangles));
+		//adding to the vector the node
+		ctx.allocations += out.nodes.size() == out.nodes.capacity();
+		out.nodes.push_back(node());
 
 		//getting the nodes index
-		unsigned currIndex = m_nodes.size() - 1;
+		unsigned currIndex = out.nodes.size() - 1;
 
-		//if it does not have a valid depth create a leaf and return
-		if (depth >= m_cfg.max_depth)
+		//if it does not have a valid depth (or a flat voxel) create a leaf and return
+		if (depth >= m_cfg.max_depth || compute_surface(voxel) <= 0.0F)
 		{
-			m_nodes[currIndex].set_leaf(m_indices.size(), triangles.size());
-
-			for (unsigned i = 0; i < triangles.size(); i++)
-				m_indices.push_back(triangles[i].original_index);
-
+			make_leaf(refs, count, currIndex, ctx);
 			return;
 		}
 
-		//getting the partition axis
-		int axis = depth % 3;
+		//everything taken from the scratch memory is released when the node is done
+		arena::marker marker = ctx.scratch.get_marker();
+
+		int axis = 0;
 		float cost = 0.0F;
+		float splitPoint = 0.0F;
+		bool planarLeft = false;
+		bool emptyAllowed = false;
 
-		std::vector<triangle_wrapper> left;
-		std::vector<triangle_wrapper> right;
-		//getting the splitting point
-		float splitPoint = get_split(triangles, axis, &cost);
+		if (m_cfg.method == split_method::sampled)
+		{
+			//getting the partition axis and the splitting point
+			axis = depth % 3;
+			splitPoint = get_split(refs, count, axis, &cost);
+		}
+		else
+		{
+			//getting the best plane on any axis
+			splitPoint = get_split_sweep(refs, count, voxel, depth, ctx.scratch, &axis, &cost, &planarLeft);
+
+			//the sweep cost accounts for empty space, so cutting it off is allowed
+			emptyAllowed = count > 0;
+		}
+
+		//the sweep events are not needed anymore
+		ctx.scratch.rewind(marker);
+
+		//if the cost of making it a leaf is lower create a leaf
+		if (cost_leaf(count) <= cost)
+		{
+			make_leaf(refs, count, currIndex, ctx);
+			return;
+		}
+
+		//each side holds at most every reference
+		build_ref* left = ctx.scratch.allocate<build_ref>(count);
+		build_ref* right = ctx.scratch.allocate<build_ref>(count);
+		int leftCount = 0;
+		int rightCount = 0;
 
 		//performing the splitting on the optimal point
-		split(triangles, left, right, axis, splitPoint);
+		if (m_cfg.method == split_method::sampled)
+			split(refs, count, left, &leftCount, right, &rightCount, axis, splitPoint);
+		else
+			split_sweep(refs, count, left, &leftCount, right, &rightCount, voxel, axis, splitPoint, planarLeft);
 
-		//if the left or the right nodes are empty, or the cost of making it a leaf is lower create a leaf
-		if (cost_leaf(triangles) <= cost || left.empty() || right.empty())
+		//if the left or the right nodes are empty create a leaf
+		if (!emptyAllowed && (leftCount == 0 || rightCount == 0))
 		{
-			//setting it as a leaf
-			m_nodes[currIndex].set_leaf(m_indices.size(), triangles.size());
+			make_leaf(refs, count, currIndex, ctx);
+			ctx.scratch.rewind(marker);
+			return;
+		}
 
-			//adding thew indices
-			for (unsigned i = 0; i < triangles.size(); i++)
-				m_indices.push_back(triangles[i].original_index);
+		//the children voxels are the halves of this one (sampled planes may fall outside of it)
+		aabb leftVoxel = voxel;
+		aabb rightVoxel = voxel;
+		leftVoxel.mMax[axis] = glm::clamp(splitPoint, voxel.mMin[axis], voxel.mMax[axis]);
+		rightVoxel.mMin[axis] = leftVoxel.mMax[axis];
 
+		//big enough subtrees near the root are built at the same time
+		if (parallel_build(count, depth))
+		{
+			//each task gets its own arrays and scratch memory, the references stay in this one
+			build_context leftContext;
+			build_context rightContext;
+			auto leftTask = std::async(std::launch::async, [&]() {
+				leftContext.scratch.reserve(scratch_estimate(leftCount));
+				build_tree(left, leftCount, leftVoxel, depth + 1, leftContext);
+			});
+			rightContext.scratch.reserve(scratch_estimate(rightCount));
+			build_tree(right, rightCount, rightVoxel, depth + 1, rightContext);
+			leftTask.get();
+
+			//joining them in the same order as the sequential build
+			append_subtree(ctx, leftContext.out);
+			out.nodes[currIndex].set_internal(axis, splitPoint, out.nodes.size());
+			append_subtree(ctx, rightContext.out);
+
+			//accumulating what the tasks used
+			for (build_context const* it : { &leftContext, &rightContext })
+			{
+				ctx.allocations += it->allocations + it->scratch.allocations();
+				ctx.scratch_peak += it->scratch.capacity() + it->scratch_peak;
+			}
 		}
 		else
 		{
 			//calling to build the left node
-			build_tree(left, depth + 1);
+			build_tree(left, leftCount, leftVoxel, depth + 1, ctx);
 
 			//setting the node as internal
-			m_nodes[currIndex].set_internal(axis, splitPoint, m_nodes.size());
+			out.nodes[currIndex].set_internal(axis, splitPoint, out.nodes.size());
 
 			//calling to build the right node
-			build_tree(right, depth + 1);
+			build_tree(right, rightCount, rightVoxel, depth + 1, ctx);
+		}
+
+		//releasing the children references
+		ctx.scratch.rewind(marker);
+	}
+
+/**
+* @brief	sets a node as a leaf holding the given triangles
+* @param	build_ref const* refs
+* @param	int count
+* @param	unsigned node_index
+* @param	build_context& ctx
+* @return		void
+**/
+	void kdtree::make_leaf(build_ref const* refs, int count, unsigned node_index, build_context& ctx)
+	{
+		build_output& out = ctx.out;
+
+		//setting it as a leaf
+		out.nodes[node_index].set_leaf(out.indices.size(), count);
+
+		//counting if the indices grow and adding them
+		if (out.indices.size() + count > out.indices.capacity())
+			ctx.allocations++;
+
+		for (int i = 0; i < count; i++)
+			out.indices.push_back(refs[i].triangle);
+	}
+
+/**
+* @brief	checks if a node is worth splitting its work in parallel tasks
+* @param	size_t triangle_count
+* @param	int depth
+* @return		bool
+**/
+	bool kdtree::parallel_build(size_t triangle_count, int depth) const
+	{
+		//disabled, too deep (every core is busy already) or too small to pay the task
+		if (m_cfg.parallel_threshold <= 0 || depth >= data().parallel_depth)
+			return false;
+
+		return triangle_count >= static_cast<size_t>(m_cfg.parallel_threshold);
+	}
+
+/**
+* @brief	scratch memory a build over the given triangles is expected to need
+* @param	size_t count
+* @return		size_t
+**/
+	size_t kdtree::scratch_estimate(size_t count)
+	{
+		//references of the node and its children along a path, plus one axis of events
+		return count * (sizeof(build_ref) * 8 + sizeof(split_event) * 2);
+	}
+
+/**
+* @brief	appends a subtree built on its own arrays, relocating its indices
+* @param	build_context& ctx
+* @param	build_output const& subtree
+* @return		void
+**/
+	void kdtree::append_subtree(build_context& ctx, build_output const& subtree)
+	{
+		build_output& out = ctx.out;
+
+		//where the subtree starts on the destination arrays
+		int nodeOffset = static_cast<int>(out.nodes.size());
+		int indexOffset = static_cast<int>(out.indices.size());
+
+		//making room once
+		ctx.allocations += out.nodes.size() + subtree.nodes.size() > out.nodes.capacity();
+		ctx.allocations += out.indices.size() + subtree.indices.size() > out.indices.capacity();
+		out.nodes.reserve(out.nodes.size() + subtree.nodes.size());
+
+		//relocating every node
+		for (auto it : subtree.nodes)
+		{
+			if (it.is_leaf())
+				it.set_leaf(it.primitive_start() + indexOffset, it.primitive_count());
+			else
+				it.set_internal(it.axis(), it.split(), it.next_child() + nodeOffset);
+
+			out.nodes.push_back(it);
+		}
+
+		out.indices.insert(out.indices.end(), subtree.indices.begin(), subtree.indices.end());
+	}
+
+/**
+* @brief	copies the built nodes in traversal order: the children of a node next to each other,
+*			filling each cache line with the closest descendants of the first pair on it
+* @param	std::vector<node> const& built, with the left child next to its parent (the right one indexed)
+* @return		void
+**/
+	void kdtree::relayout_nodes(std::vector<node> const& built)
+	{
+		m_nodes.clear();
+		if (built.empty())
+			return;
+
+		//children of a placed node, to be placed together
+		struct pending_pair
+		{
+			int left;
+			int right;
+			int parent;
+		};
+
+		auto childrenOf = [&](int builtIndex, int parent) -> pending_pair {
+			return { builtIndex + 1, built[builtIndex].next_child(), parent };
+		};
+
+		//the root has no sibling, an empty leaf takes its place so pairs never cross a line
+		node empty;
+		empty.set_leaf(0, 0);
+		m_nodes.reserve(built.size() + 1);
+		m_nodes.push_back(built[0]);
+		m_nodes.push_back(empty);
+
+		//pairs starting a line of their own, the last one pushed is the next one placed
+		std::vector<pending_pair> pending;
+		if (built[0].is_internal())
+			pending.push_back(childrenOf(0, 0));
+
+		std::vector<pending_pair> line;
+		while (!pending.empty())
+		{
+			line.assign(1, pending.back());
+			pending.pop_back();
+
+			//placing the pair and its descendants breadth first, until the line is full
+			size_t head = 0;
+			do
+			{
+				pending_pair curr = line[head++];
+				int slot = static_cast<int>(m_nodes.size());
+
+				node& parent = m_nodes[curr.parent];
+				parent.set_internal(parent.axis(), parent.split(), slot);
+
+				m_nodes.push_back(built[curr.left]);
+				m_nodes.push_back(built[curr.right]);
+
+				if (built[curr.left].is_internal())
+					line.push_back(childrenOf(curr.left, slot));
+				if (built[curr.right].is_internal())
+					line.push_back(childrenOf(curr.right, slot + 1));
+			} while (head < line.size() && m_nodes.size() % c_nodes_per_line != 0);
+
+			//the ones that did not fit, keeping the breadth first order
+			for (size_t i = line.size(); i > head; i--)
+				pending.push_back(line[i - 1]);
 		}
+
+		assert(m_nodes.size() == built.size() + 1);
 	}
 
 /**
 * @brief	gets the splitting point based on heuristics
-* @param	std::vector<triangle_wrapper> const& triangles
+* @param	build_ref const* refs
+* @param	int count
 * @param	int axis
 * @param	float* min_cost
-* @param	std::vector<triangle_wrapper>& left
-* @param	std::vector<triangle_wrapper>& right
 * @return		float
 **/
-	float kdtree::get_split(std::vector<triangle_wrapper> const& triangles, int axis, float* min_cost)
+	float kdtree::get_split(build_ref const* refs, int count, int axis, float* min_cost)
 	{
 		float min = std::numeric_limits<float>::max();
 		float splitPoint = 0.0F;
 
-		aabb parentBV= computeBV(triangles);
+		aabb parentBV= computeBV(refs, count);
 		float parentSurface = compute_surface(parentBV);
 		
-		const unsigned samples = 10;
+		const unsigned samples = m_cfg.split_samples;
 		const float step = (parentBV.mMax[axis] - parentBV.mMin[axis]) / static_cast<float>(samples);
 
 		//for each triangle
@@ -238,7 +724,7 @@ namespace cs350 {
 			int rightCount = 0;
 
 			//splitting the triangles
-			split(triangles, &leftCount, &rightCount, axis, tempSplit);
+			split(refs, count, &leftCount, &rightCount, axis, tempSplit);
 
 			//computing the aabb to have the surface and be able to use the heuristic formula
 			glm::vec3 limitLeft = parentBV.mMax;
@@ -271,15 +757,16 @@ namespace cs350 {
 	}
 
 /**
-* @brief	splits the tiangles into left and right based on their position
-* @param	std::vector<triangle_wrapper> const& triangles
+* @brief	counts the tiangles at the left and right based on their position
+* @param	build_ref const* refs
+* @param	int count
 * @param	int* left
 * @param	int* right
 * @param	int axis
 * @param	float splitPoint
 * @return		void
 **/
-	void kdtree::split(std::vector<triangle_wrapper> const& triangles, int* left, int* right, int axis, float splitPoint)
+	void kdtree::split(build_ref const* refs, int count, int* left, int* right, int axis, float splitPoint)
 	{
 		//creating the plane
 		glm::vec3 planePos{};
@@ -288,13 +775,13 @@ namespace cs350 {
 		planePos[axis] = splitPoint;
 		planeNormal[axis] = 1.0F;
 
-		//the burning plane at a thousand degrees that will be used to split
+		//the burning plane at a thousand degrees that will be used to split
 		plane bpatd(planePos, planeNormal);
 
-		for (auto& it : triangles)
+		for (int i = 0; i < count; i++)
 		{
 			//getting the classification based on the plane
-			classification_t result = classify_plane_triangle(bpatd, it.tri, cEpsilon);
+			classification_t result = classify_plane_triangle(bpatd, m_triangles[refs[i].triangle].tri, cEpsilon);
 
 			//if is inside increment left
 			if (result == classification_t::inside)
@@ -309,27 +796,19 @@ namespace cs350 {
 		}
 	}
 
-/**
-* @brief	computes the cost of making it a leaf node
-* @param	std::vector<triangle_wrapper> const& triangles
-* @return		int
-**/
-	int kdtree::cost_leaf(std::vector<triangle_wrapper> const& triangles)
-	{
-		//returning the result of the heuristics formula
-		return m_cfg.cost_intersection * triangles.size();
-	}
-
 /**
 * @brief	splits the tiangles into left and right based on their position
-* @param	std::vector<triangle_wrapper> const& triangles
-* @param	std::vector<triangle_wrapper>& left
-* @param	std::vector<triangle_wrapper>& right
+* @param	build_ref const* refs
+* @param	int count
+* @param	build_ref* left
+* @param	int* left_count
+* @param	build_ref* right
+* @param	int* right_count
 * @param	int axis
 * @param	float splitPoint
 * @return		void
 **/
-	void kdtree::split(std::vector<triangle_wrapper> const& triangles, std::vector<triangle_wrapper>& left, std::vector<triangle_wrapper>& right, int axis, float splitPoint)
+	void kdtree::split(build_ref const* refs, int count, build_ref* left, int* left_count, build_ref* right, int* right_count, int axis, float splitPoint)
 	{
 		//creating the plane
 		glm::vec3 planePos{};
@@ -338,118 +817,435 @@ namespace cs350 {
 		planePos[axis] = splitPoint;
 		planeNormal[axis] = 1.0F;
 
-		//the burning plane at a thousand degrees that will be used to split
+		//the burning plane at a thousand degrees that will be used to split
 		plane bpatd(planePos, planeNormal);
 
 		//for each triangle
-		for (auto& it : triangles)
+		for (int i = 0; i < count; i++)
 		{
 			//getting the classification based on the plane
-			classification_t result = classify_plane_triangle(bpatd, it.tri, cEpsilon);
+			classification_t result = classify_plane_triangle(bpatd, m_triangles[refs[i].triangle].tri, cEpsilon);
 
 			//if is inside push to the left
 			if (result == classification_t::inside)
 			{
-				left.push_back(it);
+				left[(*left_count)++] = refs[i];
 			}
 			else if (result == classification_t::outside)//if is out push to right
 			{
-				right.push_back(it);
+				right[(*right_count)++] = refs[i];
 			}
 			else//if overlaps push to both
 			{
-				right.push_back(it);
-				left.push_back(it);
+				right[(*right_count)++] = refs[i];
+				left[(*left_count)++] = refs[i];
 			}
 		}
 	}
 
 /**
-* @brief	Computes the bv of a triangle
-* @param	triangle_wrapper const& triangle
-* @return		aabb
+* @brief	gets the splitting plane with the lowest SAH cost on any axis sweeping the triangle bounds
+* @param	build_ref const* refs
+* @param	int count
+* @param	aabb const& voxel
+* @param	int depth
+* @param	arena& scratch, memory for the events (released by the caller)
+* @param	int* axis
+* @param	float* min_cost
+* @param	bool* planar_left, side in which the triangles lying on the plane go
+* @return		float
 **/
-	aabb kdtree::computeBV(triangle_wrapper const& triangle)
+	float kdtree::get_split_sweep(build_ref const* refs, int count, aabb const& voxel, int depth, arena& scratch, int* axis, float* min_cost, bool* planar_left)
 	{
-		//aabb which will contain the values
-		aabb bounding;
-
-		//floats to store the min and max values
-		float mins[3] = { std::numeric_limits<float>::max(),
-						  std::numeric_limits<float>::max(),
-						  std::numeric_limits<float>::max() };
-
-		float maxs[3] = { -std::numeric_limits<float>::max(),
-						  -std::numeric_limits<float>::max(),
-						  -std::numeric_limits<float>::max() };
+		//best plane of each axis
+		float splits[3] = {};
+		float costs[3] = {};
+		bool planars[3] = {};
 
-		//go throught the vector and get the lowest and highest x, y, z values
-		for (int i = 0; i < 3; i++)
+		//big nodes near the root sweep the three axis at the same time, each one on its own events
+		if (parallel_build(count, depth))
 		{
-			for (int j = 0; j < 3; j++)
-			{
-				if (triangle[i][j] <= mins[j])
-					mins[j] = triangle[i][j];
-
-				if (triangle[i][j] >= maxs[j])
-					maxs[j] = triangle[i][j];
-			}
+			split_event* events[3];
+			for (int k = 0; k < 3; k++)
+				events[k] = scratch.allocate<split_event>(2 * count);
+
+			auto sweepY = std::async(std::launch::async, [&]() { splits[1] = sweep_axis(refs, count, voxel, 1, events[1], &costs[1], &planars[1]); });
+			auto sweepZ = std::async(std::launch::async, [&]() { splits[2] = sweep_axis(refs, count, voxel, 2, events[2], &costs[2], &planars[2]); });
+			splits[0] = sweep_axis(refs, count, voxel, 0, events[0], &costs[0], &planars[0]);
+			sweepY.get();
+			sweepZ.get();
+		}
+		else
+		{
+			split_event* events = scratch.allocate<split_event>(2 * count);
+			for (int k = 0; k < 3; k++)
+				splits[k] = sweep_axis(refs, count, voxel, k, events, &costs[k], &planars[k]);
 		}
 
-		//setting the points
-		bounding.mMin = glm::vec3(mins[0], mins[1], mins[2]);
-		bounding.mMax = glm::vec3(maxs[0], maxs[1], maxs[2]);
+		//keeping the cheapest one (the first axis wins ties)
+		int best = 0;
+		for (int k = 1; k < 3; k++)
+			if (costs[k] < costs[best])
+				best = k;
 
-		return bounding;
+		*axis = best;
+		*min_cost = costs[best];
+		*planar_left = planars[best];
+
+		//returning the splitting point
+		return splits[best];
 	}
 
 /**
-* @brief	Computes the bv of a vector of triangles
-* @param	std::vector<triangle_wrapper> const& triangles
-* @return		aabb
+* @brief	sweeps the triangle bounds on one axis getting the plane with the lowest SAH cost
+* @param	build_ref const* refs
+* @param	int count
+* @param	aabb const& voxel
+* @param	int k, the axis
+* @param	split_event* events, room for two events per triangle
+* @param	float* min_cost
+* @param	bool* planar_left, side in which the triangles lying on the plane go
+* @return		float
 **/
-	aabb kdtree::computeBV(std::vector<triangle_wrapper> const& triangles)
+	float kdtree::sweep_axis(build_ref const* refs, int count, aabb const& voxel, int k, split_event* events, float* min_cost, bool* planar_left)
 	{
-		//aabb which will contain the values
-		aabb bounding;
+		float min = std::numeric_limits<float>::max();
+		float splitPoint = 0.0F;
+		*min_cost = min;
+		*planar_left = false;
 
-		//floats to store the min and max values
-		float mins[3] = { std::numeric_limits<float>::max(),
-						  std::numeric_limits<float>::max(),
-						  std::numeric_limits<float>::max() };
+		float parentSurface = compute_surface(voxel);
 
-		float maxs[3] = { -std::numeric_limits<float>::max(),
-						  -std::numeric_limits<float>::max(),
-						  -std::numeric_limits<float>::max() };
+		//getting the bounds of every triangle as events
+		size_t eventCount = 0;
+		for (int i = 0; i < count; i++)
+		{
+			aabb bounds = computeBV(refs[i], voxel);
 
-		//go throught the vector and get the lowest and highest x, y, z values
-		for (unsigned i = 0; i < triangles.size(); i++)
+			if (bounds.mMin[k] == bounds.mMax[k])
+				events[eventCount++] = { bounds.mMin[k], split_event::planar };
+			else
+			{
+				events[eventCount++] = { bounds.mMin[k], split_event::start };
+				events[eventCount++] = { bounds.mMax[k], split_event::end };
+			}
+		}
+
+		//sorting them by position once
+		std::sort(events, events + eventCount);
+
+		//at first every triangle is at the right of the plane
+		int leftCount = 0;
+		int planarCount = 0;
+		int rightCount = count;
+
+		//evaluating every candidate plane in one pass
+		for (size_t i = 0; i < eventCount;)
 		{
-			for (int j = 0; j < 3; j++)
+			float position = events[i].position;
+
+			//counting the events on this plane
+			int ends = 0;
+			int planars = 0;
+			int starts = 0;
+
+			while (i < eventCount && events[i].position == position && events[i].type == split_event::end)
 			{
-				for (int k = 0; k < 3; k++)
-				{
-					if (triangles[i][j][k] <= mins[k])
-						mins[k] = triangles[i][j][k];
+				ends++;
+				i++;
+			}
+			while (i < eventCount && events[i].position == position && events[i].type == split_event::planar)
+			{
+				planars++;
+				i++;
+			}
+			while (i < eventCount && events[i].position == position && events[i].type == split_event::start)
+			{
+				starts++;
+				i++;
+			}
+
+			//triangles ending or lying on the plane are no longer on the right
+			planarCount = planars;
+			rightCount -= planars + ends;
+
+			//planes on the border of the voxel do not split anything
+			if (position > voxel.mMin[k] && position < voxel.mMax[k])
+			{
+				//computing the aabb to have the surface and be able to use the heuristic formula
+				glm::vec3 limitLeft = voxel.mMax;
+				glm::vec3 limitRight = voxel.mMin;
+
+				limitLeft[k] = position;
+				limitRight[k] = position;
+
+				aabb leftBV(voxel.mMin, limitLeft);
+				aabb rightBV(limitRight, voxel.mMax);
+
+				//computing the probability based on surface areas
+				float surfaceLeft = compute_surface(leftBV) / parentSurface;
+				float surfaceRight = compute_surface(rightBV) / parentSurface;
+
+				//trying the planar triangles on both sides
+				float costLeft = cost_intersect(surfaceLeft, leftCount + planarCount, surfaceRight, rightCount);
+				float costRight = cost_intersect(surfaceLeft, leftCount, surfaceRight, rightCount + planarCount);
 
-					if (triangles[i][j][k] >= maxs[k])
-						maxs[k] = triangles[i][j][k];
+				//if the cost is lower update the values
+				if (costLeft < min)
+				{
+					min = costLeft;
+					splitPoint = position;
+					*min_cost = costLeft;
+					*planar_left = true;
+				}
+				if (costRight < min)
+				{
+					min = costRight;
+					splitPoint = position;
+					*min_cost = costRight;
+					*planar_left = false;
 				}
 			}
 
+			//triangles starting or lying on the plane are on the left for the next ones
+			leftCount += starts + planars;
+			planarCount = 0;
 		}
 
-		//setting the points
-		bounding.mMin = glm::vec3(mins[0], mins[1], mins[2]);
-		bounding.mMax = glm::vec3(maxs[0], maxs[1], maxs[2]);
-
-		return bounding;
+		//returning the splitting point
+		return splitPoint;
 	}
 
 /**
-* @brief	computes the surface area of a bv
-* @param	const aabb& bv
-* @return		float
+* @brief	splits the triangles into left and right using their bounds inside of the voxel
+* @param	build_ref const* refs
+* @param	int count
+* @param	build_ref* left
+* @param	int* left_count
+* @param	build_ref* right
+* @param	int* right_count
+* @param	aabb const& voxel
+* @param	int axis
+* @param	float splitPoint
+* @param	bool planar_left
+* @return		void
+**/
+	void kdtree::split_sweep(build_ref const* refs, int count, build_ref* left, int* left_count, build_ref* right, int* right_count, aabb const& voxel, int axis, float splitPoint, bool planar_left)
+	{
+		//pieces of the clipped triangles, reused by every reference of the node
+		std::vector<triangle> positive;
+		std::vector<triangle> negative;
+
+		//for each triangle
+		for (int i = 0; i < count; i++)
+		{
+			build_ref const& it = refs[i];
+			aabb bounds = computeBV(it, voxel);
+
+			//if it lies on the plane push it to the chosen side
+			if (bounds.mMin[axis] == splitPoint && bounds.mMax[axis] == splitPoint)
+			{
+				if (planar_left)
+					left[(*left_count)++] = it;
+				else
+					right[(*right_count)++] = it;
+			}
+			else if (bounds.mMax[axis] <= splitPoint)//if it ends before the plane push to the left
+				left[(*left_count)++] = it;
+			else if (bounds.mMin[axis] >= splitPoint)//if it starts after the plane push to the right
+				right[(*right_count)++] = it;
+			else if (m_cfg.perfect_splits)//if overlaps push to both the part on each side
+			{
+				build_ref& leftRef = left[(*left_count)++];
+				build_ref& rightRef = right[(*right_count)++];
+				clip_reference(it, bounds, axis, splitPoint, leftRef, rightRef, positive, negative);
+			}
+			else//if overlaps push to both
+			{
+				right[(*right_count)++] = it;
+				left[(*left_count)++] = it;
+			}
+		}
+	}
+
+/**
+* @brief	splits a reference by a plane, bounding the part of its triangle on each side
+* @param	build_ref const& ref
+* @param	aabb const& bounds, bounds of the reference inside of the voxel
+* @param	int axis
+* @param	float splitPoint
+* @param	build_ref& left
+* @param	build_ref& right
+* @param	std::vector<triangle>& positive, scratch for the pieces on the right
+* @param	std::vector<triangle>& negative, scratch for the pieces on the left
+* @return		void
+**/
+	void kdtree::clip_reference(build_ref const& ref, aabb const& bounds, int axis, float splitPoint, build_ref& left, build_ref& right, std::vector<triangle>& positive, std::vector<triangle>& negative)
+	{
+		//at least, each side keeps its half of the bounds
+		left = { ref.triangle, bounds };
+		right = { ref.triangle, bounds };
+		left.bounds.mMax[axis] = splitPoint;
+		right.bounds.mMin[axis] = splitPoint;
+
+		//creating the plane
+		glm::vec3 planePos{};
+		glm::vec3 planeNormal{};
+
+		planePos[axis] = splitPoint;
+		planeNormal[axis] = 1.0F;
+
+		//splitting the triangle
+		positive.clear();
+		negative.clear();
+		split_triangle(m_triangles[ref.triangle].tri, plane(planePos, planeNormal), positive, negative);
+
+		//shrinking each half to the pieces of the triangle on it
+		shrink_bounds(left.bounds, negative, axis);
+		shrink_bounds(right.bounds, positive, axis);
+	}
+
+/**
+* @brief	intersects the bounds of a reference with the bounds of the pieces of its triangle
+* @param	aabb& bounds
+* @param	std::vector<triangle> const& pieces
+* @param	int axis, split axis (already exact on the bounds)
+* @return		void
+**/
+	void kdtree::shrink_bounds(aabb& bounds, std::vector<triangle> const& pieces, int axis)
+	{
+		//numerical trouble, keeping the half of the bounds
+		if (pieces.empty())
+			return;
+
+		//bounds of the pieces
+		glm::vec3 mins(std::numeric_limits<float>::max());
+		glm::vec3 maxs(-std::numeric_limits<float>::max());
+		for (auto const& it : pieces)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				mins = glm::min(mins, it[i]);
+				maxs = glm::max(maxs, it[i]);
+			}
+		}
+
+		//the split axis is left as is, the intersection points may be off by rounding
+		for (int k = 0; k < 3; k++)
+		{
+			if (k == axis)
+				continue;
+
+			bounds.mMin[k] = std::max(bounds.mMin[k], mins[k]);
+			bounds.mMax[k] = std::min(bounds.mMax[k], maxs[k]);
+
+			//never inverting the bounds
+			if (bounds.mMax[k] < bounds.mMin[k])
+				bounds.mMax[k] = bounds.mMin[k];
+		}
+	}
+
+/**
+* @brief	computes the cost of making it a leaf node
+* @param	int count
+* @return		float
+**/
+	float kdtree::cost_leaf(int count)
+	{
+		//returning the result of the heuristics formula
+		return m_cfg.cost_intersection * count;
+	}
+
+/**
+* @brief	Computes the bv of a triangle
+* @param	triangle_wrapper const& triangle
+* @return		aabb
+**/
+	aabb kdtree::computeBV(triangle_wrapper const& triangle)
+	{
+		//aabb which will contain the values
+		aabb bounding;
+
+		//floats to store the min and max values
+		float mins[3] = { std::numeric_limits<float>::max(),
+						  std::numeric_limits<float>::max(),
+						  std::numeric_limits<float>::max() };
+
+		float maxs[3] = { -std::numeric_limits<float>::max(),
+						  -std::numeric_limits<float>::max(),
+						  -std::numeric_limits<float>::max() };
+
+		//go throught the vector and get the lowest and highest x, y, z values
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				if (triangle[i][j] <= mins[j])
+					mins[j] = triangle[i][j];
+
+				if (triangle[i][j] >= maxs[j])
+					maxs[j] = triangle[i][j];
+			}
+		}
+
+		//setting the points
+		bounding.mMin = glm::vec3(mins[0], mins[1], mins[2]);
+		bounding.mMax = glm::vec3(maxs[0], maxs[1], maxs[2]);
+
+		return bounding;
+	}
+
+/**
+* @brief	Computes the bv of a triangle clipped to a voxel
+* @param	build_ref const& ref
+* @param	aabb const& voxel
+* @return		aabb
+**/
+	aabb kdtree::computeBV(build_ref const& ref, aabb const& voxel)
+	{
+		//bounds of the reference, computed once per build (and clipped on perfect splits)
+		aabb bounding = ref.bounds;
+
+		//only the part inside of the voxel matters
+		bounding.mMin = glm::max(bounding.mMin, voxel.mMin);
+		bounding.mMax = glm::min(bounding.mMax, voxel.mMax);
+
+		return bounding;
+	}
+
+/**
+* @brief	Computes the bv of a range of triangles
+* @param	build_ref const* refs
+* @param	int count
+* @return		aabb
+**/
+	aabb kdtree::computeBV(build_ref const* refs, int count)
+	{
+		//aabb which will contain the values
+		aabb bounding;
+
+		//floats to store the min and max values
+		glm::vec3 mins(std::numeric_limits<float>::max());
+		glm::vec3 maxs(-std::numeric_limits<float>::max());
+
+		//joining the bounds of every triangle
+		for (int i = 0; i < count; i++)
+		{
+			mins = glm::min(mins, refs[i].bounds.mMin);
+			maxs = glm::max(maxs, refs[i].bounds.mMax);
+		}
+
+		//setting the points
+		bounding.mMin = mins;
+		bounding.mMax = maxs;
+
+		return bounding;
+	}
+
+/**
+* @brief	computes the surface area of a bv
+* @param	const aabb& bv
+* @return		float
 **/
 	float kdtree::compute_surface(const aabb& bv)
 	{
@@ -476,111 +1272,967 @@ namespace cs350 {
 * @param	int countA
 * @param	float surfaceB
 * @param	int countB
-* @return		int
+* @return		float
 **/
-	int kdtree::cost_intersect(float surfaceA, int countA, float surfaceB, int countB)
+	float kdtree::cost_intersect(float surfaceA, int countA, float surfaceB, int countB)
 	{
 		//returning the result of the heuristics formula
-		int cost = m_cfg.cost_traversal + m_cfg.cost_intersection * (surfaceA * countA + surfaceB * countB);
+		float cost = m_cfg.cost_traversal + m_cfg.cost_intersection * (surfaceA * countA + surfaceB * countB);
 		return cost;
 	}
 	
 /**
-* @brief	wrapper to get the closest triangle
-* @param	ray const r
+* @brief	gets the closest triangle walking the tree front to back
+* @param	ray const& r
 * @param	debug_stats* stats
 * @return		kdtree::intersection
 **/
-	kdtree::intersection kdtree::get_closest(ray const r, debug_stats* stats) const
+	kdtree::intersection kdtree::walk_closest(ray const& r, debug_stats* stats) const
 	{
 		//intersection value
-		intersection t{ 0, -1.0F };
+		intersection minT{ 0, -1.0F };
 
-		//if does not intersect with the root return straight away
-		if (intersection_ray_aabb(r, m_aabbs[0]) < 0.0F)
-			return t;
+		//empty tree
+		if (m_nodes.empty())
+			return minT;
 
-		//getting the minimum intersection time
-		get_min(r, 0, t);
+		//clipping the ray against the root, if it misses return straight away
+		float tMin = 0.0F;
+		float tMax = 0.0F;
+		if (!clip_ray_aabb(r, data().bounds, tMin, tMax))
+			return minT;
 
-		//returing the intersecion object
-		return t;
-	}
+		//far children still to visit
+		traversal_entry stack[c_max_depth];
+		int top = 0;
 
-/**
-* @brief	recursive fuction that gets the triangle with the mionimum intersection time
-* @param	ray const& r
-* @param	int currNode
-* @param	intersection& minT
-* @return		kdtree::intersection
-**/
-	kdtree::intersection kdtree::get_min(ray const& r, int currNode, intersection& minT) const
-	{
-		//cheching is a valid node
-		if (currNode < 0.0F)
-			return minT;
+		int currNode = 0;
 
-		//if does not intersect with the aabb of this node return an error intersection code
-		if (intersection_ray_aabb(r, m_aabbs[currNode]) < 0.0F)
+		while (true)
 		{
-			intersection error{ 0, -1.0F };
-			return error;
-		}
-		
-		//if the node is a leaf
-		if (m_nodes[currNode].is_leaf())
-		{
-			unsigned size = m_nodes[currNode].primitive_count();
+			//going down until reaching a leaf, always through the near child first
+			while (m_nodes[currNode].is_internal())
+			{
+				KDTREE_STAT(stats->nodes_visited++);
+
+				//getting the partition axis and the splitting point
+				int axis = m_nodes[currNode].axis();
+				float splitPoint = m_nodes[currNode].split();
+
+				//the left child is the one under the split point
+				int leftIndex = m_nodes[currNode].next_child();
+				int rightIndex = leftIndex + 1;
+
+				//the near child is the side the ray starts on
+				bool leftFirst = r.mP[axis] < splitPoint || (r.mP[axis] == splitPoint && r.mVec[axis] <= 0.0F);
+				int nearIndex = leftFirst ? leftIndex : rightIndex;
+				int farIndex = leftFirst ? rightIndex : leftIndex;
+
+				//parallel to the plane, the ray never crosses to the far side
+				if (r.mVec[axis] <= cEpsilon && r.mVec[axis] >= -cEpsilon)
+				{
+					currNode = nearIndex;
+					continue;
+				}
+
+				//time at which the ray crosses the splitting plane
+				float tSplit = (splitPoint - r.mP[axis]) / r.mVec[axis];
+
+				//if the plane is crossed after leaving the node (or behind) only the near side is visited
+				if (tSplit > tMax || tSplit <= 0.0F)
+					currNode = nearIndex;
+				//if it is crossed before entering the node only the far side is visited
+				else if (tSplit < tMin)
+					currNode = farIndex;
+				else
+				{
+					//visit the near side now and the far side later
+					stack[top++] = { farIndex, tSplit, tMax };
+					KDTREE_STAT(stats->max_stack_depth = std::max(stats->max_stack_depth, static_cast<size_t>(top)));
+					currNode = nearIndex;
+					tMax = tSplit;
+				}
+			}
+
+			//getting the starting index and triangle count of the leaf
+			int start = m_nodes[currNode].primitive_start();
+			int size = m_nodes[currNode].primitive_count();
+			KDTREE_STAT(stats->leaves_visited++);
 
 			//checking with every triangle in the node
-			for (unsigned i = 0; i < size; i++)
+			for (int i = 0; i < size; i++)
 			{
-				//getting the starting index
-				unsigned index = m_nodes[currNode].primitive_start();
-
 				//getting the intersection time for the triangle
-				float time = intersection_ray_triangle(r, m_triangles[m_indices[index + i]].tri);
+				float time = intersect_leaf_triangle(r, start + i);
+				KDTREE_STAT(stats->intersection_queries++);
 
 				//if does not intersect skip it
 				if (time < 0.0F)
 					continue;
 
+				KDTREE_STAT(stats->intersection_positive_queries++);
+
 				//if the minimum time is negative or the result is lower than the stored one update it
 				if (time < minT.t || minT.t < 0.0F)
 				{
-					minT.triangle_index = m_indices[index + i];
+					minT.triangle_index = m_triangles[m_indices[start + i]].original_index;
 					minT.t = time;
 				}
 			}
+
+			//a hit inside the current interval can not be beaten by any node further away
+			if (minT.t >= 0.0F && minT.t <= tMax)
+				return minT;
+
+			//nothing else to visit
+			if (top == 0)
+				return minT;
+
+			//getting the next far child
+			top--;
+			currNode = stack[top].node;
+			tMin = stack[top].t_min;
+			tMax = stack[top].t_max;
+
+			//the stored hit is closer than where the far child starts
+			if (minT.t >= 0.0F && minT.t < tMin)
+				return minT;
+		}
+	}
+
+/**
+* @brief	checks if the ray hits any triangle before a given time, stopping on the first one found
+* @param	ray const& r
+* @param	float max_t, hits after it do not count (the light distance for shadow rays)
+* @param	debug_stats* stats
+* @return		bool
+**/
+	bool kdtree::walk_occluded(ray const& r, float max_t, debug_stats* stats) const
+	{
+		//empty tree
+		if (m_nodes.empty())
+			return false;
+
+		//clipping the ray against the root, if it misses return straight away
+		float tMin = 0.0F;
+		float tMax = 0.0F;
+		if (!clip_ray_aabb(r, data().bounds, tMin, tMax))
+			return false;
+
+		//nothing past the limit matters
+		tMax = std::min(tMax, max_t);
+		if (tMin > tMax)
+			return false;
+
+		//far children still to visit
+		traversal_entry stack[c_max_depth];
+		int top = 0;
+
+		int currNode = 0;
+
+		while (true)
+		{
+			//going down until reaching a leaf, the order does not matter but near first finds blockers sooner
+			while (m_nodes[currNode].is_internal())
+			{
+				KDTREE_STAT(stats->nodes_visited++);
+
+				//getting the partition axis and the splitting point
+				int axis = m_nodes[currNode].axis();
+				float splitPoint = m_nodes[currNode].split();
+
+				//the left child is the one under the split point
+				int leftIndex = m_nodes[currNode].next_child();
+				int rightIndex = leftIndex + 1;
+
+				//the near child is the side the ray starts on
+				bool leftFirst = r.mP[axis] < splitPoint || (r.mP[axis] == splitPoint && r.mVec[axis] <= 0.0F);
+				int nearIndex = leftFirst ? leftIndex : rightIndex;
+				int farIndex = leftFirst ? rightIndex : leftIndex;
+
+				//parallel to the plane, the ray never crosses to the far side
+				if (r.mVec[axis] <= cEpsilon && r.mVec[axis] >= -cEpsilon)
+				{
+					currNode = nearIndex;
+					continue;
+				}
+
+				//time at which the ray crosses the splitting plane
+				float tSplit = (splitPoint - r.mP[axis]) / r.mVec[axis];
+
+				//if the plane is crossed after leaving the node (or behind) only the near side is visited
+				if (tSplit > tMax || tSplit <= 0.0F)
+					currNode = nearIndex;
+				//if it is crossed before entering the node only the far side is visited
+				else if (tSplit < tMin)
+					currNode = farIndex;
+				else
+				{
+					//visit the near side now and the far side later
+					stack[top++] = { farIndex, tSplit, tMax };
+					KDTREE_STAT(stats->max_stack_depth = std::max(stats->max_stack_depth, static_cast<size_t>(top)));
+					currNode = nearIndex;
+					tMax = tSplit;
+				}
+			}
+
+			//getting the starting index and triangle count of the leaf
+			int start = m_nodes[currNode].primitive_start();
+			int size = m_nodes[currNode].primitive_count();
+			KDTREE_STAT(stats->leaves_visited++);
+
+			//any triangle in front of the limit blocks the ray
+			for (int i = 0; i < size; i++)
+			{
+				float time = intersect_leaf_triangle(r, start + i);
+				KDTREE_STAT(stats->intersection_queries++);
+
+				if (time >= 0.0F && time <= max_t)
+				{
+					KDTREE_STAT(stats->intersection_positive_queries++);
+					return true;
+				}
+			}
+
+			//nothing else to visit
+			if (top == 0)
+				return false;
+
+			//getting the next far child
+			top--;
+			currNode = stack[top].node;
+			tMin = stack[top].t_min;
+			tMax = stack[top].t_max;
 		}
+	}
 
-		//if the node is a intermediate
-		if(m_nodes[currNode].is_internal())
+/**
+* @brief	gets the closest triangle of a packet of rays walking the tree once for all of them
+* @param	ray const* rays
+* @param	int count, at most c_packet_size
+* @param	intersection* results, one per ray
+* @param	debug_stats* stats
+* @return		void
+**/
+	void kdtree::walk_packet(ray const* rays, int count, intersection* results, debug_stats* stats) const
+	{
+		assert(count >= 0 && count <= c_packet_size);
+
+		//by default no ray hits anything
+		for (int i = 0; i < count; i++)
+			results[i] = { 0, -1.0F };
+
+		//empty tree
+		if (m_nodes.empty() || count == 0)
+			return;
+
+		//the packet visits the near child first, so every ray must go the same way on each axis
+		int signs[3] = { 0, 0, 0 };
+		for (int i = 0; i < count; i++)
 		{
-			//getting the partition axis and the splitting point
-			int axis = m_nodes[currNode].axis();
-			float splitPoint = m_nodes[currNode].split();
+			for (int k = 0; k < 3; k++)
+			{
+				//parallel rays never cross a plane, any order works for them
+				if (rays[i].mVec[k] <= cEpsilon && rays[i].mVec[k] >= -cEpsilon)
+					continue;
 
-			//if the rays starting pos is over or under the splitting point get the left or right node
-			int leftIndex = -1;
-			if (r.mP[axis] <= splitPoint)
-				leftIndex = currNode + 1;
-			else
-				leftIndex = m_nodes[currNode].next_child();
+				int sign = rays[i].mVec[k] > 0.0F ? 1 : -1;
+
+				//incoherent packet, tracing the rays one by one
+				if (signs[k] != 0 && signs[k] != sign)
+				{
+					for (int j = 0; j < count; j++)
+						results[j] = walk_closest(rays[j], stats);
+					return;
+				}
+
+				signs[k] = sign;
+			}
+		}
+
+		//origins and inverse directions per axis, parallel rays get the infinity of the packet direction
+		//(unused lanes are left at zero, so every loop runs the full packet width)
+		float origins[3][c_packet_size] = {};
+		float inverses[3][c_packet_size] = {};
+		for (int k = 0; k < 3; k++)
+		{
+			for (int i = 0; i < count; i++)
+			{
+				origins[k][i] = rays[i].mP[k];
+
+				if (rays[i].mVec[k] <= cEpsilon && rays[i].mVec[k] >= -cEpsilon)
+					inverses[k][i] = signs[k] >= 0 ? std::numeric_limits<float>::infinity() : -std::numeric_limits<float>::infinity();
+				else
+					inverses[k][i] = 1.0F / rays[i].mVec[k];
+			}
+		}
+
+		//far children still to visit, with the interval of every ray inside of them
+		packet_entry stack[c_max_depth];
+		int top = 0;
+
+		//clipping the rays against the root, the unused lanes get an empty interval
+		packet_entry curr;
+		curr.node = 0;
+		for (int i = 0; i < c_packet_size; i++)
+		{
+			if (i >= count || !clip_ray_aabb(rays[i], data().bounds, curr.t_min[i], curr.t_max[i]))
+			{
+				curr.t_min[i] = 1.0F;
+				curr.t_max[i] = 0.0F;
+			}
+		}
+
+		//closest hit of every ray so far, the intervals of the rays are cut there
+		float closest[c_packet_size];
+		for (int i = 0; i < c_packet_size; i++)
+			closest[i] = std::numeric_limits<float>::infinity();
+
+		while (true)
+		{
+			//going down until reaching a leaf, always through the near child first
+			while (m_nodes[curr.node].is_internal())
+			{
+				KDTREE_STAT(stats->nodes_visited++);
+
+				//getting the partition axis and the splitting point
+				int axis = m_nodes[curr.node].axis();
+				float splitPoint = m_nodes[curr.node].split();
+
+				//the left child is the one under the split point
+				int leftIndex = m_nodes[curr.node].next_child();
+				int rightIndex = leftIndex + 1;
+
+				//the near child is the side the rays go away from
+				bool leftFirst = signs[axis] >= 0;
+
+				//the far side is written on the top of the stack, and only kept if needed
+				packet_entry& far = stack[top];
+				far.node = leftFirst ? rightIndex : leftIndex;
+				curr.node = leftFirst ? leftIndex : rightIndex;
+
+				//splitting the interval of every ray, without branches so the lanes go together
+				int nearAny = 0;
+				int farAny = 0;
+				for (int i = 0; i < c_packet_size; i++)
+				{
+					//time at which the ray crosses the splitting plane (parallel rays on the plane visit both sides)
+					float tSplit = (splitPoint - origins[axis][i]) * inverses[axis][i];
+
+					far.t_min[i] = std::max(curr.t_min[i], tSplit);
+					far.t_max[i] = curr.t_max[i];
+					curr.t_max[i] = std::min(curr.t_max[i], tSplit);
+
+					//rays that still have something to do on each side
+					nearAny |= curr.t_min[i] <= curr.t_max[i];
+					farAny |= far.t_min[i] <= far.t_max[i];
+				}
+
+				//visit the near side now and the far side later
+				if (nearAny)
+				{
+					if (farAny)
+					{
+						top++;
+						KDTREE_STAT(stats->max_stack_depth = std::max(stats->max_stack_depth, static_cast<size_t>(top)));
+					}
+				}
+				else if (farAny)//only the far side is visited
+					curr = far;
+				else
+					break;
+			}
+
+			if (m_nodes[curr.node].is_leaf())
+			{
+				//getting the starting index and triangle count of the leaf
+				int start = m_nodes[curr.node].primitive_start();
+				int size = m_nodes[curr.node].primitive_count();
+				KDTREE_STAT(stats->leaves_visited++);
+
+				//checking every triangle in the node against the rays that cross it
+				for (int j = 0; j < size; j++)
+				{
+					for (int i = 0; i < count; i++)
+					{
+						if (curr.t_min[i] > curr.t_max[i])
+							continue;
+
+						//getting the intersection time for the triangle
+						float time = intersect_leaf_triangle(rays[i], start + j);
+						KDTREE_STAT(stats->intersection_queries++);
+						KDTREE_STAT(stats->intersection_positive_queries += time >= 0.0F);
+
+						//if the result is lower than the stored one update it
+						if (time >= 0.0F && time < closest[i])
+						{
+							results[i].triangle_index = m_triangles[m_indices[start + j]].original_index;
+							results[i].t = time;
+							closest[i] = time;
+						}
+					}
+				}
+			}
+
+			//nothing else to visit
+			if (top == 0)
+				return;
+
+			//getting the next far child, nodes further than the hit of a ray are empty for it
+			curr = stack[--top];
+			for (int i = 0; i < c_packet_size; i++)
+				curr.t_max[i] = std::min(curr.t_max[i], closest[i]);
+		}
+	}
+
+/**
+* @brief	gets the closest triangle, recording the query
+* @param	ray const r
+* @param	debug_stats* stats, the counts of the query are added to it
+* @return		kdtree::intersection
+**/
+	kdtree::intersection kdtree::get_closest(ray const r, debug_stats* stats) const
+	{
+#if CS350_KDTREE_STATS
+		debug_stats query{};
+		intersection result = walk_closest(r, &query);
+
+		thread_histogram().record(query);
+		if (stats != nullptr)
+			*stats += query;
+
+		return result;
+#else
+		return walk_closest(r, nullptr);
+#endif
+	}
+
+/**
+* @brief	checks if the ray hits any triangle before a given time, recording the query
+* @param	ray const r
+* @param	float max_t
+* @param	debug_stats* stats, the counts of the query are added to it
+* @return		bool
+**/
+	bool kdtree::occluded(ray const r, float max_t, debug_stats* stats) const
+	{
+#if CS350_KDTREE_STATS
+		debug_stats query{};
+		bool result = walk_occluded(r, max_t, &query);
+
+		thread_histogram().record(query);
+		if (stats != nullptr)
+			*stats += query;
+
+		return result;
+#else
+		return walk_occluded(r, max_t, nullptr);
+#endif
+	}
+
+/**
+* @brief	gets the closest triangle of a packet of rays, recording the packet as a single query
+* @param	ray const* rays
+* @param	int count
+* @param	intersection* results
+* @param	debug_stats* stats, the counts of the packet are added to it
+* @return		void
+**/
+	void kdtree::get_closest_packet(ray const* rays, int count, intersection* results, debug_stats* stats) const
+	{
+#if CS350_KDTREE_STATS
+		debug_stats query{};
+		walk_packet(rays, count, results, &query);
+
+		thread_histogram().record(query);
+		if (stats != nullptr)
+			*stats += query;
+#else
+		walk_packet(rays, count, results, nullptr);
+#endif
+	}
+
+/**
+* @brief	adds the counts of another query, keeping the deepest stack
+* @param	debug_stats const& rhs
+* @return		kdtree::debug_stats&
+**/
+	kdtree::debug_stats& kdtree::debug_stats::operator+=(debug_stats const& rhs) noexcept
+	{
+		intersection_queries += rhs.intersection_queries;
+		intersection_positive_queries += rhs.intersection_positive_queries;
+		nodes_visited += rhs.nodes_visited;
+		leaves_visited += rhs.leaves_visited;
+		max_stack_depth = std::max(max_stack_depth, rhs.max_stack_depth);
+		return *this;
+	}
+
+/**
+* @brief	gets the power of two bucket of a value
+* @param	size_t value
+* @return		int
+**/
+	int kdtree::query_histogram::bucket(size_t value) noexcept
+	{
+		//bucket i holds [2^(i-1), 2^i), the last one everything above
+		return std::min(static_cast<int>(std::bit_width(value)), c_log_buckets - 1);
+	}
+
+/**
+* @brief	adds a query to the histogram
+* @param	debug_stats const& query
+* @return		void
+**/
+	void kdtree::query_histogram::record(debug_stats const& query) noexcept
+	{
+		queries++;
+		totals += query;
+
+		nodes_visited[bucket(query.nodes_visited)]++;
+		triangles_tested[bucket(query.intersection_queries)]++;
+		stack_depth[std::min(query.max_stack_depth, static_cast<size_t>(c_max_depth))]++;
+	}
+
+/**
+* @brief	merges another histogram into this one
+* @param	query_histogram const& rhs
+* @return		kdtree::query_histogram&
+**/
+	kdtree::query_histogram& kdtree::query_histogram::operator+=(query_histogram const& rhs) noexcept
+	{
+		queries += rhs.queries;
+		totals += rhs.totals;
+
+		for (int i = 0; i < c_log_buckets; i++)
+		{
+			nodes_visited[i] += rhs.nodes_visited[i];
+			triangles_tested[i] += rhs.triangles_tested[i];
+		}
+		for (int i = 0; i <= c_max_depth; i++)
+			stack_depth[i] += rhs.stack_depth[i];
+
+		return *this;
+	}
+
+	// Histograms of the running threads, and the merge of the ones of finished threads
+	struct histogram_registry
+	{
+		std::mutex mutex;
+		std::vector<kdtree::query_histogram*> live;
+		kdtree::query_histogram retired{};
+	};
+
+/**
+* @brief	gets the registry of the thread histograms
+* @return		histogram_registry&
+**/
+	static histogram_registry& get_histogram_registry()
+	{
+		static histogram_registry registry;
+		return registry;
+	}
+
+	// Histogram of a thread, registered while the thread lives
+	struct thread_histogram_slot
+	{
+		kdtree::query_histogram histogram{};
+
+		thread_histogram_slot()
+		{
+			auto& registry = get_histogram_registry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			registry.live.push_back(&histogram);
+		}
+
+		~thread_histogram_slot()
+		{
+			//keeping the queries of the thread once it finishes
+			auto& registry = get_histogram_registry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			registry.retired += histogram;
+			registry.live.erase(std::find(registry.live.begin(), registry.live.end(), &histogram));
+		}
+	};
+
+/**
+* @brief	gets the histogram of the calling thread
+* @return		kdtree::query_histogram&
+**/
+	kdtree::query_histogram& kdtree::thread_histogram()
+	{
+		thread_local thread_histogram_slot slot;
+		return slot.histogram;
+	}
+
+/**
+* @brief	merges the histograms of every thread
+* @return		kdtree::query_histogram
+**/
+	kdtree::query_histogram kdtree::collect_histograms()
+	{
+		auto& registry = get_histogram_registry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+
+		query_histogram result = registry.retired;
+		for (auto const* it : registry.live)
+			result += *it;
+
+		return result;
+	}
+
+/**
+* @brief	clears the histograms of every thread
+* @return		void
+**/
+	void kdtree::reset_histograms()
+	{
+		auto& registry = get_histogram_registry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+
+		registry.retired = {};
+		for (auto* it : registry.live)
+			*it = {};
+	}
+
+/**
+* @brief	walks the tree getting its SAH cost and the distributions of its leaves
+* @return		kdtree::tree_stats
+**/
+	kdtree::tree_stats kdtree::compute_tree_stats() const
+	{
+		tree_stats result{};
+
+		//empty tree
+		if (m_nodes.empty())
+			return result;
+
+		//costs are weighted by the chance of a ray crossing the root to cross the node
+		float rootSurface = compute_surface(data().bounds);
+		if (rootSurface <= 0.0F)
+			rootSurface = 1.0F;
+
+		//node to visit, with its depth and its voxel (cut from the parent one by the split)
+		struct pending_node
+		{
+			int  index;
+			int  depth;
+			aabb voxel;
+		};
+
+		std::vector<pending_node> pending{ { 0, 0, data().bounds } };
+		while (!pending.empty())
+		{
+			auto [index, depth, voxel] = pending.back();
+			pending.pop_back();
+
+			node const& curr = m_nodes[index];
+			float weight = compute_surface(voxel) / rootSurface;
+
+			if (curr.is_internal())
+			{
+				result.internal_nodes++;
+				result.sah_cost += weight * m_cfg.cost_traversal;
+
+				aabb leftVoxel = voxel;
+				aabb rightVoxel = voxel;
+				leftVoxel.mMax[curr.axis()] = curr.split();
+				rightVoxel.mMin[curr.axis()] = curr.split();
+
+				pending.push_back({ curr.next_child() + 1, depth + 1, rightVoxel });
+				pending.push_back({ curr.next_child(), depth + 1, leftVoxel });
+				continue;
+			}
+
+			int count = curr.primitive_count();
+			result.leaves++;
+			result.references += count;
+			result.sah_cost += weight * m_cfg.cost_intersection * count;
+			if (count == 0)
+				result.empty_leaves++;
+
+			result.leaf_sizes[query_histogram::bucket(count)]++;
+			result.leaf_depths[std::min(depth, c_max_depth)]++;
+		}
+
+		return result;
+	}
+
+/**
+* @brief	hashes the geometry of the input triangles (FNV-1a over the vertex bits)
+* @param	position_container const& positions
+* @return		uint64_t
+**/
+	uint64_t kdtree::hash_input(position_container const& positions)
+	{
+		uint64_t hash = c_fnv_offset;
+
+		//the amount of triangles first, then every coordinate
+		hash = fnv_hash(hash, static_cast<uint64_t>(positions.size()));
+		for (auto const& it : positions)
+			for (int i = 0; i < 3; i++)
+				for (int k = 0; k < 3; k++)
+					hash = fnv_hash(hash, std::bit_cast<uint32_t>(it[i][k]));
+
+		return hash;
+	}
+
+/**
+* @brief	hashes the geometry of the scene triangles, same value as for their positions
+* @param	triangle_container const& all_triangles
+* @return		uint64_t
+**/
+	uint64_t kdtree::hash_input(triangle_container const& all_triangles)
+	{
+		return hash_input(positions_of(all_triangles));
+	}
+
+/**
+* @brief	hashes the fields of the config that change the built tree
+* @param	config const& cfg, with max_depth already clamped
+* @return		uint64_t
+**/
+	uint64_t kdtree::hash_config(config const& cfg)
+	{
+		uint64_t hash = c_fnv_offset;
+
+		//parallel_threshold does not change the output, so it is left out
+		hash = fnv_hash(hash, std::bit_cast<uint32_t>(cfg.cost_traversal));
+		hash = fnv_hash(hash, std::bit_cast<uint32_t>(cfg.cost_intersection));
+		hash = fnv_hash(hash, static_cast<uint64_t>(cfg.max_depth));
+		hash = fnv_hash(hash, static_cast<uint64_t>(cfg.method));
+		hash = fnv_hash(hash, static_cast<uint64_t>(cfg.split_samples));
+		hash = fnv_hash(hash, static_cast<uint64_t>(cfg.perfect_splits));
+
+		return hash;
+	}
+
+/**
+* @brief	adds the bytes of a value to a FNV-1a hash
+* @param	uint64_t hash
+* @param	uint64_t value
+* @return		uint64_t
+**/
+	uint64_t kdtree::fnv_hash(uint64_t hash, uint64_t value)
+	{
+		for (int i = 0; i < 8; i++)
+		{
+			hash ^= (value >> (i * 8)) & 0xFF;
+			hash *= c_fnv_prime;
+		}
+
+		return hash;
+	}
+
+/**
+* @brief	computes where each section of a saved tree starts, every one aligned to 16 bytes
+* @param	file_header const& header
+* @return		kdtree::file_layout
+**/
+	kdtree::file_layout kdtree::compute_layout(file_header const& header)
+	{
+		auto align = [](size_t offset) { return (offset + 15) & ~static_cast<size_t>(15); };
+
+		file_layout layout;
+		layout.nodes = align(sizeof(file_header));
+		layout.bounds = align(layout.nodes + header.node_count * sizeof(node));
+		layout.indices = align(layout.bounds + sizeof(aabb));
+		layout.triangles = align(layout.indices + header.index_count * sizeof(uint64_t));
+		layout.original_indices = align(layout.triangles + header.triangle_count * c_triangle_floats * sizeof(float));
+		layout.leaf_triangles = align(layout.original_indices + header.triangle_count * sizeof(uint64_t));
+		layout.size = layout.leaf_triangles + header.index_count * c_leaf_components * sizeof(float);
+
+		return layout;
+	}
+
+/**
+* @brief	saves the built tree, to be loaded back by a scene with the same triangles and config
+* @param	char const* path
+* @return		bool, false if the file can not be written
+**/
+	bool kdtree::save(char const* path) const
+	{
+		//the format is little endian
+		if constexpr (std::endian::native != std::endian::little)
+			return false;
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		//filling the header
+		file_header header{};
+		header.magic = c_file_magic;
+		header.version = c_file_version;
+		header.input_hash = data().input_hash;
+		header.config_hash = hash_config(m_cfg);
+		header.node_count = m_nodes.size();
+		header.index_count = m_indices.size();
+		header.triangle_count = m_triangles.size();
+
+		file_layout layout = compute_layout(header);
+
+		//writes a section at its offset, padding up to it
+		auto write = [&](size_t offset, void const* data, size_t bytes) {
+			static const char padding[16] = {};
+			file.write(padding, static_cast<std::streamsize>(offset - static_cast<size_t>(file.tellp())));
+			file.write(static_cast<char const*>(data), static_cast<std::streamsize>(bytes));
+		};
+
+		file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+		write(layout.nodes, m_nodes.data(), m_nodes.size() * sizeof(node));
+		write(layout.bounds, &data().bounds, sizeof(aabb));
+
+		//indices are stored as 64 bits whatever size_t is
+		std::vector<uint64_t> indices(m_indices.begin(), m_indices.end());
+		write(layout.indices, indices.data(), indices.size() * sizeof(uint64_t));
+
+		//triangles as plain floats, and their original indices apart
+		std::vector<float> vertices;
+		std::vector<uint64_t> originals;
+		vertices.reserve(m_triangles.size() * c_triangle_floats);
+		originals.reserve(m_triangles.size());
+		for (auto const& it : m_triangles)
+		{
+			for (int i = 0; i < 3; i++)
+				for (int k = 0; k < 3; k++)
+					vertices.push_back(it.tri[i][k]);
+
+			originals.push_back(it.original_index);
+		}
+
+		write(layout.triangles, vertices.data(), vertices.size() * sizeof(float));
+		write(layout.original_indices, originals.data(), originals.size() * sizeof(uint64_t));
+		write(layout.leaf_triangles, data().leaf_triangles.data(), data().leaf_triangles.size() * sizeof(float));
 
-			int rightIndex = -1.0F;
-			if (r.mP[axis] > splitPoint)
-				rightIndex = currNode + 1;
+		return static_cast<bool>(file);
+	}
+
+/**
+* @brief	loads a saved tree built from the geometry of the scene triangles
+* @param	char const* path
+* @param	triangle_container const& all_triangles
+* @param	const config& cfg
+* @return		bool, false if the file is missing, broken or stale (the tree is left untouched)
+**/
+	bool kdtree::load(char const* path, triangle_container const& all_triangles, const config& cfg)
+	{
+		return load(path, positions_of(all_triangles), cfg);
+	}
+
+/**
+* @brief	loads a saved tree by mapping the file, only if it was built from the same triangles and config
+* @param	char const* path
+* @param	position_container const& positions
+* @param	const config& cfg
+* @return		bool, false if the file is missing, broken or stale (the tree is left untouched)
+**/
+	bool kdtree::load(char const* path, position_container const& positions, const config& cfg)
+	{
+		//the format is little endian
+		if constexpr (std::endian::native != std::endian::little)
+			return false;
+
+		mapped_file file;
+		if (!file.open(path) || file.size() < sizeof(file_header))
+			return false;
+
+		file_header header;
+		std::memcpy(&header, file.data(), sizeof(header));
+
+		//the depth is clamped the same way as in the build
+		config clamped = cfg;
+		clamped.max_depth = std::min(clamped.max_depth, c_max_depth - 1);
+
+		//another format or another scene
+		if (header.magic != c_file_magic || header.version != c_file_version)
+			return false;
+		if (header.config_hash != hash_config(clamped) || header.triangle_count != positions.size())
+			return false;
+
+		//truncated file (counts past the file size would overflow the layout)
+		if (header.node_count > file.size() || header.index_count > file.size())
+			return false;
+		file_layout layout = compute_layout(header);
+		if (layout.size != file.size())
+			return false;
+
+		//hashing is the slow part of the checks, done last
+		uint64_t inputHash = hash_input(positions);
+		if (header.input_hash != inputHash)
+			return false;
+
+		std::byte const* contents = file.data();
+
+		//the hashes do not cover the tree itself, every offset is checked before using it
+		decltype(m_nodes) nodes(header.node_count);
+		std::memcpy(nodes.data(), contents + layout.nodes, nodes.size() * sizeof(node));
+
+		//deepest path to every node, all the parents of a node come before it
+		std::vector<int> depths(nodes.size(), 0);
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			node const& n = nodes[i];
+
+			//deeper than the traversal stacks can hold
+			if (depths[i] > c_max_depth - 1)
+				return false;
+
+			if (n.is_leaf())
+			{
+				//the range of the leaf inside the indices
+				uint64_t start = static_cast<unsigned>(n.primitive_start());
+				if (start + static_cast<unsigned>(n.primitive_count()) > header.index_count)
+					return false;
+			}
 			else
-				rightIndex = m_nodes[currNode].next_child();
+			{
+				//children are placed after their parent, next to each other
+				uint64_t child = static_cast<unsigned>(n.next_child());
+				if (child <= i || child + 1 >= nodes.size())
+					return false;
 
-			//recursive call to the child nodes
-			get_min(r, leftIndex, minT);
-			get_min(r, rightIndex, minT);
+				depths[child] = std::max(depths[child], depths[i] + 1);
+				depths[child + 1] = std::max(depths[child + 1], depths[i] + 1);
+			}
 		}
 
-		//returing the minumum intersection time
-		return minT;
+		uint64_t const* indices = reinterpret_cast<uint64_t const*>(contents + layout.indices);
+		uint64_t const* originals = reinterpret_cast<uint64_t const*>(contents + layout.original_indices);
+		for (uint64_t i = 0; i < header.index_count; i++)
+			if (indices[i] >= header.triangle_count)
+				return false;
+		for (uint64_t i = 0; i < header.triangle_count; i++)
+			if (originals[i] >= header.triangle_count)
+				return false;
+
+		//the sections are copied in bulk to the arrays of the tree
+		m_nodes = std::move(nodes);
+
+		std::memcpy(&data().bounds, contents + layout.bounds, sizeof(aabb));
+
+		m_indices.assign(indices, indices + header.index_count);
+
+		float const* vertices = reinterpret_cast<float const*>(contents + layout.triangles);
+		m_triangles.resize(header.triangle_count);
+		for (size_t i = 0; i < m_triangles.size(); i++)
+		{
+			float const* v = vertices + i * c_triangle_floats;
+			m_triangles[i].tri = triangle(glm::vec3(v[0], v[1], v[2]), glm::vec3(v[3], v[4], v[5]), glm::vec3(v[6], v[7], v[8]));
+			m_triangles[i].original_index = static_cast<uint32_t>(originals[i]);
+		}
+
+		tree_data& ext = data();
+		ext.leaf_triangles.resize(header.index_count * c_leaf_components);
+		std::memcpy(ext.leaf_triangles.data(), contents + layout.leaf_triangles, ext.leaf_triangles.size() * sizeof(float));
+		ext.leaf_offsets.clear();
+		ext.leaf_positions.clear();
+
+		//nothing was built
+		m_cfg = clamped;
+		ext.input_hash = inputHash;
+		ext.build = {};
+
+		return true;
 	}
 
 /**
@@ -592,4 +2244,16 @@ namespace cs350 {
 		//returning the macximum depth of the tree
 		return m_cfg.max_depth;
 	}
-}
\ No newline at end of file
+
+/**
+* @brief	bytes held by the arrays of the built tree (the capacity, which is what stays allocated)
+* @return		size_t
+**/
+	size_t kdtree::memory_footprint() const
+	{
+		tree_data const& ext = data();
+		return m_nodes.capacity() * sizeof(node) + m_indices.capacity() * sizeof(size_t) +
+			ext.leaf_triangles.capacity() * sizeof(float) + m_triangles.capacity() * sizeof(triangle_wrapper) +
+			(ext.leaf_offsets.capacity() + ext.leaf_positions.capacity()) * sizeof(size_t);
+	}
+}
@@ -6,35 +6,106 @@
 * @copyright Copyright (C) 2020 DigiPen Institute of Technology .
 */
 #pragma once
+#include <cstdint>
+#include <memory>
+#include <new>
 #include <vector>
+#include "arena.hpp"
 #include "geometry.hpp"
 #include "scene_data.hpp"
 
+// Traversal instrumentation (debug_stats and the query histograms). On by default on debug builds,
+// define CS350_KDTREE_STATS=1 to keep it on profiling builds. When 0 the queries do not count anything
+#ifndef CS350_KDTREE_STATS
+#ifdef NDEBUG
+#define CS350_KDTREE_STATS 0
+#else
+#define CS350_KDTREE_STATS 1
+#endif
+#endif
+
 namespace cs350 {
 
+    /**
+     * Allocator placing the arrays at the start of a cache line
+     */
+    template <typename T>
+    struct cache_line_allocator
+    {
+        using value_type = T;
+
+        static constexpr size_t c_line_size = 64;
+
+        cache_line_allocator() noexcept = default;
+        template <typename U>
+        cache_line_allocator(cache_line_allocator<U> const&) noexcept {}
+
+        T*   allocate(size_t count) { return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t{c_line_size})); }
+        void deallocate(T* p, size_t) noexcept { ::operator delete(p, std::align_val_t{c_line_size}); }
+
+        template <typename U>
+        bool operator==(cache_line_allocator<U> const&) const noexcept { return true; }
+    };
+
     /**
      * Basic KDTree
      */
     class kdtree
     {
       public:
+        /**
+         * How the splitting plane of a node is chosen
+         *  sampled: evenly spaced planes on the axis depth % 3
+         *  sweep:   exact SAH over every triangle bound on the three axis
+         */
+        enum class split_method
+        {
+            sampled,
+            sweep
+        };
+
         /**
          * Construction configuration
          */
         struct config
         {
-            float cost_traversal    = 1.0f;
-            float cost_intersection = 80.0f;
-            int   max_depth         = 5;
+            float        cost_traversal     = 1.0f;
+            float        cost_intersection  = 80.0f;
+            int          max_depth          = 5;
+            split_method method             = split_method::sweep;
+            int          split_samples      = 10;   // sampled only
+            int          parallel_threshold = 4096; // triangles needed to build a node with parallel tasks (0 disables)
+            bool         perfect_splits     = true; // sweep only, clips straddling triangles to each child
         };
 
         /**
-         * Statistics
+         * Statistics of the queries (left as they are when CS350_KDTREE_STATS is 0)
          */
         struct debug_stats
         {
+            // Triangles tested and how many of them were hit
             size_t intersection_queries;
             size_t intersection_positive_queries;
+            // Internal nodes walked and leaves reached
+            size_t nodes_visited;
+            size_t leaves_visited;
+            // Most far children pending at the same time
+            size_t max_stack_depth;
+
+            debug_stats& operator+=(debug_stats const& rhs) noexcept;
+        };
+
+        /**
+         * Cost of the last build
+         */
+        struct build_stats
+        {
+            // Memory requests done to the system, and how many of them were scratch memory blocks
+            size_t allocations;
+            size_t scratch_allocations;
+            // Bytes of every buffer the build used added up. Some of them are never live at the same time
+            // (the nodes before and after the relayout), so the real peak is below it
+            size_t memory_upper_bound;
         };
 
         /**
@@ -54,8 +125,10 @@ namespace cs350 {
 
         /**
          * KDTree Node structure
-         *  Internals: Split, Axis, Right subnode index. (left subnode is next in the array)
+         *  Internals: Split, Axis, Left subnode index (right subnode is next to it)
          *  Leafs: Index of first triangle, amount of triangles
+         * While building the left subnode is next to its parent and the right one is the one indexed,
+         * relayout_nodes changes it to the traversal order
          */
         struct node
         {
@@ -99,19 +172,200 @@ namespace cs350 {
             triangle tri;
 
             // Index of source triangle (so the application knows which triangles was being referenced)
-            size_t original_index;
+            uint32_t original_index;
 
             [[nodiscard]] auto const& operator[](int i) const { return tri[i]; }
             [[nodiscard]] auto&       operator[](int i) { return tri[i]; }
         };
 
+        // Nodes sharing a cache line (the node array starts at one)
+        static constexpr int c_nodes_per_line = static_cast<int>(cache_line_allocator<node>::c_line_size / sizeof(node));
+        // Deepest tree the traversal stack can handle (max_depth is clamped to it)
+        static constexpr int c_max_depth = 64;
+        // Most rays traced together by get_closest_packet
+        static constexpr int c_packet_size = 8;
+        // Floats stored per leaf triangle (first vertex and two edges)
+        static constexpr int c_leaf_components = 9;
+        // Saved trees: "KDTR" and format version (bump it whenever the layout changes)
+        static constexpr uint32_t c_file_magic   = 0x5254444B;
+        static constexpr uint32_t c_file_version = 2;
+        // Buckets of the power of two distributions, bucket 0 holds zeros and bucket i values in [2^(i-1), 2^i)
+        static constexpr int c_log_buckets = 32;
+
+        /**
+         * Distribution of the queries done by a thread
+         */
+        struct query_histogram
+        {
+            size_t queries;
+            // Sum of the stats of every query (max_stack_depth is the max)
+            debug_stats totals;
+            // Queries by nodes visited and by triangles tested (power of two buckets)
+            size_t nodes_visited[c_log_buckets];
+            size_t triangles_tested[c_log_buckets];
+            // Queries by their max stack depth
+            size_t stack_depth[c_max_depth + 1];
+
+            void             record(debug_stats const& query) noexcept;
+            query_histogram& operator+=(query_histogram const& rhs) noexcept;
+            static int       bucket(size_t value) noexcept;
+        };
+
+        /**
+         * Quality of the built tree
+         */
+        struct tree_stats
+        {
+            // Expected cost of a ray crossing the root, the SAH of every node weighted by its surface over the root one
+            float  sah_cost;
+            size_t internal_nodes;
+            size_t leaves;
+            size_t empty_leaves;
+            // Triangles referenced by the leaves (duplicates included)
+            size_t references;
+            // Leaves by triangle count (power of two buckets) and by depth
+            size_t leaf_sizes[c_log_buckets];
+            size_t leaf_depths[c_max_depth + 1];
+        };
+
       private:
+        /**
+         * Start, end or planar bound of a triangle on the sweep axis.
+         * Types are ordered so that ends come before planars and starts at the same position
+         */
+        struct split_event
+        {
+            enum type_t
+            {
+                end,
+                planar,
+                start
+            };
+
+            float  position;
+            type_t type;
+
+            bool operator<(split_event const& rhs) const { return position < rhs.position || (position == rhs.position && type < rhs.type); }
+        };
+
+        /**
+         * Triangle referenced by a node while building, with the bounds of the part of it inside the node
+         */
+        struct build_ref
+        {
+            unsigned triangle;
+            aabb     bounds;
+        };
+
+        /**
+         * Arrays in which a (sub)tree is built, so subtrees can be built by different tasks
+         */
+        struct build_output
+        {
+            std::vector<node>   nodes;
+            std::vector<size_t> indices;
+        };
+
+        /**
+         * State of a (sub)tree build, references to the triangles live in the scratch memory
+         */
+        struct build_context
+        {
+            build_output out;
+            arena        scratch;
+            // Requests done by the output arrays and by finished tasks
+            size_t allocations  = 0;
+            // Scratch memory owned by finished tasks
+            size_t scratch_peak = 0;
+        };
+
+        /**
+         * Start of a saved tree, followed by the sections at the offsets of file_layout
+         */
+        struct file_header
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t input_hash;
+            uint64_t config_hash;
+            uint64_t node_count;
+            uint64_t index_count;
+            uint64_t triangle_count;
+        };
+
+        /**
+         * Offsets of the sections of a saved tree
+         */
+        struct file_layout
+        {
+            size_t nodes;
+            size_t bounds;
+            size_t indices;
+            size_t triangles;
+            size_t original_indices;
+            size_t leaf_triangles;
+            size_t size;
+        };
+
+        // Floats stored per triangle on a saved tree
+        static constexpr int c_triangle_floats = 9;
+        // FNV-1a constants
+        static constexpr uint64_t c_fnv_offset = 14695981039346656037ull;
+        static constexpr uint64_t c_fnv_prime  = 1099511628211ull;
+
+        /**
+         * Pending far child of the traversal, with the ray interval inside it
+         */
+        struct traversal_entry
+        {
+            int   node;
+            float t_min;
+            float t_max;
+        };
+
+        /**
+         * Pending far child of the packet traversal, with the interval of each ray inside it (empty if t_min > t_max)
+         */
+        struct packet_entry
+        {
+            int   node;
+            float t_min[c_packet_size];
+            float t_max[c_packet_size];
+        };
+
+        /**
+         * State of the tree that the baseline one did not have. The prebuilt code was built with the baseline
+         * sizeof(kdtree), and scene::m_kdtree sits above scene members it reads, so the new state lives here
+         */
+        struct tree_data
+        {
+            // Positions in the leaf order of the references of every triangle, the ones of triangle i start at
+            // leaf_offsets[i] (built by the first removal, so plain builds do not pay for it)
+            std::vector<size_t> leaf_offsets;
+            std::vector<size_t> leaf_positions;
+            // Bounds of the root (the ones of the other nodes are cut by the splits while walking)
+            aabb bounds{};
+            // Triangles of m_indices (same order) ready to be intersected, as c_leaf_components arrays of floats
+            std::vector<float> leaf_triangles;
+            // Hash of the triangles the tree was built from
+            uint64_t input_hash = 0;
+            // Cost of the last build, and the depth up to which it forks tasks
+            build_stats build{};
+            int         parallel_depth = 0;
+            // Scratch memory of the builds, kept so rebuilding does not request it again
+            arena scratch;
+
+            tree_data() = default;
+            // Copies everything but the scratch memory, which only the builds of the same tree reuse
+            tree_data(tree_data const& rhs);
+        };
+
         // All recorded triangles (may contain duplicates)
         std::vector<size_t> m_indices;
-        // KDTree nodes
-        std::vector<node> m_nodes;
-        // AABBs of nodes (same order)
-        std::vector<aabb> m_aabbs;
+        // KDTree nodes, in traversal order
+        std::vector<node, cache_line_allocator<node>> m_nodes;
+        // Everything added over the baseline tree, in the slot of the per-node bounds it used to keep
+        std::unique_ptr<tree_data> m_data;
         // Converted triangles
         std::vector<triangle_wrapper> m_triangles;
         // Configuration
@@ -119,6 +373,15 @@ namespace cs350 {
 
     public:
         typedef std::vector<scene_triangle> triangle_container;
+        // The geometry alone, index i being the one of triangle i of the scene
+        typedef std::vector<triangle> position_container;
+
+        kdtree() = default;
+        kdtree(kdtree const& rhs);
+        kdtree(kdtree&& rhs) noexcept = default;
+        kdtree& operator=(kdtree const& rhs);
+        kdtree& operator=(kdtree&& rhs) noexcept = default;
+        ~kdtree()                                = default;
 
         /**
          * Builds the kdtree
@@ -127,17 +390,71 @@ namespace cs350 {
          */
         void build(triangle_container const& all_triangles, const config& cfg);
 
-        void build_tree(std::vector<triangle_wrapper> const& triangles, int depth);
-        float get_split(std::vector<triangle_wrapper> const& triangles, int axis, float* min_cost);
-        void split(std::vector<triangle_wrapper> const& triangles, int* left, int* right, int axis, float splitPoint);
+        /**
+         * Builds the kdtree from the geometry alone (same tree as from the scene triangles holding it)
+         * @param positions
+         * @param config
+         */
+        void build(position_container const& positions, const config& cfg);
+
+        /**
+         * Saves the built tree (little endian, versioned)
+         * @param path
+         * @return bool, false if it could not be written
+         */
+        bool save(char const* path) const;
+
+        /**
+         * Loads a saved tree by mapping the file. Trees saved from other triangles or another config are rejected
+         * @param path
+         * @param all_triangles, the triangles the tree would be built from
+         * @param cfg, the config the tree would be built with
+         * @return bool, false if there is no valid tree on the file (the current one is left as is)
+         */
+        bool load(char const* path, triangle_container const& all_triangles, const config& cfg);
+        bool load(char const* path, position_container const& positions, const config& cfg);
+
+        /**
+         * Makes triangles of the input impossible to hit, leaving the nodes as they are. The tree stays valid
+         * (only looser) while those triangles are moved or traced somewhere else, without rebuilding it
+         * @param first, index in the triangles the tree was built from
+         * @param count
+         * @return size_t, leaf references removed
+         */
+        size_t remove_triangles(size_t first, size_t count);
+
+        static uint64_t    hash_input(triangle_container const& all_triangles);
+        static uint64_t    hash_input(position_container const& positions);
+        static position_container positions_of(triangle_container const& all_triangles);
+        static uint64_t    hash_config(config const& cfg);
+        static uint64_t    fnv_hash(uint64_t hash, uint64_t value);
+        static file_layout compute_layout(file_header const& header);
+
+        void build_tree(build_ref const* refs, int count, aabb const& voxel, int depth, build_context& ctx);
+        void build_leaf_triangles();
+        void make_leaf(build_ref const* refs, int count, unsigned node_index, build_context& ctx);
+        bool parallel_build(size_t triangle_count, int depth) const;
+        void append_subtree(build_context& ctx, build_output const& subtree);
+        void relayout_nodes(std::vector<node> const& built);
+        static size_t scratch_estimate(size_t count);
+        float get_split(build_ref const* refs, int count, int axis, float* min_cost);
+        void split(build_ref const* refs, int count, int* left, int* right, int axis, float splitPoint);
 
-        int cost_intersect(float surfaceA, int countA, float surfaceB, int countB);
-        int cost_leaf(std::vector<triangle_wrapper> const& triangles);
+        float get_split_sweep(build_ref const* refs, int count, aabb const& voxel, int depth, arena& scratch, int* axis, float* min_cost, bool* planar_left);
+        float sweep_axis(build_ref const* refs, int count, aabb const& voxel, int k, split_event* events, float* min_cost, bool* planar_left);
+        void split_sweep(build_ref const* refs, int count, build_ref* left, int* left_count, build_ref* right, int* right_count, aabb const& voxel, int axis, float splitPoint, bool planar_left);
 
-        void split(std::vector<triangle_wrapper> const& triangles, std::vector<triangle_wrapper>& left, std::vector<triangle_wrapper>& right, int axis, float splitPoint);
+        void clip_reference(build_ref const& ref, aabb const& bounds, int axis, float splitPoint, build_ref& left, build_ref& right, std::vector<triangle>& positive, std::vector<triangle>& negative);
+        static void shrink_bounds(aabb& bounds, std::vector<triangle> const& pieces, int axis);
+
+        float cost_intersect(float surfaceA, int countA, float surfaceB, int countB);
+        float cost_leaf(int count);
+
+        void split(build_ref const* refs, int count, build_ref* left, int* left_count, build_ref* right, int* right_count, int axis, float splitPoint);
         aabb computeBV(triangle_wrapper const& triangle);
-        aabb computeBV(std::vector<triangle_wrapper> const& triangles);
-        float compute_surface(const aabb& bv);
+        aabb computeBV(build_ref const& ref, aabb const& voxel);
+        aabb computeBV(build_ref const* refs, int count);
+        static float compute_surface(const aabb& bv);
 
         /**
          * Retrieves the closest intersection
@@ -146,16 +463,70 @@ namespace cs350 {
          * @return intersection
          */
         [[nodiscard]] intersection get_closest(ray const r, debug_stats* stats) const;
-        intersection get_min(ray const& r, int currNode, intersection& minT) const;
+        [[nodiscard]] float        intersect_leaf_triangle(ray const& r, size_t k) const;
+
+        /**
+         * Checks if anything is hit before max_t, returning on the first hit found (shadow rays)
+         * @param r
+         * @param max_t
+         * @param stats
+         * @return bool
+         */
+        [[nodiscard]] bool occluded(ray const r, float max_t, debug_stats* stats) const;
+
+        /**
+         * Retrieves the closest intersection of up to c_packet_size rays, walking the tree once for all of them.
+         * Meant for coherent rays (primary rays of neighbouring pixels), packets whose rays go in opposite
+         * directions on some axis are traced one by one
+         * @param rays
+         * @param count
+         * @param results
+         * @param stats
+         */
+        void get_closest_packet(ray const* rays, int count, intersection* results, debug_stats* stats) const;
+
+        /**
+         * Histogram of the queries done by the calling thread, every query is recorded on it
+         * @return query_histogram&
+         */
+        static query_histogram& thread_histogram();
+
+        /**
+         * Merges the histograms of every thread (also the ones that finished). Not to be called while querying
+         * @return query_histogram
+         */
+        static query_histogram collect_histograms();
+        static void            reset_histograms();
+
+        /**
+         * Walks the built tree computing its SAH cost and the distributions of its leaves
+         * @return tree_stats
+         */
+        [[nodiscard]] tree_stats compute_tree_stats() const;
 
         [[nodiscard]] int get_depth() const;
+        // Bytes held by the arrays of the tree
+        [[nodiscard]] size_t memory_footprint() const;
+        [[nodiscard]] build_stats const& get_build_stats() const noexcept { return data().build; }
 
         [[nodiscard]] const decltype(m_nodes)&     nodes() const noexcept { return m_nodes; }
         [[nodiscard]] const decltype(m_indices)&   indices() const noexcept { return m_indices; }
-        [[nodiscard]] const decltype(m_aabbs)&     aabbs() const noexcept { return m_aabbs; }
+        [[nodiscard]] aabb const&                  bounds() const noexcept { return data().bounds; }
         [[nodiscard]] const decltype(m_triangles)& triangles() const noexcept { return m_triangles; }
         [[nodiscard]] decltype(m_triangles)&       triangles() noexcept { return m_triangles; } // Debug
 
       private:
+        // The state added over the baseline tree, created on the first write (trees never built or moved from have none)
+        tree_data&                     data();
+        [[nodiscard]] tree_data const& data() const noexcept;
+
+        // Queries without the recording, every one of them counts on stats if not null
+        [[nodiscard]] intersection walk_closest(ray const& r, debug_stats* stats) const;
+        [[nodiscard]] bool         walk_occluded(ray const& r, float max_t, debug_stats* stats) const;
+        void                       walk_packet(ray const* rays, int count, intersection* results, debug_stats* stats) const;
     };
+
+    // The prebuilt code was built with this size, and scene::m_kdtree sits above scene members it reads
+    // (m_cubemap, m_air_material). New state goes into kdtree::tree_data, never into kdtree itself
+    static_assert(sizeof(kdtree) == 112, "kdtree has to keep the size the prebuilt code was built with");
 }
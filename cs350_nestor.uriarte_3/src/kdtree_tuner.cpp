@@ -0,0 +1,279 @@
+/**
+* @file		 kdtree_tuner.cpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the implementation of the kdtree_tuner
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <string>
+#include "kdtree_tuner.hpp"
+
+namespace cs350 {
+
+	// Triangle tests done to time a test (spread over the sample rays)
+	static const size_t c_triangle_tests = 4 * 1024 * 1024;
+	// Walks down the tree done per sample ray to time a step
+	static const int c_node_walks = 16;
+	// Keeps the timed loops from being optimized away
+	static volatile float g_sink = 0.0F;
+
+/**
+* @brief	runs a function the given times, returning the fastest run
+* @param	int repetitions
+* @param	F const& fn
+* @return		double, milliseconds
+**/
+	template <typename F>
+	static double best_time(int repetitions, F const& fn)
+	{
+		double best = 0.0;
+		for (int i = 0; i < std::max(repetitions, 1); i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			fn();
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			best = i == 0 ? ms : std::min(best, ms);
+		}
+
+		return best;
+	}
+
+/**
+* @brief	keeps the geometry of the scene to tune
+* @param	kdtree::triangle_container const& triangles
+* @param	std::vector<ray> const& rays
+**/
+	kdtree_tuner::kdtree_tuner(kdtree::triangle_container const& triangles, std::vector<ray> const& rays) : m_positions(kdtree::positions_of(triangles)), m_rays(rays)
+	{
+	}
+
+/**
+* @brief	measures the costs and times every config of the settings
+* @param	settings const& s
+* @return		kdtree_tuner::result
+**/
+	kdtree_tuner::result kdtree_tuner::run(settings const& s) const
+	{
+		result r{};
+
+		//the costs are measured on a tree of the base config
+		kdtree probe;
+		probe.build(m_positions, s.base);
+		r.costs = measure_costs(probe, s.repetitions);
+
+		//the SAH only cares about the ratio, traversal is kept at 1
+		float ratio = 1.0F;
+		if (r.costs.node_ns > 0.0)
+			ratio = static_cast<float>(std::max(r.costs.triangle_ns / r.costs.node_ns, 0.01));
+
+		//the sample rays stand for the rays of the render
+		double rayScale = 1.0;
+		if (s.render_rays != 0 && !m_rays.empty())
+			rayScale = static_cast<double>(s.render_rays) / static_cast<double>(m_rays.size());
+
+		for (int depth : s.depths)
+		{
+			for (float scale : s.intersection_scales)
+			{
+				candidate c{};
+				c.cfg = s.base;
+				c.cfg.cost_traversal = 1.0F;
+				c.cfg.cost_intersection = ratio * scale;
+				c.cfg.max_depth = depth;
+
+				kdtree kd;
+				c.build_ms = best_time(s.repetitions, [&]() { kd.build(m_positions, c.cfg); });
+				c.render_ms = rayScale * best_time(s.repetitions, [&]() {
+					float sum = 0.0F;
+					for (auto const& it : m_rays)
+						sum += kd.get_closest(it, nullptr).t;
+					g_sink = sum;
+				});
+				c.nodes = kd.nodes().size();
+				c.sah_cost = kd.compute_tree_stats().sah_cost;
+
+				r.candidates.push_back(c);
+			}
+		}
+
+		//the fastest build plus render
+		r.best = 0;
+		for (size_t i = 1; i < r.candidates.size(); i++)
+			if (r.candidates[i].total_ms() < r.candidates[r.best].total_ms())
+				r.best = i;
+
+		return r;
+	}
+
+/**
+* @brief	times steps down the tree and triangle tests on a built tree
+* @param	kdtree const& kd
+* @param	int repetitions
+* @return		kdtree_tuner::measured_costs
+**/
+	kdtree_tuner::measured_costs kdtree_tuner::measure_costs(kdtree const& kd, int repetitions) const
+	{
+		measured_costs costs{ 0.0, 0.0 };
+
+		auto const& nodes = kd.nodes();
+		if (nodes.empty() || m_rays.empty())
+			return costs;
+
+		//walks from the root to the leaf holding points along the rays, the way a traversal goes down
+		//(points spread over the part of the ray inside the tree, so the walks do not repeat)
+		size_t steps = 0;
+		double nodeMs = best_time(repetitions, [&]() {
+			steps = 0;
+			float sum = 0.0F;
+			for (auto const& it : m_rays)
+			{
+				float tMin = 0.0F;
+				float tMax = std::numeric_limits<float>::max();
+				if (!clip_ray_aabb(it, kd.bounds(), tMin, tMax))
+					continue;
+
+				for (int i = 0; i < c_node_walks; i++)
+				{
+					float t = tMin + (tMax - tMin) * (static_cast<float>(i) + 0.5F) / static_cast<float>(c_node_walks);
+
+					int curr = 0;
+					while (nodes[curr].is_internal())
+					{
+						int axis = nodes[curr].axis();
+						float split = nodes[curr].split();
+
+						//the time of the split, as the traversal computes it
+						float tSplit = (split - it.mP[axis]) / it.mVec[axis];
+						sum += tSplit;
+
+						curr = nodes[curr].next_child() + (it.mP[axis] + it.mVec[axis] * t < split ? 0 : 1);
+						steps++;
+					}
+				}
+			}
+			g_sink = sum;
+		});
+
+		//every sample ray against the first leaf triangles
+		size_t triangleCount = kd.indices().size();
+		size_t tests = 0;
+		double triangleMs = best_time(repetitions, [&]() {
+			tests = 0;
+			float sum = 0.0F;
+			for (auto const& it : m_rays)
+			{
+				for (size_t k = 0; k < triangleCount && tests < c_triangle_tests; k++, tests++)
+					sum += kd.intersect_leaf_triangle(it, k);
+
+				if (tests >= c_triangle_tests)
+					break;
+			}
+			g_sink = sum;
+		});
+
+		if (steps != 0)
+			costs.node_ns = nodeMs * 1e6 / static_cast<double>(steps);
+		if (tests != 0)
+			costs.triangle_ns = triangleMs * 1e6 / static_cast<double>(tests);
+
+		return costs;
+	}
+
+/**
+* @brief	writes a config, one field per line
+* @param	char const* path
+* @param	kdtree::config const& cfg
+* @return		bool
+**/
+	bool kdtree_tuner::save_config(char const* path, kdtree::config const& cfg)
+	{
+		std::ofstream file(path);
+		if (!file)
+			return false;
+
+		file << "# kdtree config, tuned by kdtree_tuner" << std::endl;
+		file << "cost_traversal " << cfg.cost_traversal << std::endl;
+		file << "cost_intersection " << cfg.cost_intersection << std::endl;
+		file << "max_depth " << cfg.max_depth << std::endl;
+		file << "method " << (cfg.method == kdtree::split_method::sweep ? "sweep" : "sampled") << std::endl;
+		file << "split_samples " << cfg.split_samples << std::endl;
+		file << "parallel_threshold " << cfg.parallel_threshold << std::endl;
+		file << "perfect_splits " << cfg.perfect_splits << std::endl;
+
+		return static_cast<bool>(file);
+	}
+
+/**
+* @brief	reads the fields of a config written by save_config, others are left as they are
+* @param	char const* path
+* @param	kdtree::config& cfg
+* @return		bool
+**/
+	bool kdtree_tuner::load_config(char const* path, kdtree::config& cfg)
+	{
+		std::ifstream file(path);
+		if (!file)
+			return false;
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream fields(line);
+			std::string name;
+			if (!(fields >> name) || name[0] == '#')
+				continue;
+
+			//unknown names are skipped, so older files keep loading
+			if (name == "cost_traversal")
+				fields >> cfg.cost_traversal;
+			else if (name == "cost_intersection")
+				fields >> cfg.cost_intersection;
+			else if (name == "max_depth")
+				fields >> cfg.max_depth;
+			else if (name == "split_samples")
+				fields >> cfg.split_samples;
+			else if (name == "parallel_threshold")
+				fields >> cfg.parallel_threshold;
+			else if (name == "perfect_splits")
+				fields >> cfg.perfect_splits;
+			else if (name == "method")
+			{
+				std::string method;
+				fields >> method;
+				cfg.method = method == "sampled" ? kdtree::split_method::sampled : kdtree::split_method::sweep;
+			}
+		}
+
+		return true;
+	}
+
+/**
+* @brief	writes the measured costs and the timings of every config, marking the best one
+* @param	std::ostream& os
+* @param	result const& r
+* @return		void
+**/
+	void kdtree_tuner::write_report(std::ostream& os, result const& r)
+	{
+		os << "node step:     " << std::fixed << std::setprecision(2) << r.costs.node_ns << " ns" << std::endl;
+		os << "triangle test: " << r.costs.triangle_ns << " ns" << std::endl;
+		os << std::endl;
+
+		os << std::setw(6) << "depth" << std::setw(12) << "c_inter" << std::setw(12) << "build ms" << std::setw(12) << "render ms"
+		   << std::setw(12) << "total ms" << std::setw(12) << "nodes" << std::setw(12) << "SAH" << std::endl;
+
+		for (size_t i = 0; i < r.candidates.size(); i++)
+		{
+			candidate const& c = r.candidates[i];
+			os << std::setw(6) << c.cfg.max_depth << std::setw(12) << c.cfg.cost_intersection << std::setw(12) << c.build_ms
+			   << std::setw(12) << c.render_ms << std::setw(12) << c.total_ms() << std::setw(12) << c.nodes << std::setw(12) << c.sah_cost
+			   << (i == r.best ? "  <- best" : "") << std::endl;
+		}
+	}
+}
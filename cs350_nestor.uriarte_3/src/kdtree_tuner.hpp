@@ -0,0 +1,108 @@
+/**
+* @file		 kdtree_tuner.hpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the definition of the kdtree_tuner, finds the kdtree config of a scene by timing it
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#pragma once
+#include <iosfwd>
+#include <vector>
+#include "kdtree.hpp"
+
+namespace cs350 {
+
+    /**
+     * Tunes the kdtree config of a scene on the current machine. It first measures what a node step and
+     * a triangle test cost, which gives the cost_intersection / cost_traversal ratio to start from, then
+     * builds and traces trees around it, keeping the config with the lowest build plus render time.
+     */
+    class kdtree_tuner
+    {
+      public:
+        /**
+         * Configs to try
+         */
+        struct settings
+        {
+            std::vector<int>   depths              = {16, 20, 24, 28, 32};
+            std::vector<float> intersection_scales = {0.5f, 1.0f, 2.0f, 4.0f}; // applied to the measured ratio
+            kdtree::config     base;                                          // the rest of the fields
+            // Rays of the render tuned for, the sample rays time is scaled to it (0 uses the sample rays)
+            size_t render_rays = 0;
+            // Times each measure is repeated, keeping the fastest
+            int repetitions = 3;
+        };
+
+        /**
+         * Time of a step down the tree and of a triangle test
+         */
+        struct measured_costs
+        {
+            double node_ns;
+            double triangle_ns;
+        };
+
+        /**
+         * Timings of a config
+         */
+        struct candidate
+        {
+            kdtree::config cfg;
+            double         build_ms;
+            double         render_ms;
+            size_t         nodes;
+            float          sah_cost;
+
+            [[nodiscard]] double total_ms() const noexcept { return build_ms + render_ms; }
+        };
+
+        /**
+         * Outcome of a tuning
+         */
+        struct result
+        {
+            measured_costs         costs;
+            std::vector<candidate> candidates;
+            size_t                 best;
+
+            [[nodiscard]] kdtree::config const& best_config() const { return candidates[best].cfg; }
+        };
+
+        /**
+         * @param triangles, of the scene
+         * @param rays, sample of the rays of the render (primary rays of a smaller image are fine)
+         */
+        kdtree_tuner(kdtree::triangle_container const& triangles, std::vector<ray> const& rays);
+
+        /**
+         * Measures the costs and times every config of the settings
+         * @param s
+         * @return result
+         */
+        result run(settings const& s) const;
+
+        /**
+         * Measures the costs on a built tree
+         * @param kd
+         * @param repetitions
+         * @return measured_costs
+         */
+        measured_costs measure_costs(kdtree const& kd, int repetitions) const;
+
+        /**
+         * Plain text config, one "name value" per line. Loading leaves missing fields as they are
+         * @param path
+         * @param cfg
+         * @return bool, false if the file can not be opened
+         */
+        static bool save_config(char const* path, kdtree::config const& cfg);
+        static bool load_config(char const* path, kdtree::config& cfg);
+
+        static void write_report(std::ostream& os, result const& r);
+
+      private:
+        kdtree::position_container m_positions; // Copied once, every build of the tuning reads them
+        std::vector<ray> const&    m_rays;
+    };
+}
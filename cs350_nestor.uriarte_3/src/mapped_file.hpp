@@ -0,0 +1,48 @@
+/**
+* @file		 mapped_file.hpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the definition of the mapped_file, a read only view of a whole file
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#pragma once
+#include <cstddef>
+
+namespace cs350 {
+
+    /**
+     * Read only memory mapping of a whole file, unmapped when destroyed
+     */
+    class mapped_file
+    {
+      public:
+        mapped_file() = default;
+        explicit mapped_file(char const* path);
+        ~mapped_file();
+
+        // Disallow copy, the mapping has a single owner
+        mapped_file(const mapped_file&) = delete;
+        void operator=(const mapped_file&) = delete;
+
+        /**
+         * Maps the file, closing any previous one
+         * @param path
+         * @return bool, false if the file can not be opened or is empty
+         */
+        bool open(char const* path);
+        void close() noexcept;
+
+        [[nodiscard]] bool             is_open() const noexcept { return m_data != nullptr; }
+        [[nodiscard]] std::byte const* data() const noexcept { return m_data; }
+        [[nodiscard]] size_t           size() const noexcept { return m_size; }
+
+      private:
+        std::byte const* m_data = nullptr;
+        size_t           m_size = 0;
+#ifdef _WIN32
+        // File and mapping handles
+        void* m_file    = nullptr;
+        void* m_mapping = nullptr;
+#endif
+    };
+}
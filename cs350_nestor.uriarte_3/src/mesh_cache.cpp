@@ -0,0 +1,194 @@
+/**
+* @file		 mesh_cache.cpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the implementation of the mesh_cache
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include "mesh.hpp"
+#include "mesh_cache.hpp"
+
+namespace cs350 {
+
+	//the triangles are viewed in place, as the floats of their vertices
+	static_assert(std::is_trivially_copyable_v<triangle>);
+	static_assert(sizeof(triangle) == 9 * sizeof(float) && alignof(triangle) == alignof(float));
+
+/**
+* @brief	gets the path of the cache of an .obj, the same one with the .tris extension
+* @param	char const* path
+* @return		std::filesystem::path
+**/
+	static std::filesystem::path cache_path(char const* path)
+	{
+		return std::filesystem::path(path).replace_extension(".tris");
+	}
+
+/**
+* @brief	bounds of some triangles, empty at the origin if there are none
+* @param	std::span<triangle const> triangles
+* @return		aabb
+**/
+	static aabb compute_bounds(std::span<triangle const> triangles)
+	{
+		aabb bounds;
+		if (!triangles.empty())
+			bounds = aabb(triangles[0][0], triangles[0][0]);
+
+		for (auto const& it : triangles)
+		{
+			for (auto const& pt : it.points)
+			{
+				bounds.mMin = glm::min(bounds.mMin, pt);
+				bounds.mMax = glm::max(bounds.mMax, pt);
+			}
+		}
+
+		return bounds;
+	}
+
+/**
+* @brief	constructor, loading the triangles of the given .obj
+* @param	char const* path
+**/
+	mesh_cache::mesh_cache(char const* path)
+	{
+		open(path);
+	}
+
+/**
+* @brief	maps the cache of an .obj if it is newer than it, otherwise loads the .obj and writes its cache
+* @param	char const* path
+* @return		bool, whether they were mapped from the cache
+**/
+	bool mesh_cache::open(char const* path)
+	{
+		std::filesystem::path cachePath = cache_path(path);
+
+		//a cache with no .obj next to it is used as well
+		std::error_code error;
+		auto cacheTime = std::filesystem::last_write_time(cachePath, error);
+		bool upToDate = !error;
+		if (upToDate)
+		{
+			auto objTime = std::filesystem::last_write_time(path, error);
+			upToDate = error || cacheTime >= objTime;
+		}
+
+		if (upToDate && open_cache(cachePath.string().c_str()))
+			return true;
+
+		//loading the .obj, the cache can not be written on read only folders
+		clear();
+		m_loaded = load_obj(path);
+		m_triangles = m_loaded;
+
+		m_bounds = compute_bounds(m_triangles);
+
+		save(cachePath.string().c_str(), m_triangles);
+		return false;
+	}
+
+/**
+* @brief	maps a cache file and views its triangles
+* @param	char const* cache_path
+* @return		bool, false if it is missing or broken
+**/
+	bool mesh_cache::open_cache(char const* cache_path)
+	{
+		clear();
+
+		//the format is little endian
+		if constexpr (std::endian::native != std::endian::little)
+			return false;
+
+		file_header header;
+		if (!m_file.open(cache_path) || m_file.size() < sizeof(header))
+		{
+			clear();
+			return false;
+		}
+
+		std::memcpy(&header, m_file.data(), sizeof(header));
+
+		//another format, or a truncated file
+		if (header.magic != c_file_magic || header.version != c_file_version ||
+			m_file.size() != sizeof(header) + header.triangle_count * sizeof(triangle))
+		{
+			clear();
+			return false;
+		}
+
+		//the header keeps the floats after it aligned
+		m_triangles = { reinterpret_cast<triangle const*>(m_file.data() + sizeof(header)), static_cast<size_t>(header.triangle_count) };
+		m_bounds = aabb(glm::vec3(header.bounds[0], header.bounds[1], header.bounds[2]), glm::vec3(header.bounds[3], header.bounds[4], header.bounds[5]));
+		return true;
+	}
+
+/**
+* @brief	writes the cache of some triangles, to a temporary file first so a cache is never mapped half written
+* @param	char const* cache_path
+* @param	std::span<triangle const> triangles
+* @return		bool, false if it can not be written
+**/
+	bool mesh_cache::save(char const* cache_path, std::span<triangle const> triangles)
+	{
+		if constexpr (std::endian::native != std::endian::little)
+			return false;
+
+		file_header header{};
+		header.magic = c_file_magic;
+		header.version = c_file_version;
+		header.triangle_count = triangles.size();
+
+		aabb bounds = compute_bounds(triangles);
+		for (int i = 0; i < 3; i++)
+		{
+			header.bounds[i] = bounds.mMin[i];
+			header.bounds[i + 3] = bounds.mMax[i];
+		}
+
+		std::string temporary = std::string(cache_path) + ".tmp";
+		bool written = false;
+		{
+			std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+			if (file)
+			{
+				file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+				file.write(reinterpret_cast<char const*>(triangles.data()), static_cast<std::streamsize>(triangles.size_bytes()));
+				written = static_cast<bool>(file);
+			}
+		}
+
+		std::error_code error;
+		if (written)
+			std::filesystem::rename(temporary, cache_path, error);
+
+		//not leaving the temporary file behind
+		if (!written || error)
+		{
+			std::filesystem::remove(temporary, error);
+			return false;
+		}
+
+		return true;
+	}
+
+/**
+* @brief	drops the mapping and the loaded triangles
+* @return		void
+**/
+	void mesh_cache::clear() noexcept
+	{
+		m_file.close();
+		m_loaded.clear();
+		m_triangles = {};
+		m_bounds = aabb();
+	}
+}
@@ -0,0 +1,78 @@
+/**
+* @file		 mesh_cache.hpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the definition of the mesh_cache, the binary cache of the triangles of an .obj
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "geometry.hpp"
+#include "mapped_file.hpp"
+
+namespace cs350 {
+
+    /**
+     * Triangles of an .obj loaded through its binary cache, the .tris file next to it. The cache is mapped
+     * and viewed in place when it is newer than the .obj, otherwise the .obj is loaded and the cache
+     * written again for the next time. The file holds a header and the vertices as plain floats.
+     */
+    class mesh_cache
+    {
+      public:
+        static constexpr uint32_t c_file_magic   = 0x53495254;
+        static constexpr uint32_t c_file_version = 1;
+
+        mesh_cache() = default;
+        explicit mesh_cache(char const* path);
+
+        // Disallow copy, the view points into the mapping
+        mesh_cache(const mesh_cache&) = delete;
+        void operator=(const mesh_cache&) = delete;
+
+        /**
+         * Loads the triangles of an .obj, dropping the previous ones
+         * @param path, of the .obj
+         * @return bool, whether they were mapped from the cache
+         */
+        bool open(char const* path);
+
+        /**
+         * Maps a cache file alone
+         * @param cache_path
+         * @return bool, false if it is missing or broken (nothing is loaded then)
+         */
+        bool open_cache(char const* cache_path);
+
+        [[nodiscard]] std::span<triangle const> triangles() const noexcept { return m_triangles; }
+        [[nodiscard]] aabb const&               bounds() const noexcept { return m_bounds; }
+        [[nodiscard]] bool                      is_mapped() const noexcept { return m_file.is_open(); }
+
+        /**
+         * Writes the cache of some triangles
+         * @param cache_path
+         * @param triangles
+         * @return bool, false if it can not be written
+         */
+        static bool save(char const* cache_path, std::span<triangle const> triangles);
+
+      private:
+        struct file_header
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t triangle_count;
+            float    bounds[6];
+        };
+
+        void clear() noexcept;
+
+        mapped_file               m_file;
+        // Triangles of the .obj when the cache is out of date
+        std::vector<triangle>     m_loaded;
+        std::span<triangle const> m_triangles;
+        aabb                      m_bounds;
+    };
+}
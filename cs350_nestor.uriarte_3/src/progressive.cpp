@@ -0,0 +1,145 @@
+/**
+* @file		 progressive.cpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the implementation of the progressive render
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include "progressive.hpp"
+#include "texture.hpp"
+#include "tile_scheduler.hpp"
+
+namespace cs350 {
+
+/**
+* @brief	clears the buffer to the given size
+* @param	unsigned width
+* @param	unsigned height
+* @return		void
+**/
+	void accumulation_buffer::resize(unsigned width, unsigned height)
+	{
+		m_width = width;
+		m_height = height;
+		m_samples = 0;
+		m_sums.assign(static_cast<size_t>(width) * height, glm::vec3(0.0F));
+	}
+
+/**
+* @brief	writes the average of every pixel as 0xrrggbbaa
+* @param	texture* dst
+* @return		void
+**/
+	void accumulation_buffer::resolve(texture* dst) const
+	{
+		//nothing accumulated yet
+		if (m_samples == 0)
+			return;
+
+		float scale = 1.0F / static_cast<float>(m_samples);
+		for (unsigned y = 0; y < m_height; y++)
+		{
+			for (unsigned x = 0; x < m_width; x++)
+			{
+				glm::vec3 color = glm::clamp(m_sums[y * m_width + x] * scale, glm::vec3(0.0F), glm::vec3(1.0F));
+
+				unsigned r = static_cast<unsigned>(color.x * 255.0F + 0.5F);
+				unsigned g = static_cast<unsigned>(color.y * 255.0F + 0.5F);
+				unsigned b = static_cast<unsigned>(color.z * 255.0F + 0.5F);
+				dst->set_pixel(x, y, r << 24 | g << 16 | b << 8 | 0xFFu);
+			}
+		}
+	}
+
+/**
+* @brief	prepares a render on the given texture
+* @param	texture* dst
+* @param	raytracing_config const& cfg
+**/
+	progressive_render::progressive_render(texture* dst, raytracing_config const& cfg) : m_dst(dst), m_cfg(cfg)
+	{
+		m_buffer.resize(dst->width(), dst->height());
+	}
+
+/**
+* @brief	renders passes of one sample per pixel until a stop condition
+* @param	sample_function const& fn
+* @param	pass_function const& on_pass
+* @return		unsigned
+**/
+	unsigned progressive_render::run(sample_function const& fn, pass_function const& on_pass)
+	{
+		//nothing but a stop from another thread would end it
+		if (m_cfg.progressive_samples == 0 && m_cfg.time_budget_ms == 0 && !on_pass)
+			throw std::invalid_argument("progressive_render::run: no sample count, time budget or pass callback");
+
+		auto start = std::chrono::steady_clock::now();
+		tile_scheduler scheduler(m_buffer.width(), m_buffer.height(), m_cfg.tile_size, m_cfg.threads);
+
+		//a stop before running (or from a previous run) is kept until reset
+		while (!m_stop)
+		{
+			//enough samples
+			unsigned sample = m_buffer.samples();
+			if (m_cfg.progressive_samples != 0 && sample >= m_cfg.progressive_samples)
+				break;
+
+			//one sample per pixel, tiles do not overlap so workers add to different pixels
+			scheduler.run([&](tile const& t, unsigned worker) {
+				for (unsigned y = t.y0; y < t.y1; y++)
+					for (unsigned x = t.x0; x < t.x1; x++)
+						m_buffer.add(x, y, fn(x, y, sample, worker));
+			});
+			m_buffer.end_pass();
+
+			//updating the image
+			{
+				std::lock_guard<std::mutex> lock(m_image_mutex);
+				m_buffer.resolve(m_dst);
+			}
+			m_samples = m_buffer.samples();
+
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+			if (m_cfg.show_progress)
+				std::cout << "\rpass " << m_samples << " (" << elapsed << "ms)" << std::flush;
+
+			if (on_pass && !on_pass(*m_dst, m_samples))
+				break;
+
+			//out of time, checked between passes so every pixel has the same samples
+			if (m_cfg.time_budget_ms != 0 && elapsed >= m_cfg.time_budget_ms)
+				break;
+		}
+
+		if (m_cfg.show_progress)
+			std::cout << std::endl;
+
+		return m_samples;
+	}
+
+/**
+* @brief	clears the accumulated samples and a pending stop, to render again
+* @return		void
+**/
+	void progressive_render::reset()
+	{
+		m_buffer.resize(m_buffer.width(), m_buffer.height());
+		m_samples = 0;
+		m_stop = false;
+	}
+
+/**
+* @brief	copies the last image, can be called while running
+* @param	texture* out
+* @return		void
+**/
+	void progressive_render::copy_image(texture* out) const
+	{
+		std::lock_guard<std::mutex> lock(m_image_mutex);
+		*out = *m_dst;
+	}
+}
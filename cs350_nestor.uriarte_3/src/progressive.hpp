@@ -0,0 +1,119 @@
+/**
+* @file		 progressive.hpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the definition of the progressive render, passes of one sample per pixel
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#pragma once
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "math.hpp"
+#include "raytracer.hpp"
+
+namespace cs350 {
+
+    /**
+     * Sum of the samples of every pixel, resolved to their average
+     */
+    class accumulation_buffer
+    {
+      public:
+        /**
+         * Clears every pixel
+         * @param width
+         * @param height
+         */
+        void resize(unsigned width, unsigned height);
+
+        /**
+         * Adds a sample of the current pass to a pixel (different pixels can be added from different threads)
+         * @param x
+         * @param y
+         * @param color
+         */
+        void add(unsigned x, unsigned y, glm::vec3 const& color) { m_sums[y * m_width + x] += color; }
+
+        /**
+         * Ends a pass, every pixel must have got a sample on it
+         */
+        void end_pass() noexcept { m_samples++; }
+
+        /**
+         * Writes the average of every pixel, clamped to [0, 1]
+         * @param dst, same size as the buffer
+         */
+        void resolve(texture* dst) const;
+
+        [[nodiscard]] unsigned samples() const noexcept { return m_samples; }
+        [[nodiscard]] unsigned width() const noexcept { return m_width; }
+        [[nodiscard]] unsigned height() const noexcept { return m_height; }
+
+      private:
+        std::vector<glm::vec3> m_sums;
+        unsigned               m_width   = 0;
+        unsigned               m_height  = 0;
+        unsigned               m_samples = 0;
+    };
+
+    /**
+     * Renders a usable image quickly and refines it: each pass adds one sample per pixel (on the tile
+     * scheduler), and the texture is updated from the accumulation after every pass. It stops once the
+     * config progressive_samples or time_budget_ms are reached, when the pass callback returns false,
+     * or when stop() is called from another thread.
+     */
+    class progressive_render
+    {
+      public:
+        /**
+         * Color of a sample of a pixel. Using sample (and not a shared generator) for the random numbers
+         * makes the image the same whatever the amount of workers
+         */
+        using sample_function = std::function<glm::vec3(unsigned x, unsigned y, unsigned sample, unsigned worker)>;
+
+        /**
+         * Called on the rendering thread after each pass with the updated image, returns false to stop
+         */
+        using pass_function = std::function<bool(texture const& image, unsigned samples)>;
+
+        progressive_render(texture* dst, raytracing_config const& cfg);
+
+        /**
+         * Renders passes until one of the stop conditions, adding to the samples of previous runs.
+         * Throws std::invalid_argument when there is none (no sample count, time budget or on_pass)
+         * @param fn
+         * @param on_pass, optional
+         * @return unsigned, samples per pixel of the image
+         */
+        unsigned run(sample_function const& fn, pass_function const& on_pass = {});
+
+        /**
+         * Stops after the current pass (from any thread). Also stops a run that has not started yet,
+         * until reset
+         */
+        void stop() noexcept { m_stop = true; }
+
+        /**
+         * Clears the samples and a pending stop, to render again from scratch
+         */
+        void reset();
+
+        /**
+         * Polling from other threads while running: samples of the last image and a copy of it
+         */
+        [[nodiscard]] unsigned samples() const noexcept { return m_samples; }
+        void                   copy_image(texture* out) const;
+
+      private:
+        texture*            m_dst;
+        accumulation_buffer m_buffer;
+        raytracing_config   m_cfg;
+
+        std::atomic<bool>     m_stop{false};
+        std::atomic<unsigned> m_samples{0};
+        // Guards m_dst while it is resolved
+        mutable std::mutex m_image_mutex;
+    };
+}
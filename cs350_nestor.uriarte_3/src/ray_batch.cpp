@@ -0,0 +1,111 @@
+/**
+* @file		 ray_batch.cpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the implementation of the ray_batch
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#include <algorithm>
+#include "ray_batch.hpp"
+
+namespace cs350 {
+
+/**
+* @brief	adds a ray, traced after the ones already added until sorted
+* @param	ray const& r
+* @param	float max_t
+* @return		size_t
+**/
+	size_t ray_batch::add(ray const& r, float max_t)
+	{
+		size_t index = m_rays.size();
+		m_rays.push_back(r);
+		m_max_times.push_back(max_t);
+		m_order.push_back(static_cast<unsigned>(index));
+		return index;
+	}
+
+/**
+* @brief	removes every ray, keeping the memory
+* @return		void
+**/
+	void ray_batch::clear() noexcept
+	{
+		m_rays.clear();
+		m_max_times.clear();
+		m_order.clear();
+	}
+
+/**
+* @brief	orders the rays by their key, rays with the same key stay in the order they were added
+* @return		void
+**/
+	void ray_batch::sort()
+	{
+		if (m_rays.empty())
+			return;
+
+		//the Morton codes cover the bounds of the origins of the batch
+		aabb bounds(m_rays[0].mP, m_rays[0].mP);
+		for (auto const& it : m_rays)
+		{
+			bounds.mMin = glm::min(bounds.mMin, it.mP);
+			bounds.mMax = glm::max(bounds.mMax, it.mP);
+		}
+
+		m_keys.clear();
+		for (unsigned i = 0; i < m_rays.size(); i++)
+			m_keys.push_back({ sort_key(m_rays[i], bounds), i });
+
+		std::sort(m_keys.begin(), m_keys.end());
+
+		for (size_t i = 0; i < m_keys.size(); i++)
+			m_order[i] = m_keys[i].second;
+	}
+
+/**
+* @brief	gets the key of a ray, the octant of its direction and the Morton code of its origin
+* @param	ray const& r
+* @param	aabb const& bounds
+* @return		uint64_t
+**/
+	uint64_t ray_batch::sort_key(ray const& r, aabb const& bounds)
+	{
+		//a bit per negative component
+		uint64_t octant = (r.mVec.x < 0.0F ? 1u : 0u) | (r.mVec.y < 0.0F ? 2u : 0u) | (r.mVec.z < 0.0F ? 4u : 0u);
+
+		//origin quantized to the cells of the bounds
+		const float cells = static_cast<float>((1u << c_morton_bits) - 1);
+		uint32_t cell[3];
+		for (int k = 0; k < 3; k++)
+		{
+			float extent = bounds.mMax[k] - bounds.mMin[k];
+			float t = extent > 0.0F ? (r.mP[k] - bounds.mMin[k]) / extent : 0.0F;
+			cell[k] = static_cast<uint32_t>(std::clamp(t, 0.0F, 1.0F) * cells);
+		}
+
+		return octant << (3 * c_morton_bits) | morton(cell[0], cell[1], cell[2]);
+	}
+
+/**
+* @brief	interleaves the bits of three 10 bit coordinates
+* @param	uint32_t x
+* @param	uint32_t y
+* @param	uint32_t z
+* @return		uint32_t
+**/
+	uint32_t ray_batch::morton(uint32_t x, uint32_t y, uint32_t z)
+	{
+		//moves each bit of the lower 10 two positions apart
+		auto spread = [](uint32_t v) {
+			v &= 0x3FF;
+			v = (v | (v << 16)) & 0x030000FF;
+			v = (v | (v << 8)) & 0x0300F00F;
+			v = (v | (v << 4)) & 0x030C30C3;
+			v = (v | (v << 2)) & 0x09249249;
+			return v;
+		};
+
+		return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+	}
+}
@@ -0,0 +1,62 @@
+/**
+* @file		 ray_batch.hpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the definition of the ray_batch, secondary rays gathered to be traced in a coherent order
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "geometry.hpp"
+
+namespace cs350 {
+
+    /**
+     * Secondary rays (reflections, shadows) gathered before tracing them. Sorting them by direction octant
+     * and then by the Morton code of their origin makes consecutive rays walk the same kdtree nodes.
+     * Rays keep the index they were added with, the scene writes the result of each one at that index.
+     */
+    class ray_batch
+    {
+      public:
+        // Bits per axis of the Morton code of the origins
+        static constexpr int c_morton_bits = 10;
+
+        /**
+         * Adds a ray
+         * @param r
+         * @param max_t, shadow rays only count hits before it
+         * @return size_t, index of the result of the ray
+         */
+        size_t add(ray const& r, float max_t = std::numeric_limits<float>::max());
+        void   clear() noexcept;
+
+        /**
+         * Orders the rays by direction octant and origin, until then they are traced as added
+         */
+        void sort();
+
+        [[nodiscard]] size_t                       size() const noexcept { return m_rays.size(); }
+        [[nodiscard]] std::vector<ray> const&      rays() const noexcept { return m_rays; }
+        [[nodiscard]] std::vector<float> const&    max_times() const noexcept { return m_max_times; }
+        [[nodiscard]] std::vector<unsigned> const& order() const noexcept { return m_order; }
+
+        /**
+         * Key of a ray: octant (3 MSB) and Morton code of its origin inside the bounds
+         * @param r
+         * @param bounds
+         * @return uint64_t
+         */
+        static uint64_t sort_key(ray const& r, aabb const& bounds);
+        static uint32_t morton(uint32_t x, uint32_t y, uint32_t z);
+
+      private:
+        std::vector<ray>      m_rays;
+        std::vector<float>    m_max_times;
+        std::vector<unsigned> m_order;
+        // Key and index of every ray while sorting (kept to not allocate on every batch)
+        std::vector<std::pair<uint64_t, unsigned>> m_keys;
+    };
+}
@@ -16,6 +16,54 @@ namespace cs350 {
         unsigned kdtree_build_duration_ms{};
     };
 
+    /**
+     * Adds the counters of a worker to the ones of the render (durations of the whole render are left as they are)
+     * @param lhs
+     * @param rhs
+     * @return raytracing_stats&
+     */
+    inline raytracing_stats& operator+=(raytracing_stats& lhs, raytracing_stats const& rhs)
+    {
+        lhs.queries += rhs.queries;
+        lhs.intersection_tests += rhs.intersection_tests;
+        lhs.positive_tests += rhs.positive_tests;
+        lhs.negative_tests += rhs.negative_tests;
+        return lhs;
+    }
+
+    /**
+     * Counters of the queries the prebuilt raytrace() does not know about. raytracing_stats (and the
+     * raytracing_config holding it) keep the layout raytrace() was built with, so they are added here
+     */
+    struct raytracing_query_stats : raytracing_stats
+    {
+        unsigned occlusion_queries{};
+        unsigned occlusion_tests{};
+        unsigned occlusion_hits{};
+        // Secondary rays traced through ray batches, and the time spent on them (summed over workers)
+        unsigned secondary_rays{};
+        unsigned secondary_batches{};
+        unsigned secondary_duration_us{};
+    };
+
+    /**
+     * Adds the counters of a worker, along with the raytracing_stats ones
+     * @param lhs
+     * @param rhs
+     * @return raytracing_query_stats&
+     */
+    inline raytracing_query_stats& operator+=(raytracing_query_stats& lhs, raytracing_query_stats const& rhs)
+    {
+        static_cast<raytracing_stats&>(lhs) += rhs;
+        lhs.occlusion_queries += rhs.occlusion_queries;
+        lhs.occlusion_tests += rhs.occlusion_tests;
+        lhs.occlusion_hits += rhs.occlusion_hits;
+        lhs.secondary_rays += rhs.secondary_rays;
+        lhs.secondary_batches += rhs.secondary_batches;
+        lhs.secondary_duration_us += rhs.secondary_duration_us;
+        return lhs;
+    }
+
     struct raytracing_config
     {
         raytracing_stats stats;
@@ -31,6 +79,16 @@ namespace cs350 {
         // Debug
         bool show_progress{};
         bool use_kdtree{};
+
+        // The prebuilt raytrace() was built with the fields above, new ones go after these
+
+        // Scheduling: the image is rendered by tiles, workers keep their own stats merged at the end
+        unsigned threads{};      // 0 uses every core
+        unsigned tile_size = 16; // pixels
+
+        // Limits of progressive_render, passes of one sample per pixel (0 is no limit)
+        unsigned progressive_samples = 64;
+        unsigned time_budget_ms{};
     };
 
     void raytrace(texture* dst, scene const& scene, camera const& camera, raytracing_config& cfg);
@@ -1,13 +1,34 @@
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <stdexcept>
 #include "scene.hpp"
 #include "texture.hpp"
-#include "mesh.hpp"
+#include "mesh_cache.hpp"
 #include "raytracer.hpp"
 #include "kdtree.hpp"
 #include <iostream>
 
 namespace cs350 {
 
+    namespace {
+        glm::mat4 compose(glm::vec3 p, glm::vec3 r, glm::vec3 s)
+        {
+            glm::mat4 translation = glm::translate(p);
+            glm::mat4 rotation    = glm::toMat4(glm::normalize(glm::quat(glm::radians(r))));
+            glm::mat4 scale       = glm::scale(s);
+            return translation * rotation * scale;
+        }
+
+        // Same times on both spaces, as the direction is not normalized
+        ray to_instance_space(ray const& r, scene_instance const& instance)
+        {
+            glm::vec3 p = glm::vec3(instance.w2m * glm::vec4(r.mP, 1.0f));
+            glm::vec3 v = glm::vec3(instance.w2m * glm::vec4(r.mVec, 0.0f));
+            return ray(p, v);
+        }
+    }
+
     scene::scene()
     {
         // Air
@@ -30,12 +51,25 @@ namespace cs350 {
         m_lights.push_back(light);
     }
 
-    void scene::add_mesh(char const* path, glm::mat4 const& m2w, unsigned material_index)
+    unsigned scene::add_mesh(char const* path, glm::mat4 const& m2w, unsigned material_index)
     {
-        // Load mesh
-        auto triangles = load_obj(path);
+        if (material_index >= m_materials.size())
+            throw std::out_of_range("scene::add_mesh: no such material");
+
+        // Load mesh, through its binary cache
+        mesh_cache cache(path);
+        scene_mesh mesh{};
+        mesh.local.assign(cache.triangles().begin(), cache.triangles().end());
+        mesh.first = m_triangles.size();
+        mesh.count = mesh.local.size();
+        mesh.m2w   = m2w;
+        // Not on the kdtree yet
+        mesh.dirty = true;
+
         // Transform triangles
-        for (auto& geometry : triangles) {
+        m_triangles.reserve(m_triangles.size() + mesh.count);
+        m_positions.reserve(m_positions.size() + mesh.count);
+        for (auto geometry : mesh.local) {
             for (auto& pt : geometry.points) {
                 // Transform point
                 pt = glm::vec3(m2w * glm::vec4(pt, 1.0f));
@@ -44,24 +78,100 @@ namespace cs350 {
             // Submit triangle
             scene_triangle triangle{};
             triangle.geometry = geometry;
-            triangle.material = m_materials.at(material_index);
+            triangle.material = m_materials[material_index];
             m_triangles.push_back(triangle);
+            m_positions.push_back(geometry);
+        }
+
+        m_meshes.push_back(std::move(mesh));
+        return static_cast<unsigned>(m_meshes.size() - 1);
+    }
+
+    unsigned scene::add_mesh(char const* path, glm::vec3 p, glm::vec3 r, glm::vec3 s, unsigned material_index)
+    {
+        return add_mesh(path, compose(p, r, s), material_index);
+    }
+
+    unsigned scene::add_mesh(char const* path, glm::vec3 p, glm::vec3 r, glm::vec3 s, material const& material)
+    {
+        add_material(material);
+        return add_mesh(path, p, r, s, m_materials.size() - 1);
+    }
+
+    void scene::set_mesh_transform(unsigned mesh, glm::mat4 const& m2w)
+    {
+        scene_mesh& m = m_meshes.at(mesh);
+
+        // Its triangles on the kdtree are left there, impossible to hit (dirty ones are not on it)
+        if (!m.dirty && !m_kdtree.nodes().empty())
+            m_kdtree.remove_triangles(m.first, m.count);
+        m.dirty = true;
+        m.m2w   = m2w;
+
+        // Transform triangles again from the mesh space
+        for (size_t i = 0; i < m.count; i++) {
+            auto& geometry = m_triangles[m.first + i].geometry;
+            geometry       = m.local[i];
+            for (auto& pt : geometry.points)
+                pt = glm::vec3(m2w * glm::vec4(pt, 1.0f));
+            m_positions[m.first + i] = geometry;
+        }
+    }
+
+    unsigned scene::add_instance(char const* path, glm::mat4 const& m2w, unsigned material_index)
+    {
+        if (material_index >= m_materials.size())
+            throw std::out_of_range("scene::add_instance: no such material");
+
+        // Load the mesh the first time it is placed
+        auto it = m_shared_paths.find(path);
+        if (it == m_shared_paths.end()) {
+            mesh_cache        cache(path);
+            scene_shared_mesh mesh{};
+            mesh.triangles.assign(cache.triangles().begin(), cache.triangles().end());
+
+            // Bounds in its space, the ones of the instances are made from them
+            mesh.bounds = cache.bounds();
+
+            it = m_shared_paths.emplace(path, static_cast<unsigned>(m_shared_meshes.size())).first;
+            m_shared_meshes.push_back(std::move(mesh));
         }
+
+        scene_instance instance{};
+        instance.mesh     = it->second;
+        instance.material = m_materials[material_index];
+        m_instances.push_back(instance);
+
+        unsigned index = static_cast<unsigned>(m_instances.size() - 1);
+        set_instance_transform(index, m2w);
+        return index;
     }
 
-    void scene::add_mesh(char const* path, glm::vec3 p, glm::vec3 r, glm::vec3 s, unsigned material_index)
+    unsigned scene::add_instance(char const* path, glm::vec3 p, glm::vec3 r, glm::vec3 s, unsigned material_index)
     {
-        glm::mat4 translation = glm::translate(p);
-        glm::mat4 rotation    = glm::toMat4(glm::normalize(glm::quat(glm::radians(r))));
-        glm::mat4 scale       = glm::scale(s);
-        glm::mat4 m2w         = translation * rotation * scale;
-        add_mesh(path, m2w, material_index);
+        return add_instance(path, compose(p, r, s), material_index);
     }
 
-    void scene::add_mesh(char const* path, glm::vec3 p, glm::vec3 r, glm::vec3 s, material const& material)
+    unsigned scene::add_instance(char const* path, glm::vec3 p, glm::vec3 r, glm::vec3 s, material const& material)
     {
         add_material(material);
-        add_mesh(path, p, r, s, m_materials.size() - 1);
+        return add_instance(path, p, r, s, m_materials.size() - 1);
+    }
+
+    void scene::set_instance_transform(unsigned instance, glm::mat4 const& m2w)
+    {
+        scene_instance& i = m_instances.at(instance);
+        i.m2w             = m2w;
+        i.w2m             = glm::inverse(m2w);
+
+        // World bounds of the corners of the mesh bounds
+        aabb const& local = m_shared_meshes[i.mesh].bounds;
+        for (int c = 0; c < 8; c++) {
+            glm::vec3 corner{c & 1 ? local.mMax.x : local.mMin.x, c & 2 ? local.mMax.y : local.mMin.y, c & 4 ? local.mMax.z : local.mMin.z};
+            glm::vec3 pt     = glm::vec3(m2w * glm::vec4(corner, 1.0f));
+            i.bounds.mMin    = c == 0 ? pt : glm::min(i.bounds.mMin, pt);
+            i.bounds.mMax    = c == 0 ? pt : glm::max(i.bounds.mMax, pt);
+        }
     }
 
     void scene::add_cubemap(const char* dir)
@@ -81,7 +191,95 @@ namespace cs350 {
 
     void scene::build_kdtree(cs350::kdtree::config config)
     {
-        m_kdtree.build(m_triangles, config);
+        m_kdtree_config = config;
+        sync_positions();
+        m_kdtree.build(m_positions, config);
+        clear_dirty();
+        build_instances(true);
+    }
+
+    void scene::build_kdtree(cs350::kdtree::config config, char const* cache_path)
+    {
+        m_kdtree_config = config;
+        sync_positions();
+
+        // Reuse the saved tree if it was built from this scene and config
+        if (!m_kdtree.load(cache_path, m_positions, config)) {
+            m_kdtree.build(m_positions, config);
+            m_kdtree.save(cache_path);
+        }
+        clear_dirty();
+        build_instances(true);
+    }
+
+    void scene::update_kdtree()
+    {
+        size_t dirty = 0;
+        for (auto const& m : m_meshes)
+            dirty += m.dirty ? m.count : 0;
+
+        // Nothing to merge into, or the secondary tree would cost about as much as the whole scene
+        if (m_kdtree.nodes().empty() || static_cast<float>(dirty) > m_merge_fraction * static_cast<float>(m_triangles.size())) {
+            sync_positions();
+            m_kdtree.build(m_positions, m_kdtree_config);
+            clear_dirty();
+        } else {
+            // Secondary tree of the dirty meshes only
+            kdtree::position_container triangles;
+            triangles.reserve(dirty);
+            m_secondary_indices.clear();
+            for (auto const& m : m_meshes) {
+                if (!m.dirty)
+                    continue;
+                for (size_t i = m.first; i < m.first + m.count; i++) {
+                    triangles.push_back(m_positions[i]);
+                    m_secondary_indices.push_back(i);
+                }
+            }
+
+            if (!triangles.empty())
+                m_secondary_kdtree.build(triangles, m_kdtree_config);
+        }
+
+        // Shared meshes do not change in their space, only the new ones are built
+        build_instances(false);
+    }
+
+    void scene::sync_positions()
+    {
+        m_positions.resize(m_triangles.size());
+        for (size_t i = 0; i < m_triangles.size(); i++)
+            m_positions[i] = m_triangles[i].geometry;
+    }
+
+    void scene::clear_dirty()
+    {
+        for (auto& m : m_meshes)
+            m.dirty = false;
+        m_secondary_indices.clear();
+    }
+
+    void scene::build_instances(bool rebuild_meshes)
+    {
+        for (auto& mesh : m_shared_meshes) {
+            if (rebuild_meshes || mesh.kdtree.nodes().empty())
+                mesh.kdtree.build(mesh.triangles, m_kdtree_config);
+        }
+
+        // The top level is cheap, always built again
+        std::vector<aabb> bounds;
+        bounds.reserve(m_instances.size());
+        for (auto const& instance : m_instances)
+            bounds.push_back(instance.bounds);
+        m_instance_tree.build(bounds);
+    }
+
+    bool scene::is_occluded_instance(ray const& r, float max_t, kdtree::debug_stats& kdstats) const
+    {
+        return m_instance_tree.any(r, max_t, [&](unsigned index) {
+            scene_instance const& instance = m_instances[index];
+            return m_shared_meshes[instance.mesh].kdtree.occluded(to_instance_space(r, instance), max_t, &kdstats);
+        });
     }
 
     scene_intersection scene::get_closest_bf(ray const& r, raytracing_stats& stats) const
@@ -90,12 +288,14 @@ namespace cs350 {
         // Get closest intersection
         scene_intersection result{};
         result.intersection_time = std::numeric_limits<float>::max();
-        for (auto const& t : m_triangles) {
+        // The positions stream through the cache, the material is only read for the closest hit
+        size_t count = std::min(m_positions.size(), m_triangles.size());
+        for (size_t i = 0; i < count; i++) {
             stats.intersection_tests++;
-            float intersection = intersection_ray_triangle(r, t.geometry);
+            float intersection = intersection_ray_triangle(r, m_positions[i]);
             if (intersection >= 0.0f) {
                 if (intersection < result.intersection_time) {
-                    result.triangle          = &t;
+                    result.triangle          = &m_triangles[i];
                     result.intersection_time = intersection;
                 }
                 stats.positive_tests++;
@@ -113,15 +313,184 @@ namespace cs350 {
         // Get closest intersection
         kdtree::debug_stats kdstats      = {};
         auto                intersection = m_kdtree.get_closest(r, &kdstats);
+        size_t              index        = intersection.triangle_index;
 
-        stats.intersection_tests += kdstats.intersection_queries;
-        stats.positive_tests += kdstats.intersection_positive_queries;
+        // Dirty meshes are on the secondary tree
+        if (!m_secondary_indices.empty()) {
+            auto secondary = m_secondary_kdtree.get_closest(r, &kdstats);
+            if (secondary.t >= 0.0f && (intersection.t < 0.0f || secondary.t < intersection.t)) {
+                intersection.t = secondary.t;
+                index          = m_secondary_indices[secondary.triangle_index];
+            }
+        }
 
         // Convert
         scene_intersection result{};
-        result.triangle          = &m_triangles[intersection.triangle_index];
+        result.triangle          = &m_triangles[index];
         result.intersection_time = intersection.t;
 
+        stats.intersection_tests += kdstats.intersection_queries;
+        stats.positive_tests += kdstats.intersection_positive_queries;
+        stats.negative_tests += kdstats.intersection_queries - kdstats.intersection_positive_queries;
+
+        return result;
+    }
+
+    void scene::get_closest_kdtree_packet(ray const* rays, int count, scene_intersection* results, raytracing_stats& stats) const
+    {
+        stats.queries += count;
+
+        // Get closest intersections
+        kdtree::debug_stats   kdstats = {};
+        kdtree::intersection intersections[kdtree::c_packet_size];
+        m_kdtree.get_closest_packet(rays, count, intersections, &kdstats);
+
+        // Dirty meshes are on the secondary tree, its hits are kept as scene indices
+        if (!m_secondary_indices.empty()) {
+            kdtree::intersection secondary[kdtree::c_packet_size];
+            m_secondary_kdtree.get_closest_packet(rays, count, secondary, &kdstats);
+            for (int i = 0; i < count; i++) {
+                if (secondary[i].t >= 0.0f && (intersections[i].t < 0.0f || secondary[i].t < intersections[i].t)) {
+                    intersections[i].t              = secondary[i].t;
+                    intersections[i].triangle_index = m_secondary_indices[secondary[i].triangle_index];
+                }
+            }
+        }
+
+        // Convert
+        for (int i = 0; i < count; i++) {
+            results[i].triangle          = &m_triangles[intersections[i].triangle_index];
+            results[i].intersection_time = intersections[i].t;
+        }
+
+        stats.intersection_tests += kdstats.intersection_queries;
+        stats.positive_tests += kdstats.intersection_positive_queries;
+        stats.negative_tests += kdstats.intersection_queries - kdstats.intersection_positive_queries;
+    }
+
+    bool scene::is_occluded(ray const& r, float max_t, raytracing_query_stats& stats) const
+    {
+        stats.occlusion_queries++;
+
+        // Without a kdtree, first hit of the brute force
+        if (m_kdtree.nodes().empty()) {
+            for (auto const& t : m_positions) {
+                stats.occlusion_tests++;
+                float intersection = intersection_ray_triangle(r, t);
+                if (intersection >= 0.0f && intersection <= max_t) {
+                    stats.occlusion_hits++;
+                    return true;
+                }
+            }
+            for (auto const& instance : m_instances) {
+                ray local = to_instance_space(r, instance);
+                for (auto const& t : m_shared_meshes[instance.mesh].triangles) {
+                    stats.occlusion_tests++;
+                    float intersection = intersection_ray_triangle(local, t);
+                    if (intersection >= 0.0f && intersection <= max_t) {
+                        stats.occlusion_hits++;
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        // First hit of the kdtree
+        kdtree::debug_stats kdstats  = {};
+        bool                occluded = m_kdtree.occluded(r, max_t, &kdstats);
+
+        // Dirty meshes are on the secondary tree
+        if (!occluded && !m_secondary_indices.empty())
+            occluded = m_secondary_kdtree.occluded(r, max_t, &kdstats);
+        if (!occluded && !m_instances.empty())
+            occluded = is_occluded_instance(r, max_t, kdstats);
+
+        stats.occlusion_tests += kdstats.intersection_queries;
+        stats.occlusion_hits += occluded;
+
+        return occluded;
+    }
+
+    scene_instance_intersection scene::get_closest_instance(ray const& r, bool use_kdtree, raytracing_stats& stats) const
+    {
+        stats.queries++;
+
+        scene_instance_intersection result{};
+        result.intersection_time = -1.0f;
+
+        // Every triangle of every instance, in the space of their mesh
+        if (!use_kdtree) {
+            for (auto const& instance : m_instances) {
+                ray local = to_instance_space(r, instance);
+                for (auto const& t : m_shared_meshes[instance.mesh].triangles) {
+                    stats.intersection_tests++;
+                    float intersection = intersection_ray_triangle(local, t);
+                    if (intersection >= 0.0f) {
+                        if (result.triangle == nullptr || intersection < result.intersection_time) {
+                            result.triangle          = &t;
+                            result.intersection_time = intersection;
+                            result.instance          = &instance;
+                        }
+                        stats.positive_tests++;
+                    } else {
+                        stats.negative_tests++;
+                    }
+                }
+            }
+            return result;
+        }
+
+        // Top level front to back, the kdtree of each mesh in its space
+        kdtree::debug_stats kdstats = {};
+        m_instance_tree.closest(r, std::numeric_limits<float>::max(), [&](unsigned index, float best_t) {
+            scene_instance const&    instance = m_instances[index];
+            scene_shared_mesh const& mesh     = m_shared_meshes[instance.mesh];
+
+            auto hit = mesh.kdtree.get_closest(to_instance_space(r, instance), &kdstats);
+            if (hit.t < 0.0f || hit.t > best_t)
+                return -1.0f;
+
+            result.triangle          = &mesh.triangles[hit.triangle_index];
+            result.intersection_time = hit.t;
+            result.instance          = &instance;
+            return hit.t;
+        });
+
+        stats.intersection_tests += kdstats.intersection_queries;
+        stats.positive_tests += kdstats.intersection_positive_queries;
+        stats.negative_tests += kdstats.intersection_queries - kdstats.intersection_positive_queries;
+
         return result;
     }
-}
\ No newline at end of file
+
+    void scene::get_closest_batch(ray_batch const& batch, bool use_kdtree, std::vector<scene_intersection>& results, raytracing_query_stats& stats) const
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        // Traced in the order of the batch, each result at the index of its ray
+        results.resize(batch.size());
+        for (unsigned i : batch.order())
+            results[i] = use_kdtree ? get_closest_kdtree(batch.rays()[i], stats) : get_closest_bf(batch.rays()[i], stats);
+
+        auto end = std::chrono::steady_clock::now();
+        stats.secondary_rays += static_cast<unsigned>(batch.size());
+        stats.secondary_batches++;
+        stats.secondary_duration_us += static_cast<unsigned>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    }
+
+    void scene::is_occluded_batch(ray_batch const& batch, std::vector<unsigned char>& results, raytracing_query_stats& stats) const
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        // Traced in the order of the batch, each result at the index of its ray
+        results.resize(batch.size());
+        for (unsigned i : batch.order())
+            results[i] = is_occluded(batch.rays()[i], batch.max_times()[i], stats);
+
+        auto end = std::chrono::steady_clock::now();
+        stats.secondary_rays += static_cast<unsigned>(batch.size());
+        stats.secondary_batches++;
+        stats.secondary_duration_us += static_cast<unsigned>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    }
+}
@@ -1,13 +1,28 @@
 #pragma once
 
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include "camera.hpp"
+#include "instance_tree.hpp"
 #include "kdtree.hpp"
+#include "ray_batch.hpp"
 #include "texture.hpp"
 #include "scene_data.hpp"
 
 namespace cs350 {
     struct raytracing_stats;
+    struct raytracing_query_stats;
+
+    /**
+     * Mesh loaded once and placed by instances, with its kdtree in its own space
+     */
+    struct scene_shared_mesh
+    {
+        std::vector<triangle> triangles; // Geometry only, the material is the one of each instance
+        aabb                  bounds;
+        cs350::kdtree         kdtree;
+    };
 
     class scene
     {
@@ -18,6 +33,20 @@ namespace cs350 {
         cs350::kdtree               m_kdtree;
         std::array<texture, 6>      m_cubemap;
         material                    m_air_material{};
+        // The prebuilt code was built with the members above and their sizes (kdtree checks its own), new ones go after these
+        std::vector<scene_mesh>     m_meshes;
+        // Geometry of m_triangles alone, 36 bytes a triangle, what the brute force and the kdtree builds read
+        std::vector<triangle>       m_positions;
+        cs350::kdtree::config       m_kdtree_config{};
+        // Dirty meshes, traced along the kdtree until they are merged into it
+        cs350::kdtree               m_secondary_kdtree;
+        std::vector<size_t>         m_secondary_indices; // Scene triangle of every triangle of the secondary tree
+        float                       m_merge_fraction = 0.25f;
+        // Two levels: a kdtree per shared mesh, and the instances over them
+        std::vector<scene_shared_mesh>            m_shared_meshes;
+        std::unordered_map<std::string, unsigned> m_shared_paths;
+        std::vector<scene_instance>               m_instances;
+        cs350::instance_tree                      m_instance_tree;
 
       public:
         scene();
@@ -27,19 +56,85 @@ namespace cs350 {
 
         void add_material(material mat);
         void add_light(scene_light light);
-        void add_mesh(char const* path, glm::mat4 const& m2w, unsigned material_index);
-        void add_mesh(char const* path, glm::vec3 p, glm::vec3 r, glm::vec3 s, unsigned material_index);
-        void add_mesh(char const* path, glm::vec3 p, glm::vec3 r, glm::vec3 s, material const& material);
-        void add_cubemap(char const* dir);
-        void build_kdtree(cs350::kdtree::config config);
+        unsigned add_mesh(char const* path, glm::mat4 const& m2w, unsigned material_index);
+        unsigned add_mesh(char const* path, glm::vec3 p, glm::vec3 r, glm::vec3 s, unsigned material_index);
+        unsigned add_mesh(char const* path, glm::vec3 p, glm::vec3 r, glm::vec3 s, material const& material);
+
+        /**
+         * Places a mesh without copying its triangles. Instances of the same file share them and their kdtree,
+         * rays are taken to the space of the mesh to trace them. They are traced by get_closest_instance and
+         * is_occluded only, get_closest_bf/get_closest_kdtree give the triangles of the scene. The prebuilt
+         * raytrace() does not draw them, render with direct_lighting_sample (direct_render.hpp) to see them
+         * @param path
+         * @param m2w
+         * @param material_index
+         * @return unsigned, index of the instance
+         */
+        unsigned add_instance(char const* path, glm::mat4 const& m2w, unsigned material_index);
+        unsigned add_instance(char const* path, glm::vec3 p, glm::vec3 r, glm::vec3 s, unsigned material_index);
+        unsigned add_instance(char const* path, glm::vec3 p, glm::vec3 r, glm::vec3 s, material const& material);
+
+        /**
+         * Moves an instance, update_kdtree has to be called before tracing again (it only rebuilds the top level)
+         * @param instance
+         * @param m2w
+         */
+        void set_instance_transform(unsigned instance, glm::mat4 const& m2w);
+
+        void     add_cubemap(char const* dir);
+        void     build_kdtree(cs350::kdtree::config config);
+        void     build_kdtree(cs350::kdtree::config config, char const* cache_path);
+
+        /**
+         * Moves a mesh, marking it dirty. Its triangles on the kdtree stop being hit right away,
+         * update_kdtree has to be called before tracing again
+         * @param mesh, index returned by add_mesh
+         * @param m2w
+         */
+        void set_mesh_transform(unsigned mesh, glm::mat4 const& m2w);
+
+        /**
+         * Brings the kdtree up to date with the dirty meshes. They are built into a secondary tree, so the
+         * cost is the one of the edited meshes, until they are more than the merge fraction of the scene
+         * and everything is rebuilt. Builds with the config of the last build_kdtree
+         */
+        void update_kdtree();
+        void set_merge_fraction(float fraction) { m_merge_fraction = fraction; }
 
         scene_intersection get_closest_bf(ray const& r, raytracing_stats& stats) const;
         scene_intersection get_closest_kdtree(ray const& r, raytracing_stats& stats) const;
+        void               get_closest_kdtree_packet(ray const* rays, int count, scene_intersection* results, raytracing_stats& stats) const;
+        bool               is_occluded(ray const& r, float max_t, raytracing_query_stats& stats) const;
+
+        /**
+         * Closest hit of the instances. Kept apart from get_closest_kdtree, whose hits the prebuilt shading
+         * reads as world space triangles of the scene
+         * @param r
+         * @param use_kdtree, through the two levels or testing every triangle of every instance
+         * @param stats
+         * @return scene_instance_intersection, the triangle in the space of its mesh (see world_geometry)
+         */
+        scene_instance_intersection get_closest_instance(ray const& r, bool use_kdtree, raytracing_stats& stats) const;
+
+        /**
+         * Traces every ray of a batch (sort it first for coherent traversal)
+         * @param batch
+         * @param use_kdtree
+         * @param results, resized to the batch, one per ray in the order they were added
+         * @param stats
+         */
+        void get_closest_batch(ray_batch const& batch, bool use_kdtree, std::vector<scene_intersection>& results, raytracing_query_stats& stats) const;
+        void is_occluded_batch(ray_batch const& batch, std::vector<unsigned char>& results, raytracing_query_stats& stats) const;
 
         void set_air_material(decltype(m_air_material) const& m) { m_air_material = m; }
 
+        /**
+         * Triangles of the scene, with their material. Materials can be edited in place, changes to the geometry
+         * or the order are seen by get_closest_bf and the kdtree after the next build_kdtree (see positions)
+         */
         [[nodiscard]] decltype(m_triangles) const&    triangles() const noexcept { return m_triangles; }
         [[nodiscard]] decltype(m_triangles)&          triangles() noexcept { return m_triangles; }
+        [[nodiscard]] decltype(m_positions) const&    positions() const noexcept { return m_positions; }
         [[nodiscard]] decltype(m_materials) const&    materials() const noexcept { return m_materials; }
         [[nodiscard]] decltype(m_materials)&          materials() noexcept { return m_materials; }
         [[nodiscard]] decltype(m_lights)&             lights() noexcept { return m_lights; }
@@ -47,6 +142,21 @@ namespace cs350 {
         [[nodiscard]] decltype(m_air_material) const& air_material() const noexcept { return m_air_material; }
         [[nodiscard]] decltype(m_kdtree) const&       kdtree() const noexcept { return m_kdtree; }
         [[nodiscard]] decltype(m_kdtree)&             kdtree() noexcept { return m_kdtree; }
+        [[nodiscard]] decltype(m_kdtree) const&       secondary_kdtree() const noexcept { return m_secondary_kdtree; }
+        [[nodiscard]] decltype(m_meshes) const&       meshes() const noexcept { return m_meshes; }
+        [[nodiscard]] decltype(m_shared_meshes) const& shared_meshes() const noexcept { return m_shared_meshes; }
+        [[nodiscard]] decltype(m_instances) const&    instances() const noexcept { return m_instances; }
+        [[nodiscard]] decltype(m_instance_tree) const& instance_tree() const noexcept { return m_instance_tree; }
         [[nodiscard]] decltype(m_cubemap) const&      cubemap() const noexcept { return m_cubemap; }
+
+      private:
+        // Copies the geometry of m_triangles again, it may have been edited through triangles()
+        void sync_positions();
+        // Every mesh is on the kdtree again
+        void clear_dirty();
+        // Builds the kdtrees of the shared meshes (all of them, or only the new ones) and the top level
+        void build_instances(bool rebuild_meshes);
+
+        bool is_occluded_instance(ray const& r, float max_t, cs350::kdtree::debug_stats& kdstats) const;
     };
 }
\ No newline at end of file
@@ -13,6 +13,24 @@ namespace cs350 {
         glm::vec3&       operator[](int index) { return geometry[index]; }
     };
 
+    struct scene_mesh
+    {
+        size_t                first; // First of its triangles in the scene
+        size_t                count;
+        glm::mat4             m2w;
+        std::vector<triangle> local; // Triangles before the transform, to move it
+        bool                  dirty; // Added or moved since the last full build of the kdtree
+    };
+
+    struct scene_instance
+    {
+        unsigned        mesh; // Shared mesh placed
+        glm::mat4       m2w;
+        glm::mat4       w2m;
+        aabb            bounds; // World bounds
+        cs350::material material;
+    };
+
     struct scene_light
     {
         glm::vec3 position;
@@ -29,4 +47,29 @@ namespace cs350 {
     };
     static_assert(std::is_trivial<scene_intersection>());
     static_assert(std::is_standard_layout<scene_intersection>());
+
+    /**
+     * Hit of an instance, the triangle is the one of its shared mesh (in the space of the mesh)
+     */
+    struct scene_instance_intersection
+    {
+        cs350::triangle const* triangle;
+        float                  intersection_time;
+        scene_instance const*  instance;
+
+        bool operator()() const { return triangle != nullptr && intersection_time >= 0.0f; }
+
+        // Hit triangle in world space
+        cs350::triangle world_geometry() const
+        {
+            cs350::triangle result = *triangle;
+            for (auto& pt : result.points)
+                pt = glm::vec3(instance->m2w * glm::vec4(pt, 1.0f));
+            return result;
+        }
+
+        cs350::material const& surface_material() const { return instance->material; }
+    };
+    static_assert(std::is_trivial<scene_instance_intersection>());
+    static_assert(std::is_standard_layout<scene_instance_intersection>());
 }
\ No newline at end of file
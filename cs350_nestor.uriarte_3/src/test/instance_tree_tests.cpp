@@ -0,0 +1,76 @@
+#include "common.hpp"
+#include "instance_tree.hpp"
+
+namespace cs350 {
+    namespace {
+        // Unit boxes along +x, one every two units
+        std::vector<aabb> row_of_boxes(int count)
+        {
+            std::vector<aabb> boxes;
+            for (int i = 0; i < count; ++i)
+                boxes.emplace_back(glm::vec3{2.0f * i, 0, 0}, glm::vec3{2.0f * i + 1, 1, 1});
+            return boxes;
+        }
+    }
+
+    TEST(instance_tree, every_instance_in_a_leaf)
+    {
+        instance_tree tree;
+        tree.build(row_of_boxes(37));
+
+        std::vector<int> seen(37, 0);
+        for (auto const& n : tree.nodes()) {
+            ASSERT_LE(n.count, instance_tree::c_leaf_size);
+            for (unsigned i = n.first; n.is_leaf() && i < n.first + n.count; ++i)
+                seen[tree.items()[i]]++;
+        }
+        for (int count : seen)
+            ASSERT_EQ(count, 1);
+    }
+
+    TEST(instance_tree, closest_visits_front_to_back)
+    {
+        auto          boxes = row_of_boxes(64);
+        instance_tree tree;
+        tree.build(boxes);
+
+        // Along the row from the right, every box is hit at its max x
+        glm::vec3             origin{200, 0.5f, 0.5f};
+        ray                   r(origin, {-1, 0, 0});
+        std::vector<unsigned> traced;
+        float                 t = tree.closest(r, 1000.0f, [&](unsigned index, float) {
+            traced.push_back(index);
+            return origin.x - boxes[index].mMax.x;
+        });
+
+        ASSERT_FLOAT_EQ(t, 200.0f - 127.0f);
+        // Only the leaf of the nearest box and its neighbour are traced
+        ASSERT_LE(traced.size(), 2 * instance_tree::c_leaf_size);
+    }
+
+    TEST(instance_tree, misses)
+    {
+        instance_tree tree;
+        tree.build(row_of_boxes(8));
+
+        glm::vec3 origin{0, 5, 0};
+        ray       r(origin, {1, 0, 0});
+        ASSERT_LT(tree.closest(r, 1000.0f, [](unsigned, float) { return 0.0f; }), 0.0f);
+        ASSERT_FALSE(tree.any(r, 1000.0f, [](unsigned) { return true; }));
+
+        instance_tree empty;
+        empty.build({});
+        ASSERT_FALSE(empty.any(r, 1000.0f, [](unsigned) { return true; }));
+    }
+
+    TEST(instance_tree, any_stops_at_max_t)
+    {
+        instance_tree tree;
+        tree.build(row_of_boxes(8));
+
+        glm::vec3 origin{-10, 0.5f, 0.5f};
+        ray       r(origin, {1, 0, 0});
+        ASSERT_FALSE(tree.any(r, 5.0f, [](unsigned) { return true; }));
+        ASSERT_TRUE(tree.any(r, 15.0f, [](unsigned index) { return index == 0; }));
+    }
+}
@@ -0,0 +1,587 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include "common.hpp"
+#include "kdtree.hpp"
+
+namespace cs350 {
+    namespace {
+        // Small triangles in [-1, 1], with a few long ones crossing many nodes
+        kdtree::triangle_container random_triangles(int count, unsigned seed)
+        {
+            std::mt19937                          rng(seed);
+            std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+            std::uniform_real_distribution<float> offset(-0.05f, 0.05f);
+
+            kdtree::triangle_container triangles;
+            for (int i = 0; i < count; ++i) {
+                glm::vec3 p{position(rng), position(rng), position(rng)};
+                float     size = i % 50 == 0 ? 10.0f : 1.0f;
+
+                scene_triangle t{};
+                t.geometry = triangle(p, p + size * glm::vec3{offset(rng), offset(rng), offset(rng)}, p + size * glm::vec3{offset(rng), offset(rng), offset(rng)});
+                triangles.push_back(t);
+            }
+            return triangles;
+        }
+
+        kdtree::config test_config()
+        {
+            kdtree::config cfg{};
+            cfg.cost_intersection = 80;
+            cfg.cost_traversal    = 1;
+            cfg.max_depth         = 20;
+            return cfg;
+        }
+
+        // Rays from around the triangles (some of them inside the tree bounds) in every direction
+        std::vector<ray> random_rays(int count, unsigned seed)
+        {
+            std::mt19937                          rng(seed);
+            std::uniform_real_distribution<float> position(-2.0f, 2.0f);
+            std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+
+            std::vector<ray> rays;
+            for (int i = 0; i < count; ++i) {
+                glm::vec3 origin{position(rng), position(rng), position(rng)};
+                glm::vec3 dir{direction(rng), direction(rng), direction(rng)};
+                // Aimed at the triangles half of the time, so most of them hit something
+                if (i % 2 == 0)
+                    dir = glm::vec3{direction(rng), direction(rng), direction(rng)} * 0.5f - origin;
+                rays.emplace_back(origin, glm::normalize(dir));
+            }
+            return rays;
+        }
+
+        // Closest hit testing every triangle
+        kdtree::intersection brute_force(kdtree::triangle_container const& triangles, ray const& r)
+        {
+            kdtree::intersection closest{0, -1.0f};
+            for (size_t i = 0; i < triangles.size(); ++i) {
+                float t = intersection_ray_triangle(r, triangles[i].geometry);
+                if (t >= 0.0f && (!closest || t < closest.t))
+                    closest = {i, t};
+            }
+            return closest;
+        }
+
+        // Same hit time as testing every triangle, on a triangle hit at that time
+        void assert_matches_brute_force(kdtree const& tree, kdtree::triangle_container const& triangles, std::vector<ray> const& rays)
+        {
+            int hits = 0;
+            for (ray const& r : rays) {
+                kdtree::intersection expected = brute_force(triangles, r);
+                kdtree::intersection result   = tree.get_closest(r, nullptr);
+                ASSERT_EQ(static_cast<bool>(result), static_cast<bool>(expected));
+                if (!expected)
+                    continue;
+                hits++;
+                ASSERT_NEAR(result.t, expected.t, 1e-4f * std::max(1.0f, expected.t));
+                ASSERT_LT(result.triangle_index, triangles.size());
+                ASSERT_NEAR(intersection_ray_triangle(r, triangles[result.triangle_index].geometry), expected.t, 1e-4f * std::max(1.0f, expected.t));
+            }
+            // Not a test of misses only
+            ASSERT_GT(hits, static_cast<int>(rays.size()) / 4);
+        }
+
+        void write_file(char const* path, std::vector<char> const& bytes)
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        }
+
+        std::vector<char> read_file(char const* path)
+        {
+            std::ifstream in(path, std::ios::binary);
+            return std::vector<char>((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        }
+    }
+
+    TEST(kdtree, save_load_round_trip)
+    {
+        auto        triangles = random_triangles(500, 9);
+        const char* path      = "kdtree_test.kdtree";
+
+        kdtree built;
+        built.build(triangles, test_config());
+        ASSERT_TRUE(built.save(path));
+
+        kdtree loaded;
+        ASSERT_TRUE(loaded.load(path, triangles, test_config()));
+        ASSERT_EQ(loaded.nodes().size(), built.nodes().size());
+        ASSERT_EQ(std::memcmp(loaded.nodes().data(), built.nodes().data(), built.nodes().size() * sizeof(kdtree::node)), 0);
+        ASSERT_EQ(loaded.indices(), built.indices());
+        ASSERT_EQ(loaded.triangles().size(), built.triangles().size());
+        for (size_t i = 0; i < built.triangles().size(); ++i)
+            ASSERT_EQ(loaded.triangles()[i].original_index, built.triangles()[i].original_index);
+
+        // Same hits as the built one
+        ray r({0, 0, -5}, {0.01f, 0.02f, 1});
+        auto a = built.get_closest(r, nullptr);
+        auto b = loaded.get_closest(r, nullptr);
+        ASSERT_EQ(a.triangle_index, b.triangle_index);
+        ASSERT_FLOAT_EQ(a.t, b.t);
+        std::remove(path);
+    }
+
+    TEST(kdtree, positions_build_the_same_tree)
+    {
+        auto        triangles = random_triangles(500, 9);
+        auto        positions = kdtree::positions_of(triangles);
+        const char* path      = "kdtree_positions_test.kdtree";
+        ASSERT_EQ(kdtree::hash_input(positions), kdtree::hash_input(triangles));
+
+        kdtree from_triangles;
+        from_triangles.build(triangles, test_config());
+        kdtree from_positions;
+        from_positions.build(positions, test_config());
+        ASSERT_EQ(from_positions.nodes().size(), from_triangles.nodes().size());
+        ASSERT_EQ(std::memcmp(from_positions.nodes().data(), from_triangles.nodes().data(), from_triangles.nodes().size() * sizeof(kdtree::node)), 0);
+        ASSERT_EQ(from_positions.indices(), from_triangles.indices());
+
+        // Saved from one, loaded with the other
+        ASSERT_TRUE(from_triangles.save(path));
+        kdtree loaded;
+        ASSERT_TRUE(loaded.load(path, positions, test_config()));
+        ASSERT_EQ(loaded.indices(), from_triangles.indices());
+        std::remove(path);
+    }
+
+    TEST(kdtree, load_rejects_stale_files)
+    {
+        auto        triangles = random_triangles(500, 9);
+        const char* path      = "kdtree_stale_test.kdtree";
+
+        kdtree built;
+        built.build(triangles, test_config());
+        ASSERT_TRUE(built.save(path));
+
+        // Another config
+        kdtree         loaded;
+        kdtree::config other_config = test_config();
+        other_config.max_depth      = 10;
+        ASSERT_FALSE(loaded.load(path, triangles, other_config));
+
+        // A moved triangle
+        auto moved = triangles;
+        moved[7].geometry[0].x += 0.5f;
+        ASSERT_FALSE(loaded.load(path, moved, test_config()));
+
+        // Truncated and missing
+        auto bytes = read_file(path);
+        bytes.pop_back();
+        write_file(path, bytes);
+        ASSERT_FALSE(loaded.load(path, triangles, test_config()));
+        ASSERT_FALSE(loaded.load("missing_kdtree_test.kdtree", triangles, test_config()));
+        ASSERT_TRUE(loaded.nodes().empty());
+        std::remove(path);
+    }
+
+    TEST(kdtree, load_rejects_broken_trees)
+    {
+        auto        triangles = random_triangles(500, 9);
+        const char* path      = "kdtree_broken_test.kdtree";
+
+        kdtree built;
+        built.build(triangles, test_config());
+        ASSERT_TRUE(built.nodes().front().is_internal());
+        ASSERT_TRUE(built.save(path));
+        auto bytes = read_file(path);
+
+        // The hashes cover the input and the config, not the tree: the root (right after the 48 bytes
+        // of the header) is made to point out of the nodes, then to reference triangles out of the indices
+        size_t root = 48;
+        ASSERT_EQ(std::memcmp(bytes.data() + root, built.nodes().data(), sizeof(kdtree::node)), 0);
+
+        kdtree::node broken;
+        broken.set_internal(0, 0.0f, static_cast<int>(built.nodes().size()));
+        auto child = bytes;
+        std::memcpy(child.data() + root, &broken, sizeof(broken));
+        write_file(path, child);
+
+        kdtree loaded;
+        ASSERT_FALSE(loaded.load(path, triangles, test_config()));
+
+        broken.set_leaf(static_cast<int>(built.indices().size()) - 1, 2);
+        auto leaf = bytes;
+        std::memcpy(leaf.data() + root, &broken, sizeof(broken));
+        write_file(path, leaf);
+        ASSERT_FALSE(loaded.load(path, triangles, test_config()));
+        ASSERT_TRUE(loaded.nodes().empty());
+
+        // A chain of internal nodes as deep as the traversal stacks can hold loads, one more level does not
+        ASSERT_GT(built.nodes().size(), 2u * kdtree::c_max_depth + 2);
+        for (int depth : {kdtree::c_max_depth - 1, kdtree::c_max_depth}) {
+            auto chain = bytes;
+            for (size_t i = 0; i < built.nodes().size(); ++i) {
+                kdtree::node n;
+                if (i % 2 == 0 && i < 2u * depth)
+                    n.set_internal(0, 0.0f, static_cast<int>(i + 2));
+                else
+                    n.set_leaf(0, 0);
+                std::memcpy(chain.data() + root + i * sizeof(kdtree::node), &n, sizeof(n));
+            }
+            write_file(path, chain);
+
+            bool fits = depth < kdtree::c_max_depth;
+            ASSERT_EQ(loaded.load(path, triangles, test_config()), fits);
+            if (fits) {
+                for (ray const& r : random_rays(100, 22))
+                    ASSERT_FALSE(loaded.get_closest(r, nullptr));
+            }
+        }
+
+        // Untouched, it loads
+        write_file(path, bytes);
+        ASSERT_TRUE(loaded.load(path, triangles, test_config()));
+        std::remove(path);
+    }
+
+    TEST(kdtree, parallel_build_matches_serial)
+    {
+        auto triangles = random_triangles(3000, 3);
+
+        // Every node big enough is built (and swept) with tasks, the output has to be the same tree
+        for (auto method : {kdtree::split_method::sweep, kdtree::split_method::sampled}) {
+            kdtree::config serial_config       = test_config();
+            serial_config.method               = method;
+            serial_config.parallel_threshold   = 0;
+            kdtree::config parallel_config     = serial_config;
+            parallel_config.parallel_threshold = 64;
+
+            kdtree serial;
+            kdtree parallel;
+            serial.build(triangles, serial_config);
+            parallel.build(triangles, parallel_config);
+
+            ASSERT_GT(serial.nodes().size(), 1u);
+            ASSERT_EQ(parallel.nodes().size(), serial.nodes().size());
+            ASSERT_EQ(std::memcmp(parallel.nodes().data(), serial.nodes().data(), serial.nodes().size() * sizeof(kdtree::node)), 0);
+            ASSERT_EQ(parallel.indices(), serial.indices());
+        }
+    }
+
+    TEST(kdtree, closest_matches_brute_force)
+    {
+        auto triangles = random_triangles(2000, 1);
+        auto rays      = random_rays(2000, 2);
+
+        kdtree tree;
+        tree.build(triangles, test_config());
+        ASSERT_GT(tree.get_depth(), 1);
+        assert_matches_brute_force(tree, triangles, rays);
+
+        // Shallow and deep trees, the front to back order has to hold on any of them
+        for (int depth : {1, 4, 40}) {
+            kdtree::config cfg = test_config();
+            cfg.max_depth      = depth;
+            tree.build(triangles, cfg);
+            assert_matches_brute_force(tree, triangles, rays);
+        }
+
+        // Rays leaving the bounds, and an empty tree
+        glm::vec3 outside{0.0f, 0.0f, 20.0f};
+        ray       away(outside, glm::vec3{0.0f, 0.0f, 1.0f});
+        ASSERT_FALSE(tree.get_closest(away, nullptr));
+        tree.build(kdtree::triangle_container{}, test_config());
+        ASSERT_FALSE(tree.get_closest(rays.front(), nullptr));
+    }
+
+    TEST(kdtree, sweep_split_matches_brute_force)
+    {
+        auto triangles = random_triangles(2000, 4);
+        auto rays      = random_rays(1000, 5);
+
+        kdtree::config sampled_config = test_config();
+        sampled_config.method         = kdtree::split_method::sampled;
+        kdtree::config sweep_config   = test_config();
+        sweep_config.method           = kdtree::split_method::sweep;
+        sweep_config.perfect_splits   = false;
+
+        kdtree sampled;
+        kdtree sweep;
+        sampled.build(triangles, sampled_config);
+        sweep.build(triangles, sweep_config);
+        assert_matches_brute_force(sampled, triangles, rays);
+        assert_matches_brute_force(sweep, triangles, rays);
+
+        // The sweep picks the cheapest plane among every bound on the three axis, not a few samples on one
+        ASSERT_LT(sweep.compute_tree_stats().sah_cost, sampled.compute_tree_stats().sah_cost);
+    }
+
+    TEST(kdtree, perfect_splits_match_brute_force)
+    {
+        // Many long triangles, crossing most of the planes
+        auto triangles = random_triangles(1000, 6);
+        for (size_t i = 0; i < triangles.size(); i += 10)
+            triangles[i].geometry = triangle(triangles[i].geometry[0], triangles[i].geometry[1] * 8.0f, triangles[i].geometry[2] * -8.0f);
+        auto rays = random_rays(1000, 7);
+
+        kdtree::config clipped_config   = test_config();
+        clipped_config.perfect_splits   = true;
+        kdtree::config unclipped_config = clipped_config;
+        unclipped_config.perfect_splits = false;
+
+        kdtree clipped;
+        kdtree unclipped;
+        clipped.build(triangles, clipped_config);
+        unclipped.build(triangles, unclipped_config);
+        assert_matches_brute_force(clipped, triangles, rays);
+        assert_matches_brute_force(unclipped, triangles, rays);
+
+        // The clipped parts still reference their triangle
+        for (auto const& t : clipped.triangles())
+            ASSERT_LT(t.original_index, triangles.size());
+
+        // Triangles are only referenced by the nodes their clipped bounds overlap
+        ASSERT_LE(clipped.compute_tree_stats().sah_cost, unclipped.compute_tree_stats().sah_cost);
+    }
+
+    TEST(kdtree, packet_matches_scalar)
+    {
+        auto triangles = random_triangles(2000, 8);
+
+        kdtree tree;
+        tree.build(triangles, test_config());
+
+        // Coherent packets (a grid of rays from a camera) and incoherent ones (traced one by one)
+        std::vector<ray> coherent;
+        glm::vec3        eye{0.1f, 0.2f, -4.0f};
+        for (int y = 0; y < 16; ++y)
+            for (int x = 0; x < 16; ++x)
+                coherent.emplace_back(eye, glm::normalize(glm::vec3{(x - 8) * 0.03f, (y - 8) * 0.03f, 1.0f}));
+        auto incoherent = random_rays(256, 9);
+
+        for (auto const* rays : {&coherent, &incoherent}) {
+            // Full packets and a partial one at the end
+            for (size_t first = 0; first < rays->size(); first += kdtree::c_packet_size - 3) {
+                int                  count = static_cast<int>(std::min<size_t>(kdtree::c_packet_size, rays->size() - first));
+                kdtree::intersection results[kdtree::c_packet_size];
+                tree.get_closest_packet(rays->data() + first, count, results, nullptr);
+
+                for (int i = 0; i < count; ++i) {
+                    kdtree::intersection expected = tree.get_closest((*rays)[first + i], nullptr);
+                    ASSERT_EQ(static_cast<bool>(results[i]), static_cast<bool>(expected));
+                    if (expected) {
+                        ASSERT_EQ(results[i].triangle_index, expected.triangle_index);
+                        ASSERT_FLOAT_EQ(results[i].t, expected.t);
+                    }
+                }
+            }
+        }
+    }
+
+    TEST(kdtree, occluded_matches_closest)
+    {
+        auto triangles = random_triangles(2000, 10);
+        auto rays      = random_rays(1000, 11);
+
+        kdtree tree;
+        tree.build(triangles, test_config());
+
+        // Occluded before max_t exactly when the closest hit is, checked away from the hit itself
+        for (ray const& r : rays) {
+            kdtree::intersection closest = tree.get_closest(r, nullptr);
+            if (!closest) {
+                ASSERT_FALSE(tree.occluded(r, std::numeric_limits<float>::max(), nullptr));
+                continue;
+            }
+            ASSERT_TRUE(tree.occluded(r, closest.t * 1.01f + 1e-3f, nullptr));
+            ASSERT_TRUE(tree.occluded(r, std::numeric_limits<float>::max(), nullptr));
+            ASSERT_FALSE(tree.occluded(r, closest.t * 0.99f - 1e-3f, nullptr));
+        }
+    }
+
+    TEST(kdtree, leaf_triangles_match_geometry)
+    {
+        auto triangles = random_triangles(500, 12);
+        auto rays      = random_rays(200, 13);
+
+        kdtree tree;
+        tree.build(triangles, test_config());
+
+        // Every leaf slot intersects as the triangle it was copied from
+        int hits = 0;
+        for (ray const& r : rays) {
+            for (size_t k = 0; k < tree.indices().size(); ++k) {
+                float expected = intersection_ray_triangle(r, tree.triangles()[tree.indices()[k]].tri);
+                float result   = tree.intersect_leaf_triangle(r, k);
+                ASSERT_EQ(result >= 0.0f, expected >= 0.0f);
+                if (expected >= 0.0f) {
+                    ASSERT_NEAR(result, expected, 1e-4f * std::max(1.0f, expected));
+                    hits++;
+                }
+            }
+        }
+        ASSERT_GT(hits, 0);
+    }
+
+    TEST(kdtree, debug_stats_count_the_traversal)
+    {
+        auto triangles = random_triangles(2000, 14);
+        auto rays      = random_rays(500, 15);
+
+        kdtree tree;
+        tree.build(triangles, test_config());
+
+        kdtree::reset_histograms();
+        kdtree::debug_stats total{};
+        for (ray const& r : rays) {
+            kdtree::debug_stats  query{};
+            kdtree::intersection hit = tree.get_closest(r, &query);
+            total += query;
+#if CS350_KDTREE_STATS
+            // A hit was tested on some leaf, and never more triangles than the leaves reference
+            ASSERT_LE(query.intersection_positive_queries, query.intersection_queries);
+            ASSERT_LE(query.intersection_queries, tree.indices().size());
+            ASSERT_LE(query.max_stack_depth, static_cast<size_t>(tree.get_depth()));
+            if (hit) {
+                ASSERT_GE(query.intersection_positive_queries, 1u);
+                ASSERT_GE(query.leaves_visited, 1u);
+                ASSERT_GE(query.nodes_visited, 1u);
+            }
+#else
+            (void)hit;
+            ASSERT_EQ(query.intersection_queries, 0u);
+            ASSERT_EQ(query.nodes_visited, 0u);
+#endif
+        }
+
+#if CS350_KDTREE_STATS
+        // The thread histogram recorded every query with the same counts
+        kdtree::query_histogram histogram = kdtree::collect_histograms();
+        ASSERT_EQ(histogram.queries, rays.size());
+        ASSERT_EQ(histogram.totals.intersection_queries, total.intersection_queries);
+        ASSERT_EQ(histogram.totals.intersection_positive_queries, total.intersection_positive_queries);
+        ASSERT_EQ(histogram.totals.nodes_visited, total.nodes_visited);
+        ASSERT_EQ(histogram.totals.leaves_visited, total.leaves_visited);
+
+        size_t bucketed = 0;
+        for (size_t count : histogram.nodes_visited)
+            bucketed += count;
+        ASSERT_EQ(bucketed, rays.size());
+
+        // A ray missing the tree bounds walks nothing
+        glm::vec3           outside{0.0f, 0.0f, 20.0f};
+        ray                 away(outside, glm::vec3{0.0f, 0.0f, 1.0f});
+        kdtree::debug_stats query{};
+        ASSERT_FALSE(tree.get_closest(away, &query));
+        ASSERT_EQ(query.nodes_visited, 0u);
+        ASSERT_EQ(query.intersection_queries, 0u);
+#endif
+
+        // Power of two buckets
+        ASSERT_EQ(kdtree::query_histogram::bucket(0), 0);
+        ASSERT_EQ(kdtree::query_histogram::bucket(1), 1);
+        ASSERT_EQ(kdtree::query_histogram::bucket(3), 2);
+        ASSERT_EQ(kdtree::query_histogram::bucket(4), 3);
+    }
+
+    TEST(kdtree, node_layout)
+    {
+        auto triangles = random_triangles(2000, 16);
+
+        kdtree tree;
+        tree.build(triangles, test_config());
+        auto const& nodes = tree.nodes();
+        ASSERT_EQ(sizeof(kdtree::node), 8u);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(nodes.data()) % cache_line_allocator<kdtree::node>::c_line_size, 0u);
+        ASSERT_GT(nodes.size(), 2u);
+
+        // The children of a node are after it and next to each other, on the same cache line.
+        // Every node is reached once from the root, but the empty sibling of the root
+        std::vector<int> reached(nodes.size(), 0);
+        reached[0] = 1;
+        reached[1] = 1;
+        ASSERT_TRUE(nodes[1].is_leaf());
+        ASSERT_EQ(nodes[1].primitive_count(), 0);
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (nodes[i].is_leaf()) {
+                ASSERT_LE(static_cast<size_t>(nodes[i].primitive_start() + nodes[i].primitive_count()), tree.indices().size());
+                continue;
+            }
+            size_t child = static_cast<size_t>(nodes[i].next_child());
+            ASSERT_GT(child, i);
+            ASSERT_LT(child + 1, nodes.size());
+            ASSERT_EQ(child / kdtree::c_nodes_per_line, (child + 1) / kdtree::c_nodes_per_line);
+            reached[child]++;
+            reached[child + 1]++;
+        }
+        for (int count : reached)
+            ASSERT_EQ(count, 1);
+
+        assert_matches_brute_force(tree, triangles, random_rays(1000, 17));
+    }
+
+    TEST(kdtree, copies_and_moves)
+    {
+        auto triangles = random_triangles(2000, 18);
+        auto rays      = random_rays(500, 19);
+
+        // The removal tables are part of the state kept outside of the baseline layout
+        kdtree tree;
+        tree.build(triangles, test_config());
+        ASSERT_GT(tree.remove_triangles(0, 10), 0u);
+
+        kdtree copy(tree);
+        kdtree assigned;
+        assigned = copy;
+        for (ray const& r : rays) {
+            kdtree::intersection expected = tree.get_closest(r, nullptr);
+            for (kdtree const* it : {&copy, &assigned}) {
+                kdtree::intersection result = it->get_closest(r, nullptr);
+                ASSERT_EQ(static_cast<bool>(result), static_cast<bool>(expected));
+                if (expected) {
+                    ASSERT_EQ(result.triangle_index, expected.triangle_index);
+                    ASSERT_FLOAT_EQ(result.t, expected.t);
+                }
+            }
+        }
+        ASSERT_EQ(copy.remove_triangles(10, 10), tree.remove_triangles(10, 10));
+
+        // Moved from trees miss everything and can be built again
+        kdtree moved(std::move(copy));
+        ASSERT_FALSE(copy.get_closest(rays.front(), nullptr));
+        ASSERT_EQ(copy.remove_triangles(0, 10), 0u);
+        copy.build(triangles, test_config());
+        assert_matches_brute_force(copy, triangles, rays);
+    }
+
+    TEST(kdtree, rebuilds_reuse_the_scratch_memory)
+    {
+        auto           triangles = random_triangles(3000, 20);
+        kdtree::config cfg       = test_config();
+        // Tasks bring their own scratch memory
+        cfg.parallel_threshold = 0;
+
+        kdtree tree;
+        tree.build(triangles, cfg);
+        kdtree::build_stats first = tree.get_build_stats();
+        ASSERT_GE(first.scratch_allocations, 1u);
+        ASSERT_GT(first.allocations, first.scratch_allocations);
+        ASSERT_GT(first.memory_upper_bound, 0u);
+
+        // The second build reuses the scratch memory and the arrays of the first one
+        tree.build(triangles, cfg);
+        kdtree::build_stats second = tree.get_build_stats();
+        ASSERT_EQ(second.scratch_allocations, 0u);
+        ASSERT_LT(second.allocations, first.allocations);
+
+        // And it stays there
+        tree.build(triangles, cfg);
+        kdtree::build_stats third = tree.get_build_stats();
+        ASSERT_EQ(third.scratch_allocations, 0u);
+        ASSERT_EQ(third.allocations, second.allocations);
+        ASSERT_EQ(third.memory_upper_bound, second.memory_upper_bound);
+        assert_matches_brute_force(tree, triangles, random_rays(500, 21));
+
+        // A copy does not take the scratch memory with it
+        kdtree copy(tree);
+        copy.build(triangles, cfg);
+        ASSERT_GE(copy.get_build_stats().scratch_allocations, 1u);
+    }
+}
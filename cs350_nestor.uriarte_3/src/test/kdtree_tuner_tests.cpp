@@ -0,0 +1,73 @@
+#include <cstdio>
+#include "common.hpp"
+#include "kdtree_tuner.hpp"
+
+namespace {
+    /**
+     * Grid of small triangles on the z=0 plane
+     * @param side
+     * @return cs350::kdtree::triangle_container
+     */
+    cs350::kdtree::triangle_container grid(int side)
+    {
+        cs350::kdtree::triangle_container triangles;
+        for (int y = 0; y < side; ++y)
+            for (int x = 0; x < side; ++x) {
+                cs350::scene_triangle t{};
+                glm::vec3             p{float(x), float(y), 0.0f};
+                t.geometry = cs350::triangle(p, p + glm::vec3{1, 0, 0}, p + glm::vec3{0, 1, 0});
+                triangles.push_back(t);
+            }
+        return triangles;
+    }
+}
+
+namespace cs350 {
+    TEST(kdtree_tuner, config_round_trip)
+    {
+        kdtree::config cfg;
+        cfg.cost_traversal    = 1.0f;
+        cfg.cost_intersection = 3.5f;
+        cfg.max_depth         = 22;
+        cfg.method            = kdtree::split_method::sampled;
+        cfg.perfect_splits    = false;
+
+        const char* path = "kdtree_tuner_test.cfg";
+        ASSERT_TRUE(kdtree_tuner::save_config(path, cfg));
+
+        kdtree::config loaded;
+        ASSERT_TRUE(kdtree_tuner::load_config(path, loaded));
+        ASSERT_FLOAT_EQ(loaded.cost_intersection, 3.5f);
+        ASSERT_EQ(loaded.max_depth, 22);
+        ASSERT_TRUE(loaded.method == kdtree::split_method::sampled);
+        ASSERT_FALSE(loaded.perfect_splits);
+        std::remove(path);
+
+        ASSERT_FALSE(kdtree_tuner::load_config("missing_kdtree_tuner_test.cfg", loaded));
+    }
+
+    TEST(kdtree_tuner, picks_fastest_candidate)
+    {
+        auto             triangles = grid(40);
+        std::vector<ray> rays;
+        for (int y = 0; y < 32; ++y)
+            for (int x = 0; x < 32; ++x) {
+                glm::vec3 origin{x * 1.25f + 0.3f, y * 1.25f + 0.3f, 5.0f};
+                rays.emplace_back(origin, glm::vec3{0.01f, 0.02f, -1.0f});
+            }
+
+        kdtree_tuner::settings settings;
+        settings.depths              = {4, 12};
+        settings.intersection_scales = {1.0f, 2.0f};
+        settings.repetitions         = 1;
+
+        kdtree_tuner tuner(triangles, rays);
+        auto         result = tuner.run(settings);
+        ASSERT_GT(result.costs.node_ns, 0.0);
+        ASSERT_GT(result.costs.triangle_ns, 0.0);
+        ASSERT_EQ(result.candidates.size(), 4u);
+        for (auto const& it : result.candidates)
+            ASSERT_LE(result.candidates[result.best].total_ms(), it.total_ms());
+        ASSERT_EQ(result.best_config().cost_traversal, 1.0f);
+    }
+}
@@ -0,0 +1,71 @@
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include "common.hpp"
+#include "mesh_cache.hpp"
+
+namespace cs350 {
+    namespace {
+        std::vector<triangle> fan(int count)
+        {
+            std::vector<triangle> triangles;
+            for (int i = 0; i < count; ++i)
+                triangles.emplace_back(glm::vec3{0, 0, 0}, glm::vec3{float(i), 1, -2}, glm::vec3{float(i + 1), 1, 3});
+            return triangles;
+        }
+    }
+
+    TEST(mesh_cache, round_trip)
+    {
+        auto        triangles = fan(50);
+        const char* path      = "mesh_cache_test.tris";
+        ASSERT_TRUE(mesh_cache::save(path, triangles));
+
+        // Closed before removing the file
+        {
+            mesh_cache cache;
+            ASSERT_TRUE(cache.open_cache(path));
+            ASSERT_TRUE(cache.is_mapped());
+            ASSERT_EQ(cache.triangles().size(), triangles.size());
+            for (size_t i = 0; i < triangles.size(); ++i)
+                for (int k = 0; k < 3; ++k)
+                    ASSERT_VEC_EQ(cache.triangles()[i][k], triangles[i][k]);
+            ASSERT_VEC_EQ(cache.bounds().mMin, {0, 0, -2});
+            ASSERT_VEC_EQ(cache.bounds().mMax, {50, 1, 3});
+
+            // Newer than the (missing) .obj, so it is mapped instead of loading it
+            mesh_cache from_obj;
+            ASSERT_TRUE(from_obj.open("mesh_cache_test.obj"));
+            ASSERT_EQ(from_obj.triangles().size(), triangles.size());
+        }
+        std::remove(path);
+    }
+
+    TEST(mesh_cache, broken_files_are_rejected)
+    {
+        const char* path = "mesh_cache_broken_test.tris";
+        ASSERT_TRUE(mesh_cache::save(path, fan(10)));
+
+        // Truncated
+        {
+            std::ifstream     in(path, std::ios::binary);
+            std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            in.close();
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(bytes.data(), static_cast<std::streamsize>(bytes.size() - 4));
+        }
+        mesh_cache cache;
+        ASSERT_FALSE(cache.open_cache(path));
+        ASSERT_TRUE(cache.triangles().empty());
+        ASSERT_FALSE(cache.is_mapped());
+
+        // Not a cache
+        {
+            std::ofstream out(path, std::ios::trunc);
+            out << "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n";
+        }
+        ASSERT_FALSE(cache.open_cache(path));
+        ASSERT_FALSE(cache.open_cache("missing_mesh_cache_test.tris"));
+        std::remove(path);
+    }
+}
@@ -0,0 +1,117 @@
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "common.hpp"
+#include "progressive.hpp"
+#include "texture.hpp"
+
+namespace cs350 {
+    TEST(progressive, stops_at_sample_count)
+    {
+        texture image;
+        image.resize(37, 21);
+
+        raytracing_config config{};
+        config.progressive_samples = 4;
+        config.threads             = 2;
+        config.tile_size           = 8;
+
+        unsigned           passes = 0;
+        progressive_render render(&image, config);
+        unsigned           samples = render.run([](unsigned, unsigned, unsigned, unsigned) { return glm::vec3(0.5f); },
+                                      [&](texture const&, unsigned) {
+                                          passes++;
+                                          return true;
+                                      });
+        ASSERT_EQ(samples, 4u);
+        ASSERT_EQ(passes, 4u);
+        ASSERT_EQ(render.samples(), 4u);
+        ASSERT_EQ(image.get_pixel(0, 0), 0x808080ffu);
+        ASSERT_EQ(image.get_pixel(36, 20), 0x808080ffu);
+    }
+
+    TEST(progressive, averages_the_samples)
+    {
+        texture image;
+        image.resize(16, 16);
+
+        raytracing_config config{};
+        config.progressive_samples = 2;
+
+        std::vector<unsigned> intermediate;
+        progressive_render    render(&image, config);
+        render.run([](unsigned, unsigned, unsigned sample, unsigned) { return glm::vec3(sample % 2 == 0 ? 0.0f : 1.0f); },
+                   [&](texture const& t, unsigned) {
+                       intermediate.push_back(t.get_pixel(3, 5));
+                       return true;
+                   });
+        ASSERT_EQ(intermediate.size(), 2u);
+        ASSERT_EQ(intermediate[0], 0x000000ffu);
+        ASSERT_EQ(intermediate[1], 0x808080ffu);
+    }
+
+    TEST(progressive, stopped_by_callback)
+    {
+        texture image;
+        image.resize(8, 8);
+
+        raytracing_config config{};
+        config.progressive_samples = 0;
+
+        progressive_render render(&image, config);
+        unsigned           samples = render.run([](unsigned, unsigned, unsigned, unsigned) { return glm::vec3(1.0f); },
+                                      [](texture const&, unsigned samples) { return samples < 3; });
+        ASSERT_EQ(samples, 3u);
+        ASSERT_EQ(image.get_pixel(7, 7), 0xffffffffu);
+    }
+
+    TEST(progressive, time_budget)
+    {
+        texture image;
+        image.resize(8, 8);
+
+        raytracing_config config{};
+        config.progressive_samples = 0;
+        config.time_budget_ms      = 20;
+
+        // Every pass takes at least a millisecond
+        progressive_render render(&image, config);
+        unsigned           samples = render.run([](unsigned x, unsigned y, unsigned, unsigned) {
+            if (x == 0 && y == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            return glm::vec3(1.0f);
+        });
+        ASSERT_GE(samples, 1u);
+        ASSERT_LE(samples, 21u);
+    }
+
+    TEST(progressive, stopped_before_running)
+    {
+        texture image;
+        image.resize(8, 8);
+
+        raytracing_config config{};
+        config.progressive_samples = 4;
+
+        // A stop issued before the render started is not lost
+        progressive_render render(&image, config);
+        render.stop();
+        ASSERT_EQ(render.run([](unsigned, unsigned, unsigned, unsigned) { return glm::vec3(1.0f); }), 0u);
+
+        render.reset();
+        ASSERT_EQ(render.run([](unsigned, unsigned, unsigned, unsigned) { return glm::vec3(1.0f); }), 4u);
+    }
+
+    TEST(progressive, rejects_no_limit)
+    {
+        texture image;
+        image.resize(8, 8);
+
+        raytracing_config config{};
+        config.progressive_samples = 0;
+        config.time_budget_ms      = 0;
+
+        progressive_render render(&image, config);
+        ASSERT_THROW(render.run([](unsigned, unsigned, unsigned, unsigned) { return glm::vec3(1.0f); }), std::invalid_argument);
+    }
+}
@@ -0,0 +1,53 @@
+#include <algorithm>
+#include "common.hpp"
+#include "ray_batch.hpp"
+
+namespace cs350 {
+    TEST(ray_batch, morton)
+    {
+        ASSERT_EQ(ray_batch::morton(0, 0, 0), 0u);
+        ASSERT_EQ(ray_batch::morton(1, 0, 0), 1u);
+        ASSERT_EQ(ray_batch::morton(0, 1, 0), 2u);
+        ASSERT_EQ(ray_batch::morton(0, 0, 1), 4u);
+        ASSERT_EQ(ray_batch::morton(3, 0, 0), 9u);
+        ASSERT_EQ(ray_batch::morton(1023, 1023, 1023), (1u << 30) - 1);
+    }
+
+    TEST(ray_batch, unsorted_keeps_order)
+    {
+        ray_batch batch;
+        for (int i = 0; i < 10; ++i) {
+            glm::vec3 origin{float(i), 0, 0};
+            ASSERT_EQ(batch.add(ray(origin, {-1, 1, 1})), size_t(i));
+        }
+
+        for (unsigned i = 0; i < 10; ++i)
+            ASSERT_EQ(batch.order()[i], i);
+    }
+
+    TEST(ray_batch, sorted_by_octant_and_origin)
+    {
+        glm::vec3 zero{0, 0, 0}, one{1, 1, 1};
+        ray_batch batch;
+        batch.add(ray(one, {-1, 0, 0}));
+        batch.add(ray(zero, {1, 1, 1}));
+        batch.add(ray(one, {1, 1, 1}));
+        batch.add(ray(zero, {-1, 0, 0}));
+        batch.add(ray(zero, {1, 1, 1}), 2.0f);
+        batch.sort();
+
+        // Positive octant first, origins near the minimum first, ties as added
+        std::vector<unsigned> expected{1, 4, 2, 3, 0};
+        ASSERT_EQ(batch.order(), expected);
+        ASSERT_EQ(batch.max_times()[4], 2.0f);
+
+        // Every key in order
+        aabb bounds({0, 0, 0}, {1, 1, 1});
+        for (size_t i = 1; i < batch.size(); ++i)
+            ASSERT_LE(ray_batch::sort_key(batch.rays()[batch.order()[i - 1]], bounds), ray_batch::sort_key(batch.rays()[batch.order()[i]], bounds));
+
+        batch.clear();
+        ASSERT_EQ(batch.size(), 0u);
+        ASSERT_EQ(batch.order().size(), 0u);
+    }
+}
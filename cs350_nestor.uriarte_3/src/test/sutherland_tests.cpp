@@ -33,7 +33,7 @@ namespace cs350 {
     TEST(sutherland, positive_side)
     {
         // Configuration
-        cs350::plane    plane({1, 0, 0}, {-1, 0, 0});
+        cs350::plane    plane({-1, 0, 0}, {1, 0, 0});
         cs350::triangle tr;
         tr.points[0] = {0, 0, 0};
         tr.points[1] = {2, 1, 0};
@@ -54,7 +54,7 @@ namespace cs350 {
     TEST(sutherland, negative_side)
     {
         // Configuration
-        cs350::plane    plane({1, 0, 0}, {3, 0, 0});
+        cs350::plane    plane({3, 0, 0}, {1, 0, 0});
         cs350::triangle tr;
         tr.points[0] = {0, 0, 0};
         tr.points[1] = {2, 1, 0};
@@ -75,7 +75,7 @@ namespace cs350 {
     TEST(sutherland, positive_touching)
     {
         // Configuration
-        cs350::plane    plane({1, 0, 0}, {0, 0, 0});
+        cs350::plane    plane({0, 0, 0}, {1, 0, 0});
         cs350::triangle tr;
         tr.points[0] = {0, 0, 0};
         tr.points[1] = {2, 1, 0};
@@ -91,7 +91,7 @@ namespace cs350 {
     TEST(sutherland, negative_touching)
     {
         // Configuration
-        cs350::plane    plane({1, 0, 0}, {2, 0, 0});
+        cs350::plane    plane({2, 0, 0}, {1, 0, 0});
         cs350::triangle tr;
         tr.points[0] = {0, 0, 0};
         tr.points[1] = {2, 1, 0};
@@ -123,7 +123,7 @@ namespace cs350 {
     TEST(sutherland, real)
     {
         // Configuration
-        cs350::plane    plane({0, 1, 0}, {-1.13, -3, 5});
+        cs350::plane    plane({-1.13, -3, 5}, {0, 1, 0});
         cs350::triangle tr{};
         tr.points = {{{-5.00, 5.00, 5.00}, {-5.00, -3.00, 3.00}, {-5.00, 5.00, -5.00}}};
 
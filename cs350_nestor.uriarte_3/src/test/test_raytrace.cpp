@@ -1,6 +1,8 @@
 #include <chrono>
+#include <cstring>
 #include <fstream>
 #include "common.hpp"
+#include "direct_render.hpp"
 #include "scene.hpp"
 #include "raytracer.hpp"
 #include "texture.hpp"
@@ -40,6 +42,17 @@ namespace {
         return std::string(TEST_WORKDIR "out/") + suite_name + "_" + test_name + ".png";
     }
 
+    /**
+	 * Gets the filename for the saved kdtree of the current test
+	 * @return
+	 */
+    std::string current_test_kdtree_filename()
+    {
+        std::string const& suite_name = ::testing::UnitTest::GetInstance()->current_test_info()->test_suite_name();
+        std::string const& test_name = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        return std::string(TEST_WORKDIR "out/") + suite_name + "_" + test_name + ".kdtree";
+    }
+
     /**
      * Saves the graph of the current test
      * @param kd 
@@ -66,6 +79,82 @@ namespace {
         t.save(current_test_filename().c_str());
     }
 
+    /**
+     * Prints the quality of the tree and the cost of the queries done since the last reset_histograms
+     * @param kd
+     */
+    void print_kdtree_stats(kdtree const& kd)
+    {
+        auto tree = kd.compute_tree_stats();
+        std::cout << std::setw(20) << "kdtree SAH cost: " << tree.sah_cost << std::endl;
+        std::cout << std::setw(20) << "kdtree leaves: " << tree.leaves << " (" << tree.empty_leaves << " empty)" << std::endl;
+        std::cout << std::setw(20) << "kdtree references: " << tree.references << std::endl;
+
+        auto queries = kdtree::collect_histograms();
+        if (queries.queries == 0)
+            return;
+        std::cout << std::setw(20) << "nodes per query: " << double(queries.totals.nodes_visited) / queries.queries << std::endl;
+        std::cout << std::setw(20) << "leaves per query: " << double(queries.totals.leaves_visited) / queries.queries << std::endl;
+        std::cout << std::setw(20) << "tests per query: " << double(queries.totals.intersection_queries) / queries.queries << std::endl;
+        std::cout << std::setw(20) << "max stack depth: " << queries.totals.max_stack_depth << std::endl;
+    }
+
+    // The positions the brute force and the builds read are the geometry of the scene triangles
+    void assert_positions_match(scene const& scene)
+    {
+        ASSERT_EQ(scene.positions().size(), scene.triangles().size());
+        for (size_t i = 0; i < scene.triangles().size(); ++i)
+            ASSERT_EQ(std::memcmp(&scene.positions()[i], &scene.triangles()[i].geometry, sizeof(cs350::triangle)), 0);
+    }
+
+    void assert_same_hits(scene const& scene)
+    {
+        raytracing_query_stats stats{};
+        int                    size = 64;
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                glm::vec3 origin{0, 0, -panel_scale + 0.5f};
+                glm::vec3 direction{(x + 0.5f) / size - 0.5f, (y + 0.5f) / size - 0.5f, 1};
+                cs350::ray r(origin, direction);
+
+                auto bf = scene.get_closest_bf(r, stats);
+                auto kd = scene.get_closest_kdtree(r, stats);
+                ASSERT_EQ(bf(), kd());
+                if (bf())
+                    ASSERT_NEAR(bf.intersection_time, kd.intersection_time, 1e-4f);
+
+                auto instance_bf = scene.get_closest_instance(r, false, stats);
+                auto instance_kd = scene.get_closest_instance(r, true, stats);
+                ASSERT_EQ(instance_bf(), instance_kd());
+                if (instance_bf()) {
+                    ASSERT_NEAR(instance_bf.intersection_time, instance_kd.intersection_time, 1e-4f);
+                    ASSERT_EQ(instance_bf.instance, instance_kd.instance);
+                }
+                ASSERT_EQ(bf() || instance_bf(), scene.is_occluded(r, std::numeric_limits<float>::max(), stats));
+            }
+        }
+    }
+
+    // Pixels of two images of the same size that are not the same
+    int count_different_pixels(texture const& a, texture const& b)
+    {
+        int different = 0;
+        for (unsigned y = 0; y < a.height(); ++y)
+            for (unsigned x = 0; x < a.width(); ++x)
+                different += a.get_pixel(x, y) != b.get_pixel(x, y);
+        return different;
+    }
+
+    // Renders the triangles and the instances of the scene (kdtree built) with direct lighting
+    texture render_direct(scene const& scene, int size, cs350::camera const& camera, raytracing_config config)
+    {
+        texture output;
+        output.resize(size, size);
+        progressive_render render(&output, config);
+        render.run(direct_lighting_sample(scene, camera, size, size, config));
+        return output;
+    }
+
     void load_box(scene& scene)
     {
         cs350::material material{};
@@ -107,7 +196,6 @@ namespace {
         auto& kdtree = scene.kdtree();
         for (size_t j = 0; j < kdtree.nodes().size(); ++j) {
             auto& node = kdtree.nodes()[j];
-            auto& aabb = kdtree.aabbs()[j];
             if (node.is_leaf()) {
                 auto color = glm::linearRand(glm::vec3{0.01, 0.01, 0.01}, glm::vec3(1, 1, 1));
                 auto hsv   = glm::hsvColor(color);
@@ -143,7 +231,6 @@ namespace {
         auto& kdtree = scene.kdtree();
         for (size_t j = 0; j < kdtree.nodes().size(); ++j) {
             auto& node = kdtree.nodes()[j];
-            auto& aabb = kdtree.aabbs()[j];
             if (node.is_leaf()) {
                 for (size_t i = node.primitive_start(); i < node.primitive_start() + node.primitive_count(); ++i) {
                     // Material per triangle
@@ -249,7 +336,7 @@ namespace {
             kdconfig.max_depth         = 30;
 
             auto t1 = std::chrono::high_resolution_clock::now();
-            scene.build_kdtree(kdconfig);
+            scene.build_kdtree(kdconfig, current_test_kdtree_filename().c_str());
             auto t2                               = std::chrono::high_resolution_clock::now();
             auto int_ms                           = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1);
             config.stats.kdtree_build_duration_ms = int_ms.count();
@@ -258,6 +345,7 @@ namespace {
         // Render
         auto& stats = config.stats;
         std::cout << std::setw(20) << "kdtree build: " << stats.kdtree_build_duration_ms << "ms" << std::endl;
+        kdtree::reset_histograms();
         cs350::raytrace(&output, scene, camera, config);
         std::cout << std::setw(20) << "triangles: " << scene.triangles().size() << std::endl;
         std::cout << std::setw(20) << "intersection_tests: " << stats.intersection_tests << std::endl;
@@ -268,6 +356,9 @@ namespace {
         std::cout << std::setw(20) << "kdtree build: " << stats.kdtree_build_duration_ms << "ms" << std::endl;
         std::cout << std::setw(20) << "kdtree depth: " << scene.kdtree().get_depth() << std::endl;
         std::cout << std::setw(20) << "kdtree triangles: " << scene.kdtree().triangles().size() << std::endl;
+        std::cout << std::setw(20) << "kdtree build allocs: " << scene.kdtree().get_build_stats().allocations << std::endl;
+        std::cout << std::setw(20) << "kdtree build memory: " << scene.kdtree().get_build_stats().memory_upper_bound / 1024 << "KB" << std::endl;
+        print_kdtree_stats(scene.kdtree());
 
         return output;
     }
@@ -304,7 +395,7 @@ namespace {
             kdconfig.max_depth         = 30; //[INSTRUCTOR] Play with this number!
 
             auto t1 = std::chrono::high_resolution_clock::now();
-            scene.build_kdtree(kdconfig);
+            scene.build_kdtree(kdconfig, current_test_kdtree_filename().c_str());
             auto t2 = std::chrono::high_resolution_clock::now();
 
             auto int_ms                    = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1);
@@ -318,6 +409,7 @@ namespace {
 
         set_material_per_node(scene); // DEBUG
         //set_material_per_triangle(scene); // DEBUG
+        kdtree::reset_histograms();
         cs350::raytrace(&output, scene, camera, config);
         std::cout << std::setw(20) << "intersection_tests: " << stats.intersection_tests << std::endl;
         std::cout << std::setw(20) << "queries: " << stats.queries << std::endl;
@@ -327,6 +419,9 @@ namespace {
         std::cout << std::setw(20) << "kdtree build: " << stats.kdtree_build_duration_ms << "ms" << std::endl;
         std::cout << std::setw(20) << "kdtree depth: " << scene.kdtree().get_depth() << std::endl;
         std::cout << std::setw(20) << "kdtree triangles: " << scene.kdtree().triangles().size() << std::endl;
+        std::cout << std::setw(20) << "kdtree build allocs: " << scene.kdtree().get_build_stats().allocations << std::endl;
+        std::cout << std::setw(20) << "kdtree build memory: " << scene.kdtree().get_build_stats().memory_upper_bound / 1024 << "KB" << std::endl;
+        print_kdtree_stats(scene.kdtree());
         return output;
     }
 }
@@ -459,6 +554,120 @@ TEST(raytrace_fast, bunny_only)
     save_image(output);
 }
 
+TEST(raytrace_fast, cornell_instanced)
+{
+    cs350::scene scene;
+    load_box(scene);
+
+    // A row of suzannes sharing their triangles
+    for (int i = 0; i < 5; ++i)
+        scene.add_instance(c_mesh_suzanne, {-panel_scale + 1 + 2 * i, -panel_scale + 1, panel_scale * 0.5}, {0, 30.0f * i, 0}, glm::vec3{1}, material_default());
+    ASSERT_EQ(scene.shared_meshes().size(), 1u);
+    ASSERT_EQ(scene.instances().size(), 5u);
+
+    cs350::kdtree::config kdconfig{};
+    kdconfig.cost_intersection = 80;
+    kdconfig.cost_traversal    = 1;
+    kdconfig.max_depth         = 30;
+    scene.build_kdtree(kdconfig);
+    assert_same_hits(scene);
+
+    // Hits of the instances are in front of the box, given in the space of their mesh
+    raytracing_stats stats{};
+    cs350::ray       r({-panel_scale + 1, -panel_scale + 1, -panel_scale + 0.5f}, {0, 0, 1});
+    auto             box      = scene.get_closest_kdtree(r, stats);
+    auto             instance = scene.get_closest_instance(r, true, stats);
+    ASSERT_TRUE(box());
+    ASSERT_TRUE(instance());
+    ASSERT_EQ(instance.instance, &scene.instances()[0]);
+    ASSERT_LT(instance.intersection_time, box.intersection_time);
+    ASSERT_NEAR(intersection_ray_triangle(r, instance.world_geometry()), instance.intersection_time, 1e-3f);
+
+    // Moving one only rebuilds the top level
+    scene.set_instance_transform(2, glm::translate(glm::vec3{0, 0, -1}));
+    scene.update_kdtree();
+    assert_same_hits(scene);
+}
+
+TEST(raytrace_fast, cornell_instanced_direct)
+{
+    cs350::kdtree::config kdconfig{};
+    kdconfig.cost_intersection = 80;
+    kdconfig.cost_traversal    = 1;
+    kdconfig.max_depth         = 30;
+
+    cs350::scene box;
+    load_box(box);
+    box.build_kdtree(kdconfig);
+
+    // A row of blue suzannes in front of the back wall, inside the field of view (the box has no blue surface)
+    cs350::scene scene;
+    load_box(scene);
+    cs350::material blue = material_default();
+    blue.diffuse         = {0, 0, 1};
+    for (int i = 0; i < 5; ++i)
+        scene.add_instance(c_mesh_suzanne, {-3 + 1.5f * i, -1, 2}, {0, 180 + 30.0f * i, 0}, glm::vec3{1}, blue);
+    scene.build_kdtree(kdconfig);
+
+    raytracing_config config  = ray_config_diffuse_only();
+    config.progressive_samples = 4;
+    auto empty                 = render_direct(box, 128, camera_default(), config);
+    auto output                = render_direct(scene, 128, camera_default(), config);
+    save_image(output);
+
+    // The instances are drawn in front of the box, and shadow it
+    int drawn = 0;
+    for (unsigned y = 0; y < output.height(); ++y) {
+        for (unsigned x = 0; x < output.width(); ++x) {
+            unsigned pixel = output.get_pixel(x, y);
+            drawn += (pixel >> 8 & 0xff) > (pixel >> 24) + 32;
+        }
+    }
+    ASSERT_GT(drawn, 128 * 128 / 50);
+    ASSERT_GT(count_different_pixels(empty, output), drawn);
+
+    // Same image tracing every triangle of every instance
+    config.progressive_samples = 1;
+    auto kd                    = render_direct(scene, 64, camera_default(), config);
+    config.use_kdtree          = false;
+    auto bf                    = render_direct(scene, 64, camera_default(), config);
+    ASSERT_LE(count_different_pixels(kd, bf), 64 * 64 / 100);
+}
+
+TEST(raytrace_fast, cornell_incremental)
+{
+    cs350::scene scene;
+    load_box(scene);
+    auto suzanne = scene.add_mesh(c_mesh_suzanne, {panel_scale * 0.5, -panel_scale + 1, panel_scale * 0.5}, {0, 30, 0}, glm::vec3{1}, material_default());
+
+    cs350::kdtree::config kdconfig{};
+    kdconfig.cost_intersection = 80;
+    kdconfig.cost_traversal    = 1;
+    kdconfig.max_depth         = 30;
+    scene.build_kdtree(kdconfig);
+    // Never merged, to test the secondary tree
+    scene.set_merge_fraction(1.0f);
+
+    // Moved and added meshes
+    scene.set_mesh_transform(suzanne, glm::translate(glm::vec3{-panel_scale * 0.5, -panel_scale + 1, 0}));
+    scene.add_mesh(c_mesh_bunny, {panel_scale * 0.5, -panel_scale + 1, panel_scale * 0.5}, {0, 30, 0}, glm::vec3{5}, material_default());
+    scene.update_kdtree();
+    ASSERT_TRUE(scene.meshes()[suzanne].dirty);
+    ASSERT_FALSE(scene.secondary_kdtree().nodes().empty());
+    assert_positions_match(scene);
+
+    // Same hits as the brute force
+    assert_same_hits(scene);
+
+    // Merged back on the next full update
+    scene.set_merge_fraction(0.0f);
+    scene.update_kdtree();
+    ASSERT_FALSE(scene.meshes()[suzanne].dirty);
+
+    auto output = render_standard(scene, camera_default());
+    save_image(output);
+}
+
 TEST(raytrace_fancy, cornell_boxes)
 {
     cs350::scene scene;
@@ -0,0 +1,97 @@
+#include <atomic>
+#include "common.hpp"
+#include "raytracer.hpp"
+#include "tile_scheduler.hpp"
+
+namespace {
+    /**
+     * Color of a pixel depending only on its position, slow on some rows (like pixels hitting the mesh)
+     * @param x
+     * @param y
+     * @return unsigned
+     */
+    unsigned shade(unsigned x, unsigned y)
+    {
+        unsigned color      = x * 73856093u ^ y * 19349663u;
+        unsigned iterations = (y / 7) % 3 == 0 ? 2000 : 10;
+        for (unsigned i = 0; i < iterations; ++i)
+            color = color * 1664525u + 1013904223u;
+        return color;
+    }
+
+    /**
+     * Renders an image with the scheduler
+     * @param scheduler
+     * @param w
+     * @param h
+     * @param stats, merge of the stats of every worker
+     * @return std::vector<unsigned>
+     */
+    std::vector<unsigned> render(cs350::tile_scheduler& scheduler, unsigned w, unsigned h, cs350::raytracing_stats& stats)
+    {
+        std::vector<unsigned>                pixels(w * h);
+        std::vector<cs350::raytracing_stats> worker_stats(scheduler.worker_count());
+        scheduler.run([&](cs350::tile const& t, unsigned worker) {
+            for (unsigned y = t.y0; y < t.y1; ++y)
+                for (unsigned x = t.x0; x < t.x1; ++x) {
+                    pixels[y * w + x] = shade(x, y);
+                    worker_stats[worker].queries++;
+                }
+        });
+
+        stats = {};
+        for (auto const& it : worker_stats)
+            stats += it;
+        return pixels;
+    }
+}
+
+namespace cs350 {
+    TEST(tile_scheduler, covers_every_pixel_once)
+    {
+        unsigned       w = 131, h = 67;
+        tile_scheduler scheduler(w, h, 16, 4);
+        ASSERT_EQ(scheduler.tiles().size(), 9u * 5u);
+
+        std::vector<std::atomic<unsigned>> visits(w * h);
+        scheduler.run([&](tile const& t, unsigned) {
+            for (unsigned y = t.y0; y < t.y1; ++y)
+                for (unsigned x = t.x0; x < t.x1; ++x)
+                    visits[y * w + x]++;
+        });
+
+        for (auto const& it : visits)
+            ASSERT_EQ(it.load(), 1u);
+    }
+
+    TEST(tile_scheduler, same_image_any_thread_count)
+    {
+        unsigned         w = 200, h = 120;
+        raytracing_stats serial_stats{}, parallel_stats{};
+
+        tile_scheduler serial(w, h, 16, 1);
+        tile_scheduler parallel(w, h, 16, 8);
+        ASSERT_EQ(serial.worker_count(), 1u);
+        ASSERT_EQ(parallel.worker_count(), 8u);
+
+        auto serial_pixels   = render(serial, w, h, serial_stats);
+        auto parallel_pixels = render(parallel, w, h, parallel_stats);
+        ASSERT_EQ(serial_pixels, parallel_pixels);
+        ASSERT_EQ(serial.steals(), 0u);
+
+        // Counters of every worker end up on the merge
+        ASSERT_EQ(serial_stats.queries, w * h);
+        ASSERT_EQ(parallel_stats.queries, w * h);
+    }
+
+    TEST(tile_scheduler, more_threads_than_tiles)
+    {
+        tile_scheduler scheduler(10, 10, 16, 8);
+        ASSERT_EQ(scheduler.tiles().size(), 1u);
+        ASSERT_EQ(scheduler.worker_count(), 1u);
+
+        tile_scheduler empty(0, 0, 16, 8);
+        ASSERT_EQ(empty.tiles().size(), 0u);
+        empty.run([](tile const&, unsigned) { FAIL(); });
+    }
+}
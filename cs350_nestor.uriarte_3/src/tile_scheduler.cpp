@@ -0,0 +1,129 @@
+/**
+* @file		 tile_scheduler.cpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the implementation of the tile_scheduler
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#include <algorithm>
+#include <future>
+#include <thread>
+#include "tile_scheduler.hpp"
+
+namespace cs350 {
+
+/**
+* @brief	splits the image in tiles and creates the queue of each worker
+* @param	unsigned width
+* @param	unsigned height
+* @param	unsigned tile_size
+* @param	unsigned threads
+**/
+	tile_scheduler::tile_scheduler(unsigned width, unsigned height, unsigned tile_size, unsigned threads)
+	{
+		tile_size = std::max(tile_size, 1u);
+
+		//tiles in row order, the last ones of each row and column cut by the image
+		for (unsigned y = 0; y < height; y += tile_size)
+			for (unsigned x = 0; x < width; x += tile_size)
+				m_tiles.push_back({ x, y, std::min(x + tile_size, width), std::min(y + tile_size, height) });
+
+		//every core by default, never more workers than tiles
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		threads = std::max(1u, std::min(threads, static_cast<unsigned>(m_tiles.size())));
+
+		for (unsigned i = 0; i < threads; i++)
+			m_queues.push_back(std::make_unique<worker_queue>());
+	}
+
+/**
+* @brief	runs the function on every tile, one task per worker
+* @param	tile_function const& fn
+* @return		void
+**/
+	void tile_scheduler::run(tile_function const& fn)
+	{
+		unsigned workers = worker_count();
+		unsigned count = static_cast<unsigned>(m_tiles.size());
+
+		//each worker gets a contiguous share, neighbouring tiles tend to cost the same
+		for (unsigned i = 0; i < workers; i++)
+		{
+			auto& queue = m_queues[i]->tiles;
+			queue.clear();
+			for (unsigned j = count * i / workers; j < count * (i + 1) / workers; j++)
+				queue.push_back(j);
+		}
+		m_steal_count = 0;
+
+		//the calling thread is the first worker
+		std::vector<std::future<void>> tasks;
+		for (unsigned i = 1; i < workers; i++)
+			tasks.push_back(std::async(std::launch::async, [this, i, &fn]() { work(i, fn); }));
+		work(0, fn);
+
+		for (auto& it : tasks)
+			it.get();
+
+		m_steals = m_steal_count;
+	}
+
+/**
+* @brief	runs the tiles of a worker, then the ones it can steal
+* @param	unsigned worker
+* @param	tile_function const& fn
+* @return		void
+**/
+	void tile_scheduler::work(unsigned worker, tile_function const& fn)
+	{
+		unsigned index;
+		while (pop(worker, &index) || steal(worker, &index))
+			fn(m_tiles[index], worker);
+	}
+
+/**
+* @brief	takes the next tile of the share of a worker
+* @param	unsigned worker
+* @param	unsigned* tile_index
+* @return		bool, false if the share is empty
+**/
+	bool tile_scheduler::pop(unsigned worker, unsigned* tile_index)
+	{
+		worker_queue& queue = *m_queues[worker];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (queue.tiles.empty())
+			return false;
+
+		*tile_index = queue.tiles.front();
+		queue.tiles.pop_front();
+		return true;
+	}
+
+/**
+* @brief	takes the last tile of the share of another worker, starting by the next one
+* @param	unsigned thief
+* @param	unsigned* tile_index
+* @return		bool, false if there is nothing left to steal
+**/
+	bool tile_scheduler::steal(unsigned thief, unsigned* tile_index)
+	{
+		unsigned workers = worker_count();
+		for (unsigned i = 1; i < workers; i++)
+		{
+			worker_queue& queue = *m_queues[(thief + i) % workers];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+
+			if (queue.tiles.empty())
+				continue;
+
+			*tile_index = queue.tiles.back();
+			queue.tiles.pop_back();
+			m_steal_count++;
+			return true;
+		}
+
+		return false;
+	}
+}
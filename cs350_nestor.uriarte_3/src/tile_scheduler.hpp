@@ -0,0 +1,86 @@
+/**
+* @file		 tile_scheduler.hpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 This file contains the definition of the tile_scheduler, renders an image by tiles on every core
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#pragma once
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cs350 {
+
+    /**
+     * Rectangle of pixels rendered as a unit, [x0, x1) x [y0, y1)
+     */
+    struct tile
+    {
+        unsigned x0;
+        unsigned y0;
+        unsigned x1;
+        unsigned y1;
+    };
+
+    /**
+     * Splits an image in tiles and renders them on every core. Each worker starts with a contiguous share of
+     * the tiles and, once done with it, steals tiles from the end of the share of the others, so workers
+     * that got cheap tiles (sky) help the ones that got expensive ones.
+     * Tiles never overlap, so as long as a pixel only depends on its position the image is the same
+     * whatever the amount of workers.
+     */
+    class tile_scheduler
+    {
+      public:
+        /**
+         * Renders a tile, worker is in [0, worker_count()) and unique to the thread running it
+         */
+        using tile_function = std::function<void(tile const& t, unsigned worker)>;
+
+        /**
+         * @param width
+         * @param height
+         * @param tile_size, side of the tiles in pixels (the ones on the borders may be smaller)
+         * @param threads, workers to use (0 uses every core)
+         */
+        tile_scheduler(unsigned width, unsigned height, unsigned tile_size, unsigned threads = 0);
+
+        /**
+         * Runs the function on every tile, returning once all of them are done.
+         * With a single worker tiles are run on the calling thread in row order
+         * @param fn
+         */
+        void run(tile_function const& fn);
+
+        [[nodiscard]] unsigned                 worker_count() const noexcept { return static_cast<unsigned>(m_queues.size()); }
+        [[nodiscard]] std::vector<tile> const& tiles() const noexcept { return m_tiles; }
+        // Tiles run by a worker other than the one they were given to, on the last run
+        [[nodiscard]] size_t steals() const noexcept { return m_steals; }
+
+      private:
+        /**
+         * Tiles left of a worker, the owner takes from the front and thieves from the back
+         */
+        struct worker_queue
+        {
+            std::mutex           mutex;
+            std::deque<unsigned> tiles;
+        };
+
+        void work(unsigned worker, tile_function const& fn);
+        bool pop(unsigned worker, unsigned* tile_index);
+        bool steal(unsigned thief, unsigned* tile_index);
+
+        // Every tile, in row order
+        std::vector<tile> m_tiles;
+        // Tiles left of each worker
+        std::vector<std::unique_ptr<worker_queue>> m_queues;
+        // Counter of the current run
+        std::atomic<size_t> m_steal_count{0};
+        size_t              m_steals = 0;
+    };
+}
@@ -0,0 +1,87 @@
+/**
+* @file		 tune.cpp
+* @author	 Nestor Uriarte,  nestor.uriarte@digipen.edu
+* @date		 Thu Nov 26 03:37:29 2020
+* @brief	 Tool tuning the kdtree config of a scene: tune <output> <width> <height> <mesh.obj>...
+*			writes the best config to <output>.cfg and the timings to <output>.txt
+* @copyright Copyright (C) 2020 DigiPen Institute of Technology .
+*/
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "kdtree_tuner.hpp"
+#include "material.hpp"
+#include "scene.hpp"
+
+namespace {
+    // Side of the image the sample rays are taken from (the render is scaled to the given size)
+    const unsigned c_sample_size = 128;
+
+    /**
+     * Primary rays of the camera the tests use, 60 degrees of vertical field of view
+     * @param width
+     * @param height
+     * @return std::vector<cs350::ray>
+     */
+    std::vector<cs350::ray> sample_rays(unsigned width, unsigned height)
+    {
+        glm::vec3 center{0, 0, -3};
+        glm::vec3 view{0, 0, 1};
+        glm::vec3 up{0, 1, 0};
+        glm::vec3 right  = glm::normalize(glm::cross(view, up));
+        float     half_h = std::tan(glm::radians(30.0f));
+        float     half_w = half_h * static_cast<float>(width) / static_cast<float>(height);
+
+        std::vector<cs350::ray> rays;
+        for (unsigned y = 0; y < height; ++y) {
+            for (unsigned x = 0; x < width; ++x) {
+                float     u = (2.0f * (x + 0.5f) / width - 1.0f) * half_w;
+                float     v = (1.0f - 2.0f * (y + 0.5f) / height) * half_h;
+                glm::vec3 direction = view + right * u + up * v;
+                rays.emplace_back(center, direction);
+            }
+        }
+        return rays;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 5) {
+        std::cerr << "usage: " << argv[0] << " <output> <width> <height> <mesh.obj>..." << std::endl;
+        return 1;
+    }
+
+    std::string output = argv[1];
+    unsigned    width  = static_cast<unsigned>(std::atoi(argv[2]));
+    unsigned    height = static_cast<unsigned>(std::atoi(argv[3]));
+
+    // Meshes at the origin, as the tests place them
+    cs350::scene    scene;
+    cs350::material material{};
+    for (int i = 4; i < argc; ++i)
+        scene.add_mesh(argv[i], {0, 0, 0}, {0, 0, 0}, glm::vec3{1}, material);
+
+    // Sampled on a smaller image with the same aspect
+    unsigned sample_h = std::max(1u, c_sample_size * height / std::max(width, 1u));
+    auto     rays     = sample_rays(c_sample_size, sample_h);
+
+    cs350::kdtree_tuner::settings settings;
+    settings.render_rays = static_cast<size_t>(width) * height;
+
+    cs350::kdtree_tuner tuner(scene.triangles(), rays);
+    auto                result = tuner.run(settings);
+
+    if (!cs350::kdtree_tuner::save_config((output + ".cfg").c_str(), result.best_config())) {
+        std::cerr << "could not write " << output << ".cfg" << std::endl;
+        return 1;
+    }
+
+    std::ofstream report(output + ".txt");
+    report << "triangles: " << scene.triangles().size() << ", render: " << width << "x" << height << std::endl;
+    cs350::kdtree_tuner::write_report(report, result);
+    cs350::kdtree_tuner::write_report(std::cout, result);
+    return 0;
+}